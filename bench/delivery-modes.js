@@ -0,0 +1,65 @@
+'use strict';
+
+// Compares main thread wakeups and CPU time of the delivery modes, fed by the
+// native synthetic event source.
+//
+//   node bench/delivery-modes.js [eventsPerSecond] [secondsPerMode]
+
+const ioHook = require('../index');
+
+const rate = Number(process.argv[2]) || 2000;
+const seconds = Number(process.argv[3]) || 3;
+
+const modes = [
+  ['immediate', 0],
+  ['batched', 16],
+  ['batched', 50],
+];
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function runMode(mode, intervalMs) {
+  ioHook.unload();
+  await sleep(100);
+
+  ioHook.useSyntheticSource(true, rate);
+  ioHook.setDeliveryMode(mode, intervalMs);
+
+  let received = 0;
+  const onMove = () => received++;
+  ioHook.on('mousemove', onMove);
+
+  ioHook.load();
+  ioHook.start();
+  await sleep(100);
+
+  const before = ioHook.getStats().drain;
+  const cpuBefore = process.cpuUsage();
+  const receivedBefore = received;
+  await sleep(seconds * 1000);
+  const cpu = process.cpuUsage(cpuBefore);
+  const after = ioHook.getStats().drain;
+
+  ioHook.removeListener('mousemove', onMove);
+
+  const wakeups = after.wakeups - before.wakeups;
+  return {
+    mode: intervalMs > 0 ? `${mode} ${intervalMs}ms` : mode,
+    'events/s': Math.round((received - receivedBefore) / seconds),
+    'wakeups/s': Math.round(wakeups / seconds),
+    'events/wakeup': +((received - receivedBefore) / wakeups).toFixed(1),
+    'cpu ms/s': +((cpu.user + cpu.system) / 1000 / seconds).toFixed(1),
+    'max blocked ms': +after.maxBlockedMs.toFixed(2),
+  };
+}
+
+(async () => {
+  const results = [];
+  for (const [mode, intervalMs] of modes) {
+    results.push(await runMode(mode, intervalMs));
+  }
+
+  ioHook.unload();
+  console.log(`synthetic source: ${rate} events/s, ${seconds}s per mode`);
+  console.table(results);
+})();
@@ -0,0 +1,65 @@
+'use strict';
+
+// Per-event cost of on() versus onFast() for mousemove, measured by feeding
+// preshaped native messages straight into the JS handler.
+//
+//   node bench/fast-listener.js [events]
+
+const ioHook = require('../index');
+
+const count = Number(process.argv[2]) || 2000000;
+
+function message(i) {
+  return {
+    type: 9,
+    mask: 0,
+    time: i,
+    mouse: { button: 0, clicks: 0, x: i & 1023, y: i & 511 },
+  };
+}
+
+function run(label, subscribe, unsubscribe) {
+  let sum = 0;
+  const listener = (event) => {
+    sum += event.x;
+  };
+  subscribe(listener);
+
+  // Build the messages up front so only dispatch is measured.
+  const messages = new Array(count);
+  for (let i = 0; i < count; i++) {
+    messages[i] = message(i);
+  }
+
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < count; i++) {
+    ioHook._handler(messages[i]);
+  }
+  const elapsed = Number(process.hrtime.bigint() - start);
+
+  unsubscribe(listener);
+  return { listener: label, 'ns/event': +(elapsed / count).toFixed(1), sum };
+}
+
+ioHook.start();
+
+const results = [];
+for (let round = 0; round < 2; round++) {
+  results.push(
+    run(
+      'on',
+      (fn) => ioHook.on('mousemove', fn),
+      (fn) => ioHook.removeListener('mousemove', fn)
+    )
+  );
+  results.push(
+    run(
+      'onFast',
+      (fn) => ioHook.onFast('mousemove', fn),
+      (fn) => ioHook.offFast('mousemove', fn)
+    )
+  );
+}
+
+ioHook.unload();
+console.table(results.slice(2));
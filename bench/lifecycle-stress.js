@@ -0,0 +1,92 @@
+'use strict';
+
+// Hammers start/stop/restart cycles while the native synthetic source floods
+// the event queue, and reports start and stop latency percentiles. Run it
+// against a sanitizer build (see docs/manual-build.md) to catch races and
+// leaks in the hook lifecycle.
+//
+//   node bench/lifecycle-stress.js [cycles] [eventsPerSecond]
+
+const ioHook = require('../index');
+
+const cycles = Number(process.argv[2]) || 200;
+const rate = Number(process.argv[3]) || 0;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function waitFor(predicate, timeoutMs) {
+  return new Promise((resolve, reject) => {
+    const deadline = Date.now() + timeoutMs;
+    (function poll() {
+      if (predicate()) return resolve();
+      if (Date.now() > deadline) return reject(new Error('timed out'));
+      setImmediate(poll);
+    })();
+  });
+}
+
+function percentiles(values) {
+  const sorted = values.slice().sort((a, b) => a - b);
+  const at = (p) =>
+    sorted.length
+      ? +sorted[Math.min(sorted.length - 1, Math.round(p * (sorted.length - 1)))].toFixed(3)
+      : 0;
+  return { p50: at(0.5), p95: at(0.95), p99: at(0.99), max: at(1) };
+}
+
+(async () => {
+  // The hook is started when the module is loaded; replace it.
+  ioHook.unload();
+  await sleep(100);
+
+  ioHook.useSyntheticSource(true, rate);
+
+  let received = 0;
+  ioHook.on('mousemove', () => received++);
+
+  const startLatency = [];
+  const stopLatency = [];
+  const nativeStopLatency = [];
+  let failures = 0;
+
+  for (let i = 0; i < cycles; i++) {
+    try {
+      const before = received;
+      let t = process.hrtime.bigint();
+      ioHook.load();
+      ioHook.start();
+      await waitFor(() => received > before, 5000);
+      startLatency.push(Number(process.hrtime.bigint() - t) / 1e6);
+
+      // Some cycles restart right away, so the stop below may arrive before
+      // the new hook thread is up.
+      if (i % 4 === 0) {
+        ioHook.unload();
+        ioHook.load();
+        ioHook.start();
+      }
+
+      const stops = ioHook.getStats().lifecycle.stops;
+      t = process.hrtime.bigint();
+      ioHook.unload();
+      await waitFor(() => ioHook.getStats().lifecycle.stops > stops, 5000);
+      stopLatency.push(Number(process.hrtime.bigint() - t) / 1e6);
+      nativeStopLatency.push(ioHook.getStats().lifecycle.lastStopMs);
+    } catch (e) {
+      failures++;
+      ioHook.unload();
+      await sleep(100);
+    }
+  }
+
+  const stats = ioHook.getStats();
+  console.log(`${cycles} cycles, ${failures} failures, ${received} events received`);
+  console.table({
+    'start (ms, to first event)': percentiles(startLatency),
+    'stop (ms, to hook joined)': percentiles(stopLatency),
+    'stop (ms, native)': percentiles(nativeStopLatency),
+  });
+  console.log('queue', stats.queue, 'lifecycle', stats.lifecycle);
+
+  process.exit(failures ? 1 : 0);
+})();
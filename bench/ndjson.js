@@ -0,0 +1,93 @@
+'use strict';
+
+// Compares main thread CPU time of logging events as JSON lines with
+// JSON.stringify per event against native NDJSON delivery, fed by the native
+// synthetic event source. Lines go to a stream that discards them, so only
+// serialization and delivery are measured.
+//
+//   node bench/ndjson.js [eventsPerSecond] [secondsPerMode]
+
+const { Writable } = require('stream');
+const ioHook = require('../index');
+
+const rate = Number(process.argv[2]) || 20000;
+const seconds = Number(process.argv[3]) || 3;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function sink() {
+  const stream = new Writable({
+    write(chunk, encoding, callback) {
+      stream.bytes += chunk.length;
+      callback();
+    },
+  });
+  stream.bytes = 0;
+  return stream;
+}
+
+async function runMode(name, ndjson) {
+  ioHook.unload();
+  await sleep(100);
+
+  ioHook.useSyntheticSource(true, rate);
+  ioHook.setNdjsonMode(ndjson);
+
+  const out = sink();
+  let received = 0;
+  let onEvent;
+  if (ndjson) {
+    onEvent = (buffer) => {
+      received += countLines(buffer);
+      out.write(buffer);
+    };
+    ioHook.on('ndjson', onEvent);
+  } else {
+    onEvent = (event) => {
+      received++;
+      out.write(JSON.stringify(event) + '\n');
+    };
+    ioHook.on('mousemove', onEvent);
+  }
+
+  ioHook.load();
+  ioHook.start();
+  await sleep(100);
+
+  const cpuBefore = process.cpuUsage();
+  const receivedBefore = received;
+  const bytesBefore = out.bytes;
+  await sleep(seconds * 1000);
+  const cpu = process.cpuUsage(cpuBefore);
+
+  ioHook.removeListener(ndjson ? 'ndjson' : 'mousemove', onEvent);
+  ioHook.setNdjsonMode(false);
+
+  const events = received - receivedBefore;
+  const cpuUs = cpu.user + cpu.system;
+  return {
+    mode: name,
+    'events/s': Math.round(events / seconds),
+    'MB/s': +((out.bytes - bytesBefore) / 1e6 / seconds).toFixed(2),
+    'cpu ms/s': +(cpuUs / 1000 / seconds).toFixed(1),
+    'cpu us/event': +(cpuUs / events).toFixed(2),
+  };
+}
+
+function countLines(buffer) {
+  let lines = 0;
+  for (let i = buffer.indexOf(10); i !== -1; i = buffer.indexOf(10, i + 1)) {
+    lines++;
+  }
+  return lines;
+}
+
+(async () => {
+  const results = [];
+  results.push(await runMode('JSON.stringify', false));
+  results.push(await runMode('native ndjson', true));
+
+  ioHook.unload();
+  console.log(`synthetic source: ${rate} events/s, ${seconds}s per mode`);
+  console.table(results);
+})();
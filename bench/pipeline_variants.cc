@@ -0,0 +1,109 @@
+/*
+ * Per-event cost of the pipeline worker loop for every combination of
+ * optional features, each run with the loop compiled for exactly that
+ * combination ("specialized") and with the one that checks them all
+ * ("generic", what every batch paid for before).
+ *
+ *   cmake --build build --target iohook-bench-pipeline
+ *   ./build/iohook-bench-pipeline [batches]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "clock.h"
+#include "event_filter.h"
+#include "event_sampler.h"
+#include "flight_recorder.h"
+#include "iohook_core.h"
+#include "key_sketch.h"
+
+#define BENCH_BATCH_SIZE    256
+
+static void configure(uint32_t features) {
+  key_sketch_enable((features & IOHOOK_FEATURE_KEY_STATS) != 0);
+  flight_recorder_configure((features & IOHOOK_FEATURE_HISTORY) ? 4096 : 0, 0, false);
+
+  filter_program *filter = nullptr;
+  if (features & IOHOOK_FEATURE_FILTER) {
+    filter = new filter_program();
+    std::string error;
+    filter_compile("type != mousedrag", filter, &error);
+  }
+  iohook_core_set_filter(filter);
+
+  sampler_config sampler;
+  memset(&sampler, 0, sizeof(sampler_config));
+  sampler.mode = (features & IOHOOK_FEATURE_SAMPLER) ? SAMPLER_EVERY : SAMPLER_NONE;
+  sampler.n = 1;
+  sampler_configure(EVENT_MOUSE_MOVED, sampler);
+}
+
+// Mostly mouse moves, with a key press and release every 16 events.
+static void make_events(std::vector<uiohook_event> *events) {
+  events->resize(BENCH_BATCH_SIZE);
+  for (size_t i = 0; i < events->size(); i++) {
+    uiohook_event &event = (*events)[i];
+    memset(&event, 0, sizeof(uiohook_event));
+    event.time = 1000 + i;
+
+    if (i % 16 == 7 || i % 16 == 8) {
+      event.type = i % 16 == 7 ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+      event.data.keyboard.keycode = (uint16_t) (0x10 + i % 10);
+    } else {
+      event.type = EVENT_MOUSE_MOVED;
+      event.data.mouse.x = (int16_t) i;
+      event.data.mouse.y = (int16_t) (i / 2);
+    }
+  }
+}
+
+static double ns_per_event(iohook_process_proc process, const std::vector<uiohook_event> &events, size_t batches) {
+  std::vector<uiohook_event> out;
+  out.reserve(events.size());
+
+  uint64_t start = monotonic_ns();
+  for (size_t i = 0; i < batches; i++) {
+    out.clear();
+    process(events.data(), events.size(), &out);
+  }
+  return (double) (monotonic_ns() - start) / (double) (batches * events.size());
+}
+
+static std::string feature_names(uint32_t features) {
+  static const char *names[] = { "keystats", "history", "filter", "sampler" };
+
+  std::string result;
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (features & (1u << i)) {
+      result += result.empty() ? names[i] : std::string("+") + names[i];
+    }
+  }
+  return result.empty() ? "none" : result;
+}
+
+int main(int argc, char **argv) {
+  size_t batches = argc > 1 ? (size_t) strtoull(argv[1], nullptr, 10) : 20000;
+
+  std::vector<uiohook_event> events;
+  make_events(&events);
+
+  printf("%-34s %14s %14s\n", "features", "specialized", "generic");
+  for (uint32_t features = 0; features <= IOHOOK_FEATURE_ALL; features++) {
+    configure(features);
+
+    // Warm up both loops, then time them.
+    ns_per_event(iohook_core_process_proc(features), events, batches / 10 + 1);
+    ns_per_event(iohook_core_process_proc(IOHOOK_FEATURE_ALL), events, batches / 10 + 1);
+    double specialized = ns_per_event(iohook_core_process_proc(features), events, batches);
+    double generic = ns_per_event(iohook_core_process_proc(IOHOOK_FEATURE_ALL), events, batches);
+
+    printf("%-34s %11.2f ns %11.2f ns\n", feature_names(features).c_str(), specialized, generic);
+  }
+
+  configure(0);
+  return 0;
+}
@@ -0,0 +1,89 @@
+'use strict';
+
+// Measures how long the watchdog takes to bring the hook back after it died.
+//
+//   node bench/watchdog-recovery.js [cycles]
+//     The synthetic source fails after a few events, like a backend that lost
+//     its connection. Measures the restart path alone.
+//
+//   node bench/watchdog-recovery.js --xvfb [cycles]
+//     Runs the hook against an Xvfb server that is killed and started again
+//     on the same display, so the real backend fails and reconnects. Needs
+//     Xvfb in the PATH. Note that Xlib may end the process when it loses the
+//     display before the hook notices.
+
+const { spawn } = require('child_process');
+const ioHook = require('../index');
+
+const xvfb = process.argv.includes('--xvfb');
+const cycles = Number(process.argv.filter((arg) => arg !== '--xvfb')[2]) || 20;
+const display = ':' + (90 + (process.pid % 10));
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function startServer() {
+  const server = spawn('Xvfb', [display, '-nolisten', 'tcp'], { stdio: 'ignore' });
+  return sleep(300).then(() => server);
+}
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor((p / 100) * sorted.length))];
+}
+
+(async () => {
+  let server = null;
+  if (xvfb) {
+    process.env.DISPLAY = display;
+    server = await startServer();
+  } else {
+    ioHook.useSyntheticSource(true, 100000, 1000, true);
+  }
+
+  ioHook.setWatchdog({ minBackoffMs: 10, maxBackoffMs: 1000 });
+
+  const recoveries = [];
+  let downAt = 0;
+  let done;
+  const finished = new Promise((resolve) => (done = resolve));
+
+  ioHook.on('status', (status) => {
+    if (status.state === 'down' && downAt === 0) {
+      downAt = process.hrtime.bigint();
+    } else if (status.state === 'up' && downAt !== 0) {
+      recoveries.push(Number(process.hrtime.bigint() - downAt) / 1e6);
+      downAt = 0;
+      if (recoveries.length >= cycles) {
+        done();
+      } else if (server) {
+        server.kill('SIGKILL');
+        startServer().then((next) => (server = next));
+      }
+    }
+  });
+
+  ioHook.start();
+  if (server) {
+    await sleep(500);
+    server.kill('SIGKILL');
+    server = await startServer();
+  }
+
+  await finished;
+  const stats = ioHook.getStats().watchdog;
+  ioHook.unload();
+  if (server) {
+    server.kill();
+  }
+
+  recoveries.sort((a, b) => a - b);
+  console.log(`${recoveries.length} recoveries (${xvfb ? 'Xvfb' : 'synthetic'})`);
+  console.table({
+    'recovery ms': {
+      min: +recoveries[0].toFixed(2),
+      p50: +percentile(recoveries, 50).toFixed(2),
+      p99: +percentile(recoveries, 99).toFixed(2),
+      max: +recoveries[recoveries.length - 1].toFixed(2),
+    },
+  });
+  console.log(stats);
+})();
@@ -4,7 +4,7 @@ const path = require('path');
 const tar = require('tar');
 const argv = require('minimist')(process.argv.slice(2), {
   // Specify that these arguments should be a string
-  string: ['version', 'runtime', 'abi'],
+  string: ['version', 'runtime', 'abi', 'sanitize'],
 });
 const pkg = require('./package.json');
 const nodeAbi = require('node-abi');
@@ -164,6 +164,11 @@ function build(runtime, version, abi) {
       }
     }
 
+    // Instrumented builds for the lifecycle stress benchmark (linux/macOS)
+    if (argv.sanitize) {
+      args.push('--iohook_sanitizer=' + argv.sanitize);
+    }
+
     console.log('Building iohook for ' + runtime + ' v' + version + '>>>>');
     if (process.platform === 'win32') {
       if (version.split('.')[0] >= 4) {
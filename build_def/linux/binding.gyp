@@ -1,11 +1,51 @@
 {
+	"variables": {
+		"iohook_sanitizer%": ""
+	},
 	"targets": [{
 		"target_name": "iohook",
 		"win_delay_load_hook": "true",
 		"type": "loadable_module",
 		"sources": [
 			"src/iohook.cc",
-			"src/iohook.h"
+			"src/iohook.h",
+			"src/iohook_core.cc",
+			"src/iohook_core.h",
+			"src/clock.h",
+			"src/macro_player.cc",
+			"src/macro_player.h",
+			"src/analytics.cc",
+			"src/analytics.h",
+			"src/synthetic_source.cc",
+			"src/synthetic_source.h",
+			"src/event_filter.cc",
+			"src/event_filter.h",
+			"src/event_json.cc",
+			"src/event_json.h",
+			"src/event_projection.cc",
+			"src/event_projection.h",
+			"src/epoch_guard.h",
+			"src/event_ring.h",
+			"src/event_sampler.cc",
+			"src/event_sampler.h",
+			"src/packed_event.h",
+			"src/flight_recorder.cc",
+			"src/flight_recorder.h",
+			"src/hook_watchdog.cc",
+			"src/hook_watchdog.h",
+			"src/input_state.cc",
+			"src/input_state.h",
+			"src/iohook_plugin.h",
+			"src/key_sketch.cc",
+			"src/key_sketch.h",
+			"src/pipeline.cc",
+			"src/pipeline.h",
+			"src/plugin_host.cc",
+			"src/plugin_host.h",
+			"src/raw_input.cc",
+			"src/raw_input.h",
+			"src/x11_guard.cc",
+			"src/x11_guard.h"
 		],
 		"dependencies": [
 			"./uiohook.gyp:uiohook"
@@ -20,13 +60,27 @@
 		"link_settings": {
 				"libraries": [
 						"-Wl,-rpath,<!(node -e \"console.log('builds/' + process.env.gyp_iohook_runtime + '-v' + process.env.gyp_iohook_abi + '-' + process.env.gyp_iohook_platform + '-' + process.env.gyp_iohook_arch + '/build/Release')\")",
-						"-Wl,-rpath,<!(pwd)/build/Release/"
+						"-Wl,-rpath,<!(pwd)/build/Release/",
+						"-ldl",
+						"-lXi"
 				]
 		},
 		"include_dirs": [
 			"<!(node -e \"require('nan')\")",
 			"libuiohook/include"
 		],
+		"conditions": [
+			["iohook_sanitizer!=''", {
+				"cflags": [
+					"-fsanitize=<(iohook_sanitizer)",
+					"-fno-omit-frame-pointer",
+					"-g"
+				],
+				"ldflags": [
+					"-fsanitize=<(iohook_sanitizer)"
+				]
+			}]
+		],
 		"configurations": {
 			"Release": {
 			}
@@ -5,7 +5,44 @@
 		"type": "loadable_module",
 		"sources": [
 			"src/iohook.cc",
-			"src/iohook.h"
+			"src/iohook.h",
+			"src/iohook_core.cc",
+			"src/iohook_core.h",
+			"src/clock.h",
+			"src/macro_player.cc",
+			"src/macro_player.h",
+			"src/analytics.cc",
+			"src/analytics.h",
+			"src/synthetic_source.cc",
+			"src/synthetic_source.h",
+			"src/event_filter.cc",
+			"src/event_filter.h",
+			"src/event_json.cc",
+			"src/event_json.h",
+			"src/event_projection.cc",
+			"src/event_projection.h",
+			"src/epoch_guard.h",
+			"src/event_ring.h",
+			"src/event_sampler.cc",
+			"src/event_sampler.h",
+			"src/packed_event.h",
+			"src/flight_recorder.cc",
+			"src/flight_recorder.h",
+			"src/hook_watchdog.cc",
+			"src/hook_watchdog.h",
+			"src/input_state.cc",
+			"src/input_state.h",
+			"src/iohook_plugin.h",
+			"src/key_sketch.cc",
+			"src/key_sketch.h",
+			"src/pipeline.cc",
+			"src/pipeline.h",
+			"src/plugin_host.cc",
+			"src/plugin_host.h",
+			"src/raw_input.cc",
+			"src/raw_input.h",
+			"src/x11_guard.cc",
+			"src/x11_guard.h"
 		],
 		"dependencies": [
 			"./uiohook.gyp:uiohook"
@@ -0,0 +1,401 @@
+/*
+ * iohook-cli: records hooked input to stdout or a file without Node, from
+ * the same engine as the addon (src/iohook_core.h).
+ *
+ *   iohook-cli --types keydown,keyup -o keys.ndjson
+ *   iohook-cli --format binary --duration 60 > input.bin
+ *   iohook-cli --bench --synthetic 100000 --duration 10
+ *   xvfb-run -a iohook-cli --bench --inject 20000 --duration 10
+ *
+ * Events are written by a thread of their own, so a slow disk or pipe never
+ * holds up the hook; if the writer falls too far behind, events are dropped
+ * and counted like in the addon.  Hook failures, restarts and stalls are
+ * reported on stderr; the exit status is 1 if the hook failed for good.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock.h"
+#include "event_filter.h"
+#include "event_json.h"
+#include "hook_watchdog.h"
+#include "iohook_core.h"
+#include "packed_event.h"
+#include "pipeline.h"
+#include "synthetic_source.h"
+
+#define CLI_BATCH_SIZE      1024
+
+// Binary output: this header, then one packed_event per event with times
+// relative to time_base (the time of the first event), in native byte order.
+struct cli_binary_header {
+  char magic[4];        // "IOHB"
+  uint32_t version;     // 1
+  uint64_t time_base;
+};
+
+struct cli_options {
+  const char *output;
+  bool binary;
+  std::string filter;
+  uint64_t count;
+  double duration;
+  double synthetic_rate;
+  double inject_rate;
+  bool bench;
+};
+
+static std::atomic<bool> sInterrupted(false);
+static std::atomic<bool> sWriterDone(false);
+static std::atomic<uint64_t> sReceived(0);
+
+// Written by the writer thread only.
+static uint64_t sDeliverCount = 0;
+static uint64_t sDeliverTotalNs = 0;
+static uint64_t sDeliverMaxNs = 0;
+
+static void interrupt_proc(int) {
+  sInterrupted.store(true);
+}
+
+static void usage(FILE *out) {
+  fprintf(out,
+      "Usage: iohook-cli [options]\n"
+      "  -o, --output FILE     write events to FILE instead of stdout\n"
+      "  -f, --format FORMAT   ndjson (default) or binary\n"
+      "  -t, --types LIST      only these event types, e.g. keydown,mousemove\n"
+      "      --filter EXPR     only events matching a filter expression\n"
+      "  -n, --count N         stop after N events\n"
+      "  -d, --duration SEC    stop after SEC seconds\n"
+      "      --synthetic RATE  generate RATE mouse moves per second instead of\n"
+      "                        hooking the OS (0 for as fast as possible)\n"
+      "      --inject RATE     post RATE mouse moves per second through the OS\n"
+      "      --bench           report the received rate and latency every second\n"
+      "                        instead of writing events\n"
+      "  -h, --help\n");
+}
+
+static bool parse_options(int argc, char **argv, cli_options *options) {
+  std::string types;
+  options->output = nullptr;
+  options->binary = false;
+  options->count = 0;
+  options->duration = 0;
+  options->synthetic_rate = -1;
+  options->inject_rate = 0;
+  options->bench = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool takes_value = true;
+
+    if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+      options->output = value;
+    } else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--format") == 0) {
+      if (value == nullptr || (strcmp(value, "ndjson") != 0 && strcmp(value, "binary") != 0)) {
+        fprintf(stderr, "iohook-cli: unknown format %s\n", value != nullptr ? value : "");
+        return false;
+      }
+      options->binary = strcmp(value, "binary") == 0;
+    } else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--types") == 0) {
+      types = value != nullptr ? value : "";
+    } else if (strcmp(arg, "--filter") == 0) {
+      options->filter = value != nullptr ? value : "";
+    } else if (strcmp(arg, "-n") == 0 || strcmp(arg, "--count") == 0) {
+      options->count = value != nullptr ? strtoull(value, nullptr, 10) : 0;
+    } else if (strcmp(arg, "-d") == 0 || strcmp(arg, "--duration") == 0) {
+      options->duration = value != nullptr ? atof(value) : 0;
+    } else if (strcmp(arg, "--synthetic") == 0) {
+      options->synthetic_rate = value != nullptr ? atof(value) : 0;
+    } else if (strcmp(arg, "--inject") == 0) {
+      options->inject_rate = value != nullptr ? atof(value) : 0;
+    } else if (strcmp(arg, "--bench") == 0) {
+      options->bench = true;
+      takes_value = false;
+    } else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+      usage(stdout);
+      exit(0);
+    } else {
+      fprintf(stderr, "iohook-cli: unknown option %s\n", arg);
+      return false;
+    }
+
+    if (takes_value) {
+      if (value == nullptr) {
+        fprintf(stderr, "iohook-cli: %s needs a value\n", arg);
+        return false;
+      }
+      i++;
+    }
+  }
+
+  // The type list is a shorthand for a filter expression.
+  if (!types.empty()) {
+    std::string expression = "type in (" + types + ")";
+    options->filter = options->filter.empty() ? expression : "(" + options->filter + ") && " + expression;
+  }
+  return true;
+}
+
+// Writer thread.  Drains the engine queue in batches and writes them with a
+// single fwrite() each.
+static void writer_thread_proc(FILE *out, const cli_options *options) {
+  std::vector<uiohook_event> events(CLI_BATCH_SIZE);
+  std::vector<char> buffer(CLI_BATCH_SIZE * (options->binary ? sizeof(packed_event) : EVENT_JSON_MAX_LENGTH));
+  uint64_t time_base = 0;
+  bool header_written = false;
+
+  for (;;) {
+    bool done = sWriterDone.load();
+    iohook_core_wait(100);
+
+    uint64_t wakeup_ns;
+    if (iohook_core_begin_drain(&wakeup_ns)) {
+      uint64_t latency = monotonic_ns() - wakeup_ns;
+      sDeliverCount++;
+      sDeliverTotalNs += latency;
+      if (latency > sDeliverMaxNs) {
+        sDeliverMaxNs = latency;
+      }
+    }
+
+    size_t count;
+    while ((count = iohook_core_pull(events.data(), CLI_BATCH_SIZE)) > 0) {
+      if (options->count > 0) {
+        uint64_t received = sReceived.load();
+        if (received >= options->count) {
+          break;
+        }
+        if (count > options->count - received) {
+          count = (size_t) (options->count - received);
+        }
+      }
+      sReceived.fetch_add(count);
+
+      if (options->bench) {
+        continue;
+      }
+
+      char *cursor = buffer.data();
+      if (options->binary) {
+        if (!header_written) {
+          time_base = events[0].time;
+          cli_binary_header header = { { 'I', 'O', 'H', 'B' }, 1, time_base };
+          fwrite(&header, sizeof(header), 1, out);
+          header_written = true;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+          pack_event(events[i], time_base, (packed_event *) cursor);
+          cursor += sizeof(packed_event);
+        }
+      } else {
+        for (size_t i = 0; i < count; i++) {
+          cursor += event_json_write(events[i], cursor);
+        }
+      }
+      fwrite(buffer.data(), 1, (size_t) (cursor - buffer.data()), out);
+    }
+
+    if (!options->bench) {
+      fflush(out);
+    }
+
+    if (done) {
+      break;
+    }
+  }
+}
+
+// Posts mouse moves through the OS, alternating between two points so that
+// every one of them is a real move.
+static void inject_thread_proc(double rate) {
+  uiohook_event event;
+  memset(&event, 0, sizeof(uiohook_event));
+  event.type = EVENT_MOUSE_MOVED;
+
+  uint64_t start = monotonic_ns();
+  uint64_t sent = 0;
+  while (!sWriterDone.load()) {
+    uint64_t due = (uint64_t) (rate * (double) (monotonic_ns() - start) / 1e9);
+    for (; sent < due; sent++) {
+      event.data.mouse.x = (int16_t) (100 + (sent & 1));
+      event.data.mouse.y = 100;
+      hook_post_event(&event);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+static double mean_us(const latency_counter &latency) {
+  uint64_t count = latency.count.load(std::memory_order_relaxed);
+  return count > 0 ? (double) latency.total_ns.load(std::memory_order_relaxed) / count / 1e3 : 0.0;
+}
+
+static void print_bench(double seconds, uint64_t received) {
+  pipeline_stats pipeline;
+  pipeline_get_stats(&pipeline);
+  iohook_core_stats core;
+  iohook_core_get_stats(&core);
+
+  fprintf(stderr, "%7.1fs %10.0f ev/s  queue %7.1f us  process %6.2f us  deliver %7.1f us (max %7.1f)  dropped %llu\n",
+      seconds, (double) received / (seconds > 0 ? seconds : 1),
+      mean_us(*pipeline.queue), mean_us(*pipeline.process),
+      sDeliverCount > 0 ? (double) sDeliverTotalNs / sDeliverCount / 1e3 : 0.0,
+      (double) sDeliverMaxNs / 1e3,
+      (unsigned long long) (pipeline.dropped + core.queue_dropped));
+}
+
+// Reports the statuses posted since the last call on stderr.  Returns false
+// once the hook is down for good: it failed before it ever came up, e.g.
+// without a display or the needed permissions, or the watchdog is disabled.
+static bool report_statuses() {
+  std::vector<iohook_status> statuses;
+  iohook_core_take_statuses(&statuses);
+
+  bool alive = true;
+  for (const iohook_status &status : statuses) {
+    if (strcmp(status.state, "down") == 0) {
+      fprintf(stderr, "iohook-cli: hook down (attempt %u, status %d)\n", status.attempt, status.code);
+
+      iohook_core_stats stats;
+      iohook_core_get_stats(&stats);
+      watchdog_config config;
+      watchdog_get_config(&config);
+      if (stats.starts == 0 || !config.enabled) {
+        alive = false;
+      }
+    } else if (strcmp(status.state, "restarting") == 0 && alive) {
+      fprintf(stderr, "iohook-cli: restarting the hook in %u ms\n", status.delay_ms);
+    } else if (strcmp(status.state, "stalled") == 0) {
+      fprintf(stderr, "iohook-cli: hook stalled, no events for %.0f ms\n", status.idle_ms);
+    } else if (strcmp(status.state, "up") == 0) {
+      fprintf(stderr, "iohook-cli: hook up again after %.0f ms\n", status.downtime_ms);
+    }
+  }
+  return alive;
+}
+
+int main(int argc, char **argv) {
+  cli_options options;
+  if (!parse_options(argc, argv, &options)) {
+    usage(stderr);
+    return 2;
+  }
+
+  if (!options.filter.empty()) {
+    filter_program *filter = new filter_program();
+    std::string error;
+    if (!filter_compile(options.filter.c_str(), filter, &error)) {
+      fprintf(stderr, "iohook-cli: invalid filter: %s\n", error.c_str());
+      delete filter;
+      return 2;
+    }
+    iohook_core_set_filter(filter);
+  }
+
+  FILE *out = stdout;
+  if (options.output != nullptr && !options.bench) {
+    out = fopen(options.output, options.binary ? "wb" : "w");
+    if (out == nullptr) {
+      fprintf(stderr, "iohook-cli: cannot open %s\n", options.output);
+      return 1;
+    }
+  }
+  #ifdef _WIN32
+  else if (options.binary) {
+    _setmode(_fileno(stdout), _O_BINARY);
+  }
+  #endif
+
+  if (options.synthetic_rate >= 0) {
+    synthetic_set_rate(options.synthetic_rate);
+    iohook_core_use_synthetic_source(true);
+  }
+
+  signal(SIGINT, interrupt_proc);
+  signal(SIGTERM, interrupt_proc);
+
+  std::thread writer(writer_thread_proc, out, &options);
+  if (!iohook_core_start(nullptr, nullptr)) {
+    fprintf(stderr, "iohook-cli: cannot start the hook\n");
+    sWriterDone.store(true);
+    iohook_core_wakeup();
+    writer.join();
+    return 1;
+  }
+
+  std::thread injector;
+  if (options.inject_rate > 0) {
+    injector = std::thread(inject_thread_proc, options.inject_rate);
+  }
+
+  uint64_t start = monotonic_ns();
+  uint64_t last_report = start;
+  uint64_t last_received = 0;
+  bool failed = false;
+  while (!sInterrupted.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    if (!report_statuses()) {
+      failed = true;
+      break;
+    }
+
+    uint64_t now = monotonic_ns();
+    if (options.bench && now - last_report >= 1000000000ULL) {
+      uint64_t received = sReceived.load();
+      print_bench((double) (now - last_report) / 1e9, received - last_received);
+      last_report = now;
+      last_received = received;
+    }
+
+    if (options.duration > 0 && (double) (now - start) / 1e9 >= options.duration) {
+      break;
+    }
+    if (options.count > 0 && sReceived.load() >= options.count) {
+      break;
+    }
+  }
+
+  iohook_core_stop();
+  report_statuses();
+  sWriterDone.store(true);
+  iohook_core_wakeup();
+  writer.join();
+  if (injector.joinable()) {
+    injector.join();
+  }
+
+  if (options.bench) {
+    double seconds = (double) (monotonic_ns() - start) / 1e9;
+    fprintf(stderr, "total:\n");
+    print_bench(seconds, sReceived.load());
+  }
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  iohook_core_stats stats;
+  iohook_core_get_stats(&stats);
+  if (stats.starts == 0) {
+    fprintf(stderr, "iohook-cli: the hook never came up\n");
+    return 1;
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+'use strict';
+
+// Build the plugin first, see the top of throttle.c.
+const path = require('path');
+const ioHook = require('iohook');
+
+const name = ioHook.loadPlugin(path.join(__dirname, 'throttle.so'));
+
+ioHook.on('mousemove', (event) => {
+  console.log(event.x, event.y);
+});
+
+ioHook.start();
+
+setInterval(() => {
+  console.log(name, ioHook.getStats().plugins);
+}, 5000);
@@ -0,0 +1,62 @@
+/*
+ * Example iohook plugin: lets at most one mouse move per 8 milliseconds
+ * through to JavaScript, and hands key presses to JavaScript right away.
+ *
+ *   cc -shared -fPIC -O2 -I../../src throttle.c -o throttle.so
+ *   (Windows: cl /LD /O2 /I..\..\src throttle.c)
+ */
+#include <stdlib.h>
+
+#include "iohook_plugin.h"
+
+#define THROTTLE_MS 8
+
+typedef struct {
+  uint64_t last_move;
+} throttle_state;
+
+static int throttle_init(const iohook_plugin_host *host, void **user_data) {
+  throttle_state *state = (throttle_state *) calloc(1, sizeof(throttle_state));
+  if (state == NULL) {
+    return 1;
+  }
+
+  *user_data = state;
+  return 0;
+}
+
+static void throttle_process(void *user_data, iohook_plugin_event *events, size_t count, uint8_t *verdicts) {
+  throttle_state *state = (throttle_state *) user_data;
+
+  for (size_t i = 0; i < count; i++) {
+    switch (events[i].type) {
+      case IOHOOK_PLUGIN_EVENT_MOUSE_MOVED:
+        if (events[i].time - state->last_move < THROTTLE_MS) {
+          verdicts[i] = IOHOOK_PLUGIN_SUPPRESS;
+        } else {
+          state->last_move = events[i].time;
+        }
+        break;
+
+      case IOHOOK_PLUGIN_EVENT_KEY_PRESSED:
+        verdicts[i] = IOHOOK_PLUGIN_FORWARD_TO_JS;
+        break;
+    }
+  }
+}
+
+static void throttle_shutdown(void *user_data) {
+  free(user_data);
+}
+
+static const iohook_plugin plugin = {
+  IOHOOK_PLUGIN_ABI_VERSION,
+  "throttle",
+  throttle_init,
+  throttle_process,
+  throttle_shutdown
+};
+
+IOHOOK_PLUGIN_EXPORT const iohook_plugin *iohook_plugin_register(void) {
+  return &plugin;
+}
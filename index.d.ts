@@ -31,6 +31,136 @@ declare class IOHook extends EventEmitter {
    */
   setDebug(mode: boolean): void;
 
+  /**
+   * Enable/Disable struct-of-arrays batch delivery through the `batch` event
+   * @param {boolean} enabled
+   */
+  setBatchMode(enabled: boolean): void;
+
+  /**
+   * Enable/Disable native NDJSON delivery through the `ndjson` event
+   * @param {boolean} enabled
+   */
+  setNdjsonMode(enabled: boolean): void;
+
+  /**
+   * Limit the events and time spent per drain of the native queue
+   * @param {number} [maxEvents] 0 for no limit
+   * @param {number} [maxMs] 0 for no limit
+   */
+  setDrainBudget(maxEvents?: number, maxMs?: number): void;
+
+  /**
+   * Choose immediate delivery or batched delivery with a bounded delay
+   * @param {string} mode
+   * @param {number} [intervalMs] Maximum delay in batched mode, defaults to 16
+   */
+  setDeliveryMode(mode: 'immediate' | 'batched', intervalMs?: number): void;
+
+  /**
+   * Merge consecutive wheel events scrolling the same way into one event.
+   * Has no effect in batch or NDJSON mode, which deliver every wheel event
+   * @param {boolean} enabled
+   */
+  setWheelCoalescing(enabled: boolean): void;
+
+  /**
+   * Replace the OS hook with a synthetic event source on the next load()
+   * @param {boolean} enabled
+   * @param {number} [rate] Events per second
+   * @param {number} [limit] Total events to generate
+   * @param {boolean} [failAtLimit] Fail like a disconnected backend at the limit
+   */
+  useSyntheticSource(enabled: boolean, rate?: number, limit?: number, failAtLimit?: boolean): void;
+
+  /**
+   * Sample events of one type natively
+   * @param {string} eventName
+   * @param {IOHookSamplerOptions | null} options
+   */
+  setSampler(eventName: string, options: IOHookSamplerOptions | null): void;
+
+  /**
+   * Configure the hook watchdog, which reports through 'status' events
+   * @param {IOHookWatchdogOptions | boolean} options false to disable
+   */
+  setWatchdog(options?: IOHookWatchdogOptions | boolean): void;
+
+  /**
+   * Turn native key usage statistics on or off
+   * @param {boolean} enabled
+   */
+  enableKeyStats(enabled: boolean): void;
+
+  /**
+   * Most frequent key bigrams, trigrams and chords
+   * @param {number} [limit]
+   */
+  getKeyStats(limit?: number): IOHookKeyStats;
+
+  /**
+   * Estimated count of a key bigram or trigram
+   * @param {number[]} keycodes
+   */
+  estimateKeySequence(keycodes: number[]): number;
+
+  /**
+   * Snapshot of the key statistics
+   */
+  exportKeyStats(): Buffer;
+
+  /**
+   * Add a snapshot to the current key statistics
+   * @param {Buffer} snapshot
+   */
+  importKeyStats(snapshot: Buffer): void;
+
+  /**
+   * Clear the key statistics
+   */
+  resetKeyStats(): void;
+
+  /**
+   * Configure the native event history. Typed keys are redacted unless
+   * `redact` is false
+   * @param {IOHookHistoryOptions} options
+   */
+  setHistory(options?: IOHookHistoryOptions): void;
+
+  /**
+   * Copy the event history without pausing the hook
+   */
+  dumpHistory(options?: { binary?: false }): IOHookEventBatch;
+  dumpHistory(options: { binary: true }): { timeBase: number; events: Buffer };
+
+  /**
+   * Whether a key is held right now
+   * @param {number} keycode
+   */
+  isKeyDown(keycode: number): boolean;
+
+  /**
+   * Whether a mouse button is held right now
+   * @param {number} button
+   */
+  isButtonDown(button: number): boolean;
+
+  /**
+   * Current input state, tracked natively from hooked events
+   */
+  getInputState(): IOHookInputState;
+
+  /**
+   * Get native delivery statistics
+   */
+  getStats(): IOHookStats;
+
+  /**
+   * Compute per-batch statistics natively
+   * @param {IOHookEventBatch} batch
+   */
+  analyzeBatch(batch: IOHookEventBatch): IOHookBatchAnalysis;
+
   /**
    * Specify that key event's `rawcode` property should be used instead of
    * `keycode` when listening for key presses.
@@ -41,6 +171,24 @@ declare class IOHook extends EventEmitter {
    */
   useRawcode(using: boolean): void;
 
+  /**
+   * Register a listener called directly for every event of a type, bypassing EventEmitter
+   * @param {string} eventName
+   * @param {Function} listener
+   */
+  onFast(
+    eventName: string,
+    listener: (event: IOHookEvent) => void,
+    options?: { fields: string[] } | string[]
+  ): this;
+
+  /**
+   * Remove a listener registered with onFast()
+   * @param {string} eventName
+   * @param {Function} listener
+   */
+  offFast(eventName: string, listener: (event: IOHookEvent) => void): this;
+
   /**
    * Register global shortcut. When all keys in keys array pressed, callback will be called
    * @param {Array<string|number>} keys Array of keycodes
@@ -70,6 +218,43 @@ declare class IOHook extends EventEmitter {
    * Unregister all shortcuts
    */
   unregisterAllShortcuts(): void;
+
+  /**
+   * Replay a timed sequence of events from a native playback thread
+   * @param {Array<IOHookMacroStep>} steps Events with a `time` in milliseconds relative to the start
+   * @return {Promise<IOHookMacroStats>} Actual-vs-planned timing statistics
+   */
+  playMacro(steps: Array<IOHookMacroStep>): Promise<IOHookMacroStats>;
+
+  /**
+   * Stop the macro currently being played
+   */
+  stopMacro(): void;
+
+  /**
+   * Enable or disable raw XInput 2 events (Linux only)
+   * @param {Boolean} enabled
+   */
+  setRawInput(enabled: boolean): void;
+
+  /**
+   * Filter events natively before they are queued for JavaScript
+   * @param {string|null} expression
+   */
+  setFilter(expression: string | null): void;
+
+  /**
+   * Load a native plugin implementing the C ABI of src/iohook_plugin.h
+   * @param {string} libraryPath
+   * @return {string} Name of the plugin
+   */
+  loadPlugin(libraryPath: string): string;
+
+  /**
+   * Unload a native plugin
+   * @param {string} name
+   */
+  unloadPlugin(name: string): boolean;
 }
 
 declare interface IOHookEvent {
@@ -81,6 +266,180 @@ declare interface IOHookEvent {
   clicks?: number;
   x?: number;
   y?: number;
+  sourceid?: number;
+  dx?: number;
+  dy?: number;
+  detail?: number;
+}
+
+declare type IOHookSamplerOptions =
+  | { every: number }
+  | { interval: number }
+  | { reservoir: number; window?: number };
+
+declare interface IOHookKeyStats {
+  enabled: boolean;
+  keystrokes: number;
+  bigrams: { keys: number[]; count: number; error: number }[];
+  trigrams: { keys: number[]; count: number; error: number }[];
+  chords: { modifiers: number; keycode: number; count: number; error: number }[];
+}
+
+declare interface IOHookHistoryOptions {
+  events?: number;
+  seconds?: number;
+  redact?: boolean;
+}
+
+declare interface IOHookInputState {
+  mask: number;
+  buttons: number;
+  x: number;
+  y: number;
+  keysDown: number;
+}
+
+declare interface IOHookWatchdogOptions {
+  stallMs?: number;
+  probeMs?: number;
+  minBackoffMs?: number;
+  maxBackoffMs?: number;
+}
+
+/**
+ * Payload of the 'status' event
+ */
+declare interface IOHookStatus {
+  state: 'down' | 'restarting' | 'stalled' | 'up';
+  attempt?: number;
+  code?: number;
+  delayMs?: number;
+  downtimeMs?: number;
+  idleMs?: number;
+}
+
+declare interface IOHookLatency {
+  count: number;
+  meanUs: number;
+  maxUs: number;
+}
+
+declare interface IOHookStats {
+  drain: {
+    wakeups: number;
+    drains: number;
+    events: number;
+    yields: number;
+    maxBlockedMs: number;
+  };
+  queue: {
+    capacity: number;
+    pending: number;
+    dropped: number;
+  };
+  lifecycle: {
+    starts: number;
+    stops: number;
+    lastStartMs: number;
+    lastStopMs: number;
+  };
+  raw: {
+    active: boolean;
+    pending: number;
+    dropped: number;
+  };
+  filter: {
+    active: boolean;
+    evaluated: number;
+    rejected: number;
+  };
+  plugins: {
+    loaded: number;
+    batches: number;
+    processed: number;
+    suppressed: number;
+    forwarded: number;
+  };
+  pipeline: {
+    queued: number;
+    dropped: number;
+    pending: number;
+    batches: number;
+    queue: IOHookLatency;
+    process: IOHookLatency;
+    deliver: IOHookLatency;
+  };
+  history: {
+    capacity: number;
+    maxAge: number;
+    redact: boolean;
+    recorded: number;
+  };
+  sampling: {
+    [eventName: string]: {
+      seen: number;
+      sampled: number;
+    };
+  };
+  watchdog: {
+    state: 'stopped' | 'up' | 'down' | 'restarting' | 'stalled';
+    restarts: number;
+    stalls: number;
+    failures: number;
+    lastRecoveryMs: number;
+  };
+}
+
+declare interface IOHookEventBatch {
+  length: number;
+  type: Uint8Array;
+  time: Float64Array;
+  x: Int32Array;
+  y: Int32Array;
+  keycode: Uint16Array;
+  mask: Uint16Array;
+}
+
+declare interface IOHookBatchAnalysis {
+  kernel: 'avx2' | 'sse2' | 'scalar';
+  count: number;
+  typeCounts: Uint32Array;
+  modifierCounts: { shift: number; ctrl: number; meta: number; alt: number };
+  maskPopcount: number;
+  boundingBox: { minX: number; minY: number; maxX: number; maxY: number } | null;
+  moveCount: number;
+  pathLength: number;
+  maxVelocity: number;
+  velocityHistogram: Uint32Array;
+  accelerationHistogram: Uint32Array;
+}
+
+declare interface IOHookMacroStep {
+  type: string | number;
+  time: number;
+  mask?: number;
+  keycode?: number;
+  rawcode?: number;
+  keychar?: number;
+  button?: number;
+  clicks?: number;
+  x?: number;
+  y?: number;
+  rotation?: number;
+  delta?: number;
+  direction?: number;
+  scrollType?: number;
+}
+
+declare interface IOHookMacroStats {
+  planned: number;
+  played: number;
+  cancelled: boolean;
+  durationMs: number;
+  meanErrorUs: number;
+  maxErrorUs: number;
+  p50ErrorUs: number;
+  p99ErrorUs: number;
 }
 
 declare const iohook: IOHook;
@@ -33,8 +33,20 @@ const events = {
   9: 'mousemove',
   10: 'mousedrag',
   11: 'mousewheel',
+  32: 'rawmotion',
+  33: 'rawkeydown',
+  34: 'rawkeyup',
+  35: 'rawmousedown',
+  36: 'rawmouseup',
 };
 
+const keyEventTypes = { 3: true, 4: true, 5: true };
+
+const eventTypes = {};
+Object.keys(events).forEach((type) => {
+  eventTypes[events[type]] = Number(type);
+});
+
 class IOHook extends EventEmitter {
   constructor() {
     super();
@@ -42,6 +54,9 @@ class IOHook extends EventEmitter {
     this.shortcuts = [];
     this.eventProperty = 'keycode';
     this.activatedShortcuts = [];
+    this.fastListeners = {};
+    this.fastFields = {};
+    this.projections = {};
 
     this.lastKeydownShift = false;
     this.lastKeydownAlt = false;
@@ -50,6 +65,22 @@ class IOHook extends EventEmitter {
 
     this.load();
     this.setDebug(false);
+
+    // Listeners added with on() did not say what they read, so events they
+    // receive are built in full.
+    this.on('newListener', (eventName) => {
+      const type = eventTypes[eventName];
+      if (type !== undefined && this.projections[type] != null) {
+        this.projections[type] = null;
+        NodeHookAddon.setProjection(type, null);
+      }
+    });
+    this.on('removeListener', (eventName) => {
+      const type = eventTypes[eventName];
+      if (type !== undefined) {
+        this._updateProjection(type);
+      }
+    });
   }
 
   /**
@@ -72,6 +103,107 @@ class IOHook extends EventEmitter {
     }
   }
 
+  /**
+   * Register a fast listener, called directly for every event of the given
+   * type without going through EventEmitter. Mouse and wheel events that only
+   * have fast listeners also skip modifier and shortcut tracking. The event
+   * object may be reused afterwards; copy what you need to keep.
+   *
+   * With `fields`, only the listed properties are built natively, as long as
+   * every listener of the event type declared its fields. Key events always
+   * carry the modifier flags and the keycode (or rawcode, see useRawcode()),
+   * which modifier and shortcut tracking need.
+   * @param {string} eventName Event name, e.g. 'mousemove'
+   * @param {Function} listener
+   * @param {Object|Array} [options] `{ fields: ['x', 'y'] }`, or the array
+   * of fields alone
+   * @return {IOHook}
+   */
+  onFast(eventName, listener, options) {
+    const type = eventTypes[eventName];
+    if (type === undefined) {
+      throw new TypeError('Unknown event: ' + eventName);
+    }
+
+    const fields = Array.isArray(options) ? options : options && options.fields;
+
+    // Copy on write, so dispatching never has to copy the listener array.
+    const listeners = this.fastListeners[type] || [];
+    this.fastListeners[type] = listeners.concat([listener]);
+    this.fastFields[type] = (this.fastFields[type] || []).concat([fields || null]);
+
+    try {
+      this._updateProjection(type);
+    } catch (e) {
+      this.offFast(eventName, listener);
+      throw e;
+    }
+    return this;
+  }
+
+  /**
+   * Remove a listener registered with onFast()
+   * @param {string} eventName
+   * @param {Function} listener
+   * @return {IOHook}
+   */
+  offFast(eventName, listener) {
+    const type = eventTypes[eventName];
+    const kept = (this.fastListeners[type] || []).map((fn) => fn !== listener);
+    if (kept.every(Boolean)) {
+      return this;
+    }
+
+    const listeners = this.fastListeners[type].filter((fn, i) => kept[i]);
+    const fields = this.fastFields[type].filter((f, i) => kept[i]);
+    if (listeners.length > 0) {
+      this.fastListeners[type] = listeners;
+      this.fastFields[type] = fields;
+    } else {
+      delete this.fastListeners[type];
+      delete this.fastFields[type];
+    }
+
+    this._updateProjection(type);
+    return this;
+  }
+
+  /**
+   * Tell the native side which properties events of one type need: the
+   * fields declared by its fast listeners, or all of them.
+   * @param {number} type Event type
+   * @private
+   */
+  _updateProjection(type) {
+    // Raw input events are always built in full.
+    if (type > 11) return;
+
+    let fields = null;
+    const declared = this.fastFields[type];
+    if (
+      declared !== undefined &&
+      this.listenerCount(events[type]) === 0 &&
+      declared.every((f) => f !== null)
+    ) {
+      const names = new Set(
+        keyEventTypes[type]
+          ? ['shiftKey', 'altKey', 'ctrlKey', 'metaKey', this.eventProperty]
+          : []
+      );
+      declared.forEach((f) => f.forEach((name) => names.add(name)));
+      // `type` is set on every event by _handler.
+      names.delete('type');
+      fields = Array.from(names).sort();
+    }
+
+    const key = fields && fields.join(',');
+    const current = this.projections[type] === undefined ? null : this.projections[type];
+    if (current === key) return;
+
+    NodeHookAddon.setProjection(type, fields);
+    this.projections[type] = key;
+  }
+
   /**
    * Register global shortcut. When all keys in keys array pressed, callback will be called
    * @param {Array} keys Array of keycodes
@@ -175,6 +307,328 @@ class IOHook extends EventEmitter {
     NodeHookAddon.debugEnable(mode);
   }
 
+  /**
+   * Enable or disable batch delivery. In batch mode, events are no longer
+   * emitted one by one: each drain of the native queue emits a single `batch`
+   * event holding one typed array per field (`type`, `time`, `x`, `y`,
+   * `keycode`, `mask`), all of the same `length`.
+   * @param {Boolean} enabled
+   */
+  setBatchMode(enabled) {
+    NodeHookAddon.setBatchMode(!!enabled);
+  }
+
+  /**
+   * Enable or disable NDJSON delivery. Events are serialized natively, off
+   * the main thread, and emitted as `ndjson` events holding a Buffer of
+   * UTF-8 JSON lines, one per event, ready to be written to a stream.
+   * Takes precedence over batch mode.
+   * @param {Boolean} enabled
+   */
+  setNdjsonMode(enabled) {
+    NodeHookAddon.setNdjsonMode(!!enabled);
+  }
+
+  /**
+   * Limit how long a single drain of the native queue may block the event
+   * loop. Once either budget is exhausted the remaining events are delivered
+   * on a later loop iteration, so timers, I/O and rendering are not starved
+   * by a large backlog. In batch mode the time budget cuts the batch being
+   * built; the single listener call for that batch is not split. In NDJSON
+   * mode both budgets are checked between buffers, which are never split.
+   * @param {number} [maxEvents] Maximum events delivered per drain, 0 for no limit
+   * @param {number} [maxMs] Maximum time spent per drain in milliseconds, 0 for no limit
+   */
+  setDrainBudget(maxEvents, maxMs) {
+    NodeHookAddon.setDrainBudget(maxEvents || 0, maxMs || 0);
+  }
+
+  /**
+   * Choose between latency and throughput. In 'immediate' mode (default)
+   * events are delivered as soon as the main thread can be woken up. In
+   * 'batched' mode the main thread is woken up at most once per `intervalMs`
+   * and receives everything queued in the meantime; no event is held longer
+   * than `intervalMs`.
+   * @param {string} mode 'immediate' or 'batched'
+   * @param {number} [intervalMs] Maximum delivery delay in batched mode
+   */
+  setDeliveryMode(mode, intervalMs) {
+    if (mode === 'batched') {
+      NodeHookAddon.setDeliveryMode(intervalMs > 0 ? intervalMs : 16);
+    } else {
+      NodeHookAddon.setDeliveryMode(0);
+    }
+  }
+
+  /**
+   * Enable or disable raw input (Linux only, needs an X server with XInput
+   * 2.1). Raw events carry the id of the device they come from and, for
+   * motion, the unaccelerated relative movement: `rawmotion` (`sourceid`,
+   * `dx`, `dy`), `rawkeydown`/`rawkeyup` and `rawmousedown`/`rawmouseup`
+   * (`sourceid`, `detail`: X keycode or button number).
+   * @param {Boolean} enabled
+   * @throws {Error} If raw input is not available
+   */
+  setRawInput(enabled) {
+    NodeHookAddon.setRawInput(!!enabled);
+  }
+
+  /**
+   * Filter events natively, before they are queued for JavaScript. The
+   * expression is compiled once and evaluated on a native worker thread, e.g.
+   * `type in (keydown, keyup) && (mask & CTRL) && keycode in {30, 31, 32}`.
+   * Can be replaced at any time, also while the hook runs.
+   * @param {string|null} expression Filter expression, null or '' to remove the filter
+   * @throws {SyntaxError} If the expression is invalid
+   */
+  setFilter(expression) {
+    NodeHookAddon.setFilter(expression || '');
+  }
+
+  /**
+   * Merge bursts of wheel events natively. Consecutive queued `mousewheel`
+   * events scrolling the same way are delivered as a single event whose
+   * `rotation` and `delta` are summed and whose `count` holds the number of
+   * merged events, so smooth scrolling yields one update per drain.
+   * Only applies to per-event delivery: batch and NDJSON mode always deliver
+   * every wheel event, since their records have no field for the count.
+   * @param {Boolean} enabled
+   */
+  setWheelCoalescing(enabled) {
+    NodeHookAddon.setWheelCoalescing(!!enabled);
+  }
+
+  /**
+   * Replace the OS hook with a synthetic source generating mouse movement at
+   * a fixed rate. Meant for benchmarks and tests; takes effect on the next
+   * `load()`.
+   * @param {Boolean} enabled
+   * @param {number} [rate] Events per second, 0 for as fast as possible
+   * @param {number} [limit] Stop generating after this many events, 0 for no limit
+   * @param {Boolean} [failAtLimit] Fail like a disconnected backend once the
+   * limit is reached, to exercise the watchdog
+   */
+  useSyntheticSource(enabled, rate, limit, failAtLimit) {
+    NodeHookAddon.useSyntheticSource(
+      !!enabled,
+      rate === undefined ? 1000 : rate,
+      limit || 0,
+      !!failAtLimit
+    );
+  }
+
+  /**
+   * Sample events of one type natively, before they are queued for
+   * JavaScript. Counters of seen and sampled events are in
+   * `getStats().sampling` so that results can be re-weighted.
+   * @param {string} eventName Event type, e.g. 'mousemove'
+   * @param {Object|null} options `{ every: n }` for the first of every n
+   * events, `{ interval: ms }` for at most one event per interval or
+   * `{ reservoir: size, window: ms }` for a uniform sample of up to `size`
+   * events per window (delivered when the window closes); null to stop
+   * sampling
+   */
+  setSampler(eventName, options) {
+    const type = eventTypes[eventName];
+    // Raw input events do not go through the hook and cannot be sampled.
+    if (type === undefined || type > 11) {
+      throw new TypeError('Unknown event: ' + eventName);
+    }
+
+    if (!options) {
+      NodeHookAddon.setSampler(type, 0);
+    } else if (options.every !== undefined) {
+      NodeHookAddon.setSampler(type, 1, options.every);
+    } else if (options.interval !== undefined) {
+      NodeHookAddon.setSampler(type, 2, options.interval);
+    } else if (options.reservoir !== undefined) {
+      NodeHookAddon.setSampler(type, 3, options.reservoir, options.window || 1000);
+    } else {
+      throw new Error('setSampler expects every, interval or reservoir');
+    }
+  }
+
+  /**
+   * Configure the hook watchdog (on by default). A hook that fails is
+   * restarted after a delay that doubles with each failed attempt, and a
+   * hook that stops delivering events while the pointer keeps moving is
+   * restarted too. Changes are reported through 'status' events with a
+   * `state` of 'down', 'restarting', 'stalled' or 'up'.
+   * @param {Object|Boolean} options false to disable, or `{ stallMs,
+   * probeMs, minBackoffMs, maxBackoffMs }`; omitted values are unchanged
+   */
+  setWatchdog(options) {
+    if (options === false || options === null) {
+      NodeHookAddon.setWatchdog(false);
+      return;
+    }
+
+    options = options || {};
+    NodeHookAddon.setWatchdog(
+      true,
+      options.stallMs,
+      options.probeMs,
+      options.minBackoffMs,
+      options.maxBackoffMs
+    );
+  }
+
+  /**
+   * Turn native key usage statistics on or off (off by default). Key
+   * bigrams, trigrams and chords are counted in fixed memory, without
+   * sending keystrokes to JavaScript.
+   * @param {Boolean} enabled
+   */
+  enableKeyStats(enabled) {
+    NodeHookAddon.enableKeyStats(!!enabled);
+  }
+
+  /**
+   * Most frequent key bigrams, trigrams and chords
+   * @param {Number} [limit=256] Maximum entries per list
+   * @return {Object} `keystrokes` counted, `bigrams` and `trigrams` as
+   * `{ keys, count, error }` and `chords` as `{ modifiers, keycode, count,
+   * error }`, most frequent first; `count` may overcount by up to `error`
+   */
+  getKeyStats(limit) {
+    return NodeHookAddon.getKeyStats(limit === undefined ? 256 : limit);
+  }
+
+  /**
+   * Estimated count of any key bigram or trigram (never less than the true
+   * count)
+   * @param {Array<Number>} keycodes 2 or 3 keycodes
+   * @return {Number}
+   */
+  estimateKeySequence(keycodes) {
+    return NodeHookAddon.estimateKeySequence(keycodes);
+  }
+
+  /**
+   * Snapshot of the key statistics, to store and merge into a later session
+   * with importKeyStats()
+   * @return {Buffer}
+   */
+  exportKeyStats() {
+    return NodeHookAddon.exportKeyStats();
+  }
+
+  /**
+   * Add a snapshot from exportKeyStats() to the current statistics
+   * @param {Buffer} snapshot
+   * @throws {Error} If the snapshot is invalid or from an incompatible version
+   */
+  importKeyStats(snapshot) {
+    NodeHookAddon.importKeyStats(snapshot);
+  }
+
+  /**
+   * Clear the key statistics
+   */
+  resetKeyStats() {
+    NodeHookAddon.resetKeyStats();
+  }
+
+  /**
+   * Configure the native event history (flight recorder). It is on by
+   * default and keeps the last 4096 events, at most 30 seconds apart from
+   * the newest one.
+   * @param {Object} options
+   * @param {Number} [options.events=4096] Events kept, 16 bytes each; 0 turns
+   * the history off
+   * @param {Number} [options.seconds=30] Maximum age relative to the newest
+   * event; 0 for no limit
+   * @param {Boolean} [options.redact=true] Do not record which keys are typed,
+   * except modifiers and keys pressed with Ctrl, Alt or Meta. Only turn this
+   * off if the history may hold typed text, passwords included
+   */
+  setHistory(options = {}) {
+    NodeHookAddon.setHistory(
+      options.events === undefined ? 4096 : options.events,
+      options.seconds === undefined ? 30000 : options.seconds * 1000,
+      options.redact === undefined ? true : !!options.redact
+    );
+  }
+
+  /**
+   * Copy the event history without pausing the hook
+   * @param {Object} [options]
+   * @param {Boolean} [options.binary=false] Return `{ timeBase, events }`,
+   * `events` being a Buffer of 16 byte packed events, instead of a batch
+   * @return {Object} A batch object, as emitted by the `batch` event
+   */
+  dumpHistory(options = {}) {
+    return NodeHookAddon.dumpHistory(!!options.binary);
+  }
+
+  /**
+   * Whether a key is held right now, as tracked natively from hooked events
+   * (no event listener needed)
+   * @param {Number} keycode Keycode, as in `keydown` events
+   * @return {Boolean}
+   */
+  isKeyDown(keycode) {
+    return NodeHookAddon.isKeyDown(keycode);
+  }
+
+  /**
+   * Whether a mouse button is held right now
+   * @param {Number} button Button number, as in `mousedown` events
+   * @return {Boolean}
+   */
+  isButtonDown(button) {
+    return NodeHookAddon.isButtonDown(button);
+  }
+
+  /**
+   * Current input state, tracked natively from hooked events
+   * @return {Object} `mask`: modifier mask of the last event, `buttons`: bit
+   * (button - 1) set for each button held, `x`/`y`: last cursor position,
+   * `keysDown`: number of keys held
+   */
+  getInputState() {
+    return NodeHookAddon.getInputState();
+  }
+
+  /**
+   * Get native delivery statistics
+   * @return {Object} `drain`: number of main thread wakeups, drains, events delivered, drains
+   * that yielded because of the budget and the longest time (ms) the event
+   * loop was blocked by a drain. `queue`: capacity of the native queue,
+   * events pending in it and events dropped because it was full. `lifecycle`:
+   * hook starts and stops and how long the last ones took. `raw`: whether raw
+   * input is enabled, raw events pending and dropped. `filter`: whether
+   * a filter is set and how many events it evaluated and rejected.
+   * `plugins`: native plugins loaded and events they processed, suppressed
+   * and forwarded. `history`: event history settings and events recorded.
+   * `sampling`: events seen and sampled, per sampled event type.
+   * `pipeline`: events handed from the hook thread to the native worker
+   * thread and the latency of the queue, process and deliver stages.
+   * `watchdog`: hook state, restarts, stalls and failures and how long the
+   * last recovery took (ms)
+   */
+  getStats() {
+    const stats = NodeHookAddon.getStats();
+    const sampling = {};
+    for (const type in stats.sampling) {
+      sampling[events[type]] = stats.sampling[type];
+    }
+    stats.sampling = sampling;
+    return stats;
+  }
+
+  /**
+   * Compute statistics over a batch natively (SIMD where available): counts
+   * per event type and modifier, pointer bounding box, mouse path length and
+   * velocity/acceleration histograms.
+   * @param {Object} batch Object of parallel typed arrays, as emitted by the
+   * `batch` event
+   * @return {Object} Batch statistics
+   */
+  analyzeBatch(batch) {
+    return NodeHookAddon.analyzeBatch(batch);
+  }
+
   /**
    * Specify that key event's `rawcode` property should be used instead of
    * `keycode` when listening for key presses.
@@ -186,6 +640,65 @@ class IOHook extends EventEmitter {
   useRawcode(using) {
     // If true, use rawcode, otherwise use keycode
     this.eventProperty = using ? 'rawcode' : 'keycode';
+    Object.keys(keyEventTypes).forEach((type) => this._updateProjection(Number(type)));
+  }
+
+  /**
+   * Replay a timed sequence of events. Playback runs on a native thread with
+   * absolute deadlines, so it is not affected by a busy event loop.
+   * @param {Array<Object>} steps Events to inject. Each step has a `type`
+   * (event name such as 'keydown' or its numeric code), a `time` in
+   * milliseconds relative to the start of playback and the event fields
+   * (keycode, button, x, y, rotation...)
+   * @return {Promise<Object>} Resolves with the actual-vs-planned timing
+   * statistics once playback has finished or has been stopped; rejects with a
+   * TypeError if a step has an unknown type
+   */
+  playMacro(steps) {
+    return new Promise((resolve, reject) => {
+      const nativeSteps = steps.map((step) => {
+        const type =
+          typeof step.type === 'number' ? step.type : eventTypes[step.type];
+        if (events[type] === undefined) {
+          throw new TypeError('Unknown macro step type: ' + step.type);
+        }
+        return Object.assign({}, step, { type });
+      });
+      NodeHookAddon.playMacro(nativeSteps, (err, stats) => {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(stats);
+        }
+      });
+    });
+  }
+
+  /**
+   * Stop the macro currently being played, if any
+   */
+  stopMacro() {
+    NodeHookAddon.stopMacro();
+  }
+
+  /**
+   * Load a native plugin: a shared library implementing the C ABI declared in
+   * src/iohook_plugin.h. Plugins process events on a native thread before
+   * they reach JavaScript and may suppress or modify them.
+   * @param {string} libraryPath Path of the shared library
+   * @return {string} Name of the plugin, used to unload it
+   */
+  loadPlugin(libraryPath) {
+    return NodeHookAddon.loadPlugin(path.resolve(libraryPath));
+  }
+
+  /**
+   * Unload a native plugin
+   * @param {string} name Name returned by loadPlugin()
+   * @return {boolean} Whether a plugin of that name was loaded
+   */
+  unloadPlugin(name) {
+    return NodeHookAddon.unloadPlugin(name);
   }
 
   /**
@@ -194,13 +707,43 @@ class IOHook extends EventEmitter {
    * @private
    */
   _handler(msg) {
-    if (this.active === false || !msg) return;
+    if (!msg) return;
+
+    // Hook health is reported even while events are paused.
+    if (msg.status) {
+      this.emit('status', msg.status);
+      return;
+    }
+
+    if (this.active === false) return;
+
+    if (msg.batch) {
+      this.emit('batch', msg.batch);
+      return;
+    }
+
+    if (msg.ndjson) {
+      this.emit('ndjson', msg.ndjson);
+      return;
+    }
 
     if (events[msg.type]) {
-      const event = msg.mouse || msg.keyboard || msg.wheel;
+      const event = msg.mouse || msg.keyboard || msg.wheel || msg.raw;
 
       event.type = events[msg.type];
 
+      const fast = this.fastListeners[msg.type];
+      if (fast !== undefined) {
+        for (let i = 0; i < fast.length; i++) {
+          fast[i](event);
+        }
+
+        // Key events still go through modifier and shortcut tracking.
+        if (!keyEventTypes[msg.type] && this.listenerCount(event.type) === 0) {
+          return;
+        }
+      }
+
       this._handleShift(event);
       this._handleAlt(event);
       this._handleCtrl(event);
@@ -0,0 +1,408 @@
+#include "analytics.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "uiohook.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANALYTICS_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(ANALYTICS_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define ANALYTICS_HAVE_AVX2 1
+#define ANALYTICS_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(ANALYTICS_HAVE_SSE2) && defined(_MSC_VER)
+#define ANALYTICS_HAVE_AVX2 1
+#define ANALYTICS_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// Kernels work on the compacted pointer/move arrays gathered from a batch.
+struct analytics_kernels {
+  const char *name;
+
+  // Sum of set bits over all masks, and number of masks with (mask & bits) == 0
+  // for each of the four modifier groups.
+  void (*mask_stats)(const uint16_t *mask, size_t n, uint64_t *popcount, uint32_t *without_modifier);
+
+  void (*bounding_box)(const int32_t *x, const int32_t *y, size_t n, int32_t *out);
+
+  // For points 1..n-1: segment length and velocity to the previous point.
+  void (*segments)(const float *x, const float *y, const float *dt, size_t n, float *dist, float *velocity);
+};
+
+static const uint16_t modifier_masks[4] = { MASK_SHIFT, MASK_CTRL, MASK_META, MASK_ALT };
+
+static inline uint32_t popcount32(uint32_t v) {
+  v = v - ((v >> 1) & 0x55555555);
+  v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+  return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+
+/* Scalar kernels. */
+
+static void mask_stats_scalar(const uint16_t *mask, size_t n, uint64_t *popcount, uint32_t *without_modifier) {
+  for (size_t i = 0; i < n; i++) {
+    *popcount += popcount32(mask[i]);
+    for (int m = 0; m < 4; m++) {
+      without_modifier[m] += (mask[i] & modifier_masks[m]) == 0;
+    }
+  }
+}
+
+static void bounding_box_scalar(const int32_t *x, const int32_t *y, size_t n, int32_t *out) {
+  for (size_t i = 0; i < n; i++) {
+    out[0] = std::min(out[0], x[i]);
+    out[1] = std::min(out[1], y[i]);
+    out[2] = std::max(out[2], x[i]);
+    out[3] = std::max(out[3], y[i]);
+  }
+}
+
+static void segments_scalar(const float *x, const float *y, const float *dt, size_t n, float *dist, float *velocity) {
+  for (size_t i = 1; i < n; i++) {
+    float dx = x[i] - x[i - 1];
+    float dy = y[i] - y[i - 1];
+    dist[i] = sqrtf(dx * dx + dy * dy);
+    velocity[i] = dist[i] / std::max(dt[i], 1.0f);
+  }
+}
+
+static const analytics_kernels kernels_scalar = {
+  "scalar", mask_stats_scalar, bounding_box_scalar, segments_scalar
+};
+
+
+/* SSE2 kernels. */
+
+#ifdef ANALYTICS_HAVE_SSE2
+static inline __m128i popcount_epi16_sse2(__m128i v) {
+  v = _mm_sub_epi16(v, _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi16(0x5555)));
+  v = _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x3333)), _mm_and_si128(_mm_srli_epi16(v, 2), _mm_set1_epi16(0x3333)));
+  v = _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 4)), _mm_set1_epi16(0x0F0F));
+  return _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), _mm_set1_epi16(0x001F));
+}
+
+static void mask_stats_sse2(const uint16_t *mask, size_t n, uint64_t *popcount, uint32_t *without_modifier) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i total = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (mask + i));
+
+    // madd widens the 16-bit lane counts into 32-bit accumulators.
+    total = _mm_add_epi32(total, _mm_madd_epi16(popcount_epi16_sse2(v), ones));
+
+    for (int m = 0; m < 4; m++) {
+      __m128i none = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short) modifier_masks[m])), zero);
+      without_modifier[m] += popcount32((uint32_t) _mm_movemask_epi8(none)) / 2;
+    }
+  }
+
+  uint32_t lanes[4];
+  _mm_storeu_si128((__m128i *) lanes, total);
+  *popcount += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  mask_stats_scalar(mask + i, n - i, popcount, without_modifier);
+}
+
+// SSE2 has no 32-bit min/max, emulate it with a compare and a select.
+static inline __m128i min_epi32_sse2(__m128i a, __m128i b) {
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static inline __m128i max_epi32_sse2(__m128i a, __m128i b) {
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+static void bounding_box_sse2(const int32_t *x, const int32_t *y, size_t n, int32_t *out) {
+  __m128i min_x = _mm_set1_epi32(out[0]), min_y = _mm_set1_epi32(out[1]);
+  __m128i max_x = _mm_set1_epi32(out[2]), max_y = _mm_set1_epi32(out[3]);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i vx = _mm_loadu_si128((const __m128i *) (x + i));
+    __m128i vy = _mm_loadu_si128((const __m128i *) (y + i));
+    min_x = min_epi32_sse2(min_x, vx);
+    min_y = min_epi32_sse2(min_y, vy);
+    max_x = max_epi32_sse2(max_x, vx);
+    max_y = max_epi32_sse2(max_y, vy);
+  }
+
+  int32_t lanes[4][4];
+  _mm_storeu_si128((__m128i *) lanes[0], min_x);
+  _mm_storeu_si128((__m128i *) lanes[1], min_y);
+  _mm_storeu_si128((__m128i *) lanes[2], max_x);
+  _mm_storeu_si128((__m128i *) lanes[3], max_y);
+  for (int l = 0; l < 4; l++) {
+    out[0] = std::min(out[0], lanes[0][l]);
+    out[1] = std::min(out[1], lanes[1][l]);
+    out[2] = std::max(out[2], lanes[2][l]);
+    out[3] = std::max(out[3], lanes[3][l]);
+  }
+
+  bounding_box_scalar(x + i, y + i, n - i, out);
+}
+
+static void segments_sse2(const float *x, const float *y, const float *dt, size_t n, float *dist, float *velocity) {
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  size_t i = 1;
+  for (; i + 4 <= n; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(x + i - 1));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(y + i - 1));
+    __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    _mm_storeu_ps(dist + i, d);
+    _mm_storeu_ps(velocity + i, _mm_div_ps(d, _mm_max_ps(_mm_loadu_ps(dt + i), one)));
+  }
+
+  // The scalar kernel starts at index 1 relative to its arguments.
+  if (i < n) {
+    segments_scalar(x + i - 1, y + i - 1, dt + i - 1, n - i + 1, dist + i - 1, velocity + i - 1);
+  }
+}
+
+static const analytics_kernels kernels_sse2 = {
+  "sse2", mask_stats_sse2, bounding_box_sse2, segments_sse2
+};
+#endif
+
+
+/* AVX2 kernels, compiled for the avx2 target and selected at runtime. */
+
+#ifdef ANALYTICS_HAVE_AVX2
+ANALYTICS_TARGET_AVX2
+static void mask_stats_avx2(const uint16_t *mask, size_t n, uint64_t *popcount, uint32_t *without_modifier) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i total = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (mask + i));
+
+    __m256i c = _mm256_sub_epi16(v, _mm256_and_si256(_mm256_srli_epi16(v, 1), _mm256_set1_epi16(0x5555)));
+    c = _mm256_add_epi16(_mm256_and_si256(c, _mm256_set1_epi16(0x3333)), _mm256_and_si256(_mm256_srli_epi16(c, 2), _mm256_set1_epi16(0x3333)));
+    c = _mm256_and_si256(_mm256_add_epi16(c, _mm256_srli_epi16(c, 4)), _mm256_set1_epi16(0x0F0F));
+    c = _mm256_and_si256(_mm256_add_epi16(c, _mm256_srli_epi16(c, 8)), _mm256_set1_epi16(0x001F));
+    total = _mm256_add_epi32(total, _mm256_madd_epi16(c, ones));
+
+    for (int m = 0; m < 4; m++) {
+      __m256i none = _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16((short) modifier_masks[m])), zero);
+      without_modifier[m] += popcount32((uint32_t) _mm256_movemask_epi8(none)) / 2;
+    }
+  }
+
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i *) lanes, total);
+  for (int l = 0; l < 8; l++) {
+    *popcount += lanes[l];
+  }
+
+  mask_stats_scalar(mask + i, n - i, popcount, without_modifier);
+}
+
+ANALYTICS_TARGET_AVX2
+static void bounding_box_avx2(const int32_t *x, const int32_t *y, size_t n, int32_t *out) {
+  __m256i min_x = _mm256_set1_epi32(out[0]), min_y = _mm256_set1_epi32(out[1]);
+  __m256i max_x = _mm256_set1_epi32(out[2]), max_y = _mm256_set1_epi32(out[3]);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i vx = _mm256_loadu_si256((const __m256i *) (x + i));
+    __m256i vy = _mm256_loadu_si256((const __m256i *) (y + i));
+    min_x = _mm256_min_epi32(min_x, vx);
+    min_y = _mm256_min_epi32(min_y, vy);
+    max_x = _mm256_max_epi32(max_x, vx);
+    max_y = _mm256_max_epi32(max_y, vy);
+  }
+
+  int32_t lanes[4][8];
+  _mm256_storeu_si256((__m256i *) lanes[0], min_x);
+  _mm256_storeu_si256((__m256i *) lanes[1], min_y);
+  _mm256_storeu_si256((__m256i *) lanes[2], max_x);
+  _mm256_storeu_si256((__m256i *) lanes[3], max_y);
+  for (int l = 0; l < 8; l++) {
+    out[0] = std::min(out[0], lanes[0][l]);
+    out[1] = std::min(out[1], lanes[1][l]);
+    out[2] = std::max(out[2], lanes[2][l]);
+    out[3] = std::max(out[3], lanes[3][l]);
+  }
+
+  bounding_box_scalar(x + i, y + i, n - i, out);
+}
+
+ANALYTICS_TARGET_AVX2
+static void segments_avx2(const float *x, const float *y, const float *dt, size_t n, float *dist, float *velocity) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+
+  size_t i = 1;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(x + i - 1));
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(y + i - 1));
+    __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+    _mm256_storeu_ps(dist + i, d);
+    _mm256_storeu_ps(velocity + i, _mm256_div_ps(d, _mm256_max_ps(_mm256_loadu_ps(dt + i), one)));
+  }
+
+  if (i < n) {
+    segments_scalar(x + i - 1, y + i - 1, dt + i - 1, n - i + 1, dist + i - 1, velocity + i - 1);
+  }
+}
+
+static const analytics_kernels kernels_avx2 = {
+  "avx2", mask_stats_avx2, bounding_box_avx2, segments_avx2
+};
+
+static bool cpu_has_avx2() {
+  #ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, 7, 0);
+  bool avx2 = (info[1] & (1 << 5)) != 0;
+
+  // The OS must also save the YMM registers.
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  return avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+  #else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+  #endif
+}
+#endif
+
+static const analytics_kernels &select_kernels() {
+  #ifdef ANALYTICS_HAVE_AVX2
+  if (cpu_has_avx2()) {
+    return kernels_avx2;
+  }
+  #endif
+
+  #ifdef ANALYTICS_HAVE_SSE2
+  return kernels_sse2;
+  #else
+  return kernels_scalar;
+  #endif
+}
+
+static const analytics_kernels &kernels() {
+  static const analytics_kernels &selected = select_kernels();
+  return selected;
+}
+
+const char *analytics_kernel_name() {
+  return kernels().name;
+}
+
+static inline int histogram_bucket(float value, int shift) {
+  if (!(value > 0)) {
+    return 0;
+  }
+
+  int exponent;
+  frexpf(value, &exponent);
+  return std::max(0, std::min(ANALYTICS_HISTOGRAM_BUCKETS - 1, exponent + shift));
+}
+
+// Dense arrays the batch is gathered into before the kernels run.  They only
+// ever grow, so repeated calls on similarly sized batches do not allocate.
+struct analytics_scratch {
+  std::vector<int32_t> px, py;
+  std::vector<float> mx, my, mdt;
+  std::vector<float> dist, velocity;
+
+  void reserve(size_t n) {
+    if (px.size() < n) {
+      px.resize(n);
+      py.resize(n);
+      mx.resize(n);
+      my.resize(n);
+      mdt.resize(n);
+      dist.resize(n);
+      velocity.resize(n);
+    }
+  }
+};
+
+void analyze_batch(const batch_view &batch, batch_analysis *result) {
+  const analytics_kernels &k = kernels();
+
+  memset(result, 0, sizeof(batch_analysis));
+  result->count = batch.length;
+
+  static thread_local analytics_scratch scratch;
+  scratch.reserve(batch.length);
+  int32_t *px = scratch.px.data(), *py = scratch.py.data();
+  float *mx = scratch.mx.data(), *my = scratch.my.data(), *mdt = scratch.mdt.data();
+
+  // Gather pointer coordinates and the move path into dense arrays.
+  size_t np = 0, n = 0;
+  double last_move_time = 0;
+  for (size_t i = 0; i < batch.length; i++) {
+    uint8_t type = batch.type[i];
+    result->type_counts[type < ANALYTICS_TYPE_COUNT ? type : 0]++;
+
+    if (type >= EVENT_MOUSE_CLICKED && type <= EVENT_MOUSE_WHEEL) {
+      px[np] = batch.x[i];
+      py[np] = batch.y[i];
+      np++;
+    }
+
+    if (type == EVENT_MOUSE_MOVED || type == EVENT_MOUSE_DRAGGED) {
+      mx[n] = (float) batch.x[i];
+      my[n] = (float) batch.y[i];
+      mdt[n] = n == 0 ? 0 : (float) (batch.time[i] - last_move_time);
+      last_move_time = batch.time[i];
+      n++;
+    }
+  }
+
+  uint32_t without_modifier[4] = { 0, 0, 0, 0 };
+  k.mask_stats(batch.mask, batch.length, &result->mask_popcount, without_modifier);
+  result->shift_count = (uint32_t) batch.length - without_modifier[0];
+  result->ctrl_count = (uint32_t) batch.length - without_modifier[1];
+  result->meta_count = (uint32_t) batch.length - without_modifier[2];
+  result->alt_count = (uint32_t) batch.length - without_modifier[3];
+
+  result->pointer_count = np;
+  if (np > 0) {
+    int32_t box[4] = { px[0], py[0], px[0], py[0] };
+    k.bounding_box(px, py, np, box);
+    result->min_x = box[0];
+    result->min_y = box[1];
+    result->max_x = box[2];
+    result->max_y = box[3];
+  }
+
+  result->move_count = n;
+  if (n < 2) {
+    return;
+  }
+
+  float *dist = scratch.dist.data(), *velocity = scratch.velocity.data();
+  dist[0] = velocity[0] = 0;
+  k.segments(mx, my, mdt, n, dist, velocity);
+
+  for (size_t i = 1; i < n; i++) {
+    result->path_length += dist[i];
+    result->max_velocity = std::max(result->max_velocity, (double) velocity[i]);
+    result->velocity_histogram[histogram_bucket(velocity[i], 4)]++;
+
+    if (i > 1) {
+      float acceleration = fabsf(velocity[i] - velocity[i - 1]) / std::max(mdt[i], 1.0f);
+      result->acceleration_histogram[histogram_bucket(acceleration, 8)]++;
+    }
+  }
+}
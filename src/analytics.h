@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ANALYTICS_TYPE_COUNT          16
+#define ANALYTICS_HISTOGRAM_BUCKETS   16
+
+// Read-only struct-of-arrays view over a batch of events, in the same layout
+// as the JS `batch` event.
+struct batch_view {
+  size_t length;
+  const uint8_t *type;
+  const double *time;
+  const int32_t *x;
+  const int32_t *y;
+  const uint16_t *keycode;
+  const uint16_t *mask;
+};
+
+// Per-batch statistics.
+//
+// Velocities are in px/ms and accelerations in px/ms^2, computed over
+// consecutive mouse moved/dragged events.  Event timestamps have millisecond
+// resolution, so segment durations are clamped to at least 1ms.
+//
+// Histograms use power of two buckets: velocity bucket k holds values in
+// [2^(k-5), 2^(k-4)), acceleration bucket k holds [2^(k-9), 2^(k-8)).  The
+// first and last buckets are open ended.
+struct batch_analysis {
+  size_t count;
+  uint32_t type_counts[ANALYTICS_TYPE_COUNT];
+
+  // Number of events with each modifier held and the total number of set mask bits.
+  uint32_t shift_count;
+  uint32_t ctrl_count;
+  uint32_t meta_count;
+  uint32_t alt_count;
+  uint64_t mask_popcount;
+
+  // Bounding box of all pointer events (mouse and wheel).
+  size_t pointer_count;
+  int32_t min_x;
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+
+  size_t move_count;
+  double path_length;
+  double max_velocity;
+  uint32_t velocity_histogram[ANALYTICS_HISTOGRAM_BUCKETS];
+  uint32_t acceleration_histogram[ANALYTICS_HISTOGRAM_BUCKETS];
+};
+
+// Name of the kernel set selected for this CPU: "avx2", "sse2" or "scalar".
+const char *analytics_kernel_name();
+
+void analyze_batch(const batch_view &batch, batch_analysis *result);
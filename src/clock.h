@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <time.h>
+#else
+#include <chrono>
+#endif
+
+// Monotonic timestamp in nanoseconds, for latency and deadline bookkeeping.
+// Not related to the wall clock carried in uiohook_event::time.
+static inline uint64_t monotonic_ns() {
+  #ifdef _WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+  #elif defined(__linux__)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+  #else
+  return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  #endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+// Lets the pipeline worker thread use an object that the main thread swaps
+// out with an atomic exchange, without a lock on either side.  The worker
+// brackets each use with an epoch_guard, which keeps the epoch odd meanwhile;
+// once it has exchanged the pointer, the main thread waits for the use in
+// progress, if any, to end before it frees the replaced object.  Uses only
+// take a bounded number of steps, so the main thread yields rather than
+// sleeps.
+
+struct epoch_guard {
+  std::atomic<uint64_t> &epoch;
+
+  explicit epoch_guard(std::atomic<uint64_t> &epoch) : epoch(epoch) {
+    epoch.fetch_add(1);
+  }
+
+  ~epoch_guard() {
+    epoch.fetch_add(1);
+  }
+
+  epoch_guard(const epoch_guard&) = delete;
+  epoch_guard &operator=(const epoch_guard&) = delete;
+};
+
+// Returns once no use that may have seen the previous pointer is running.
+static inline void wait_until_quiescent(const std::atomic<uint64_t> &epoch) {
+  uint64_t current = epoch.load();
+  if (current & 1) {
+    while (epoch.load() == current) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template<typename T>
+static inline void retire_when_quiescent(const std::atomic<uint64_t> &epoch, T *retired) {
+  if (retired == nullptr) {
+    return;
+  }
+
+  wait_until_quiescent(epoch);
+  delete retired;
+}
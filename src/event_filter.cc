@@ -0,0 +1,491 @@
+#include "event_filter.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+// Bounds the recursion of the parser on inputs like "((((...".
+#define FILTER_MAX_NESTING  64
+
+enum filter_op {
+  OP_FIELD,
+  OP_CONST,
+  OP_NOT,
+  OP_BITAND,
+  OP_EQ,
+  OP_NE,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_IN_MASK,
+  OP_IN_SET,
+  // Short-circuit: if the top of the stack decides the result, jump to
+  // offset keeping it, otherwise pop it and fall through.
+  OP_JUMP_IF_FALSE,
+  OP_JUMP_IF_TRUE
+};
+
+enum filter_field {
+  FIELD_TYPE,
+  FIELD_MASK,
+  FIELD_KEYCODE,
+  FIELD_RAWCODE,
+  FIELD_KEYCHAR,
+  FIELD_BUTTON,
+  FIELD_CLICKS,
+  FIELD_X,
+  FIELD_Y,
+  FIELD_ROTATION,
+  FIELD_DELTA,
+  FIELD_DIRECTION
+};
+
+struct filter_name {
+  const char *name;
+  int64_t value;
+};
+
+static const filter_name sFields[] = {
+  { "type", FIELD_TYPE },
+  { "mask", FIELD_MASK },
+  { "keycode", FIELD_KEYCODE },
+  { "rawcode", FIELD_RAWCODE },
+  { "keychar", FIELD_KEYCHAR },
+  { "button", FIELD_BUTTON },
+  { "clicks", FIELD_CLICKS },
+  { "x", FIELD_X },
+  { "y", FIELD_Y },
+  { "rotation", FIELD_ROTATION },
+  { "delta", FIELD_DELTA },
+  { "direction", FIELD_DIRECTION }
+};
+
+static const filter_name sConstants[] = {
+  { "keypress", EVENT_KEY_TYPED },
+  { "keydown", EVENT_KEY_PRESSED },
+  { "keyup", EVENT_KEY_RELEASED },
+  { "mouseclick", EVENT_MOUSE_CLICKED },
+  { "mousedown", EVENT_MOUSE_PRESSED },
+  { "mouseup", EVENT_MOUSE_RELEASED },
+  { "mousemove", EVENT_MOUSE_MOVED },
+  { "mousedrag", EVENT_MOUSE_DRAGGED },
+  { "mousewheel", EVENT_MOUSE_WHEEL },
+  { "SHIFT_L", MASK_SHIFT_L },
+  { "CTRL_L", MASK_CTRL_L },
+  { "META_L", MASK_META_L },
+  { "ALT_L", MASK_ALT_L },
+  { "SHIFT_R", MASK_SHIFT_R },
+  { "CTRL_R", MASK_CTRL_R },
+  { "META_R", MASK_META_R },
+  { "ALT_R", MASK_ALT_R },
+  { "SHIFT", MASK_SHIFT },
+  { "CTRL", MASK_CTRL },
+  { "META", MASK_META },
+  { "ALT", MASK_ALT },
+  { "BUTTON1", MASK_BUTTON1 },
+  { "BUTTON2", MASK_BUTTON2 },
+  { "BUTTON3", MASK_BUTTON3 },
+  { "BUTTON4", MASK_BUTTON4 },
+  { "BUTTON5", MASK_BUTTON5 },
+  { "NUM_LOCK", MASK_NUM_LOCK },
+  { "CAPS_LOCK", MASK_CAPS_LOCK },
+  { "SCROLL_LOCK", MASK_SCROLL_LOCK }
+};
+
+static bool lookup_name(const filter_name *names, size_t count, const std::string &name, int64_t *value) {
+  for (size_t i = 0; i < count; i++) {
+    if (name == names[i].name) {
+      *value = names[i].value;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Recursive descent compiler.  Tracks the stack depth of the generated code
+// so that evaluation can use a fixed size stack.
+class FilterCompiler {
+  public:
+
+    FilterCompiler(const char *expression, filter_program *program) :
+      fSource(expression), fPos(0), fProgram(program), fDepth(0), fNesting(0) {}
+
+    bool Compile(std::string *error) {
+      Next();
+      ParseOr();
+      if (fError.empty() && fToken != TOKEN_END) {
+        Fail("unexpected '" + fText + "'");
+      }
+      if (fError.empty() && fProgram->code.empty()) {
+        Fail("empty expression");
+      }
+
+      *error = fError;
+      return fError.empty();
+    }
+
+  private:
+
+    enum token {
+      TOKEN_END,
+      TOKEN_NUMBER,
+      TOKEN_NAME,
+      TOKEN_OPERATOR
+    };
+
+    const char *fSource;
+    size_t fPos;
+    size_t fTokenPos;
+    token fToken;
+    std::string fText;
+    int64_t fNumber;
+
+    filter_program *fProgram;
+    int fDepth;
+    int fNesting;
+    std::string fError;
+
+    void Fail(const std::string &message) {
+      if (fError.empty()) {
+        fError = message + " at position " + std::to_string(fTokenPos);
+      }
+      fToken = TOKEN_END;
+    }
+
+    void Next() {
+      if (!fError.empty()) {
+        return;
+      }
+
+      while (isspace((unsigned char) fSource[fPos])) {
+        fPos++;
+      }
+
+      fTokenPos = fPos;
+      const char *start = fSource + fPos;
+      if (*start == '\0') {
+        fToken = TOKEN_END;
+        fText = "end of expression";
+      } else if (isdigit((unsigned char) *start) || (*start == '-' && isdigit((unsigned char) start[1]))) {
+        // Decimal, or hexadecimal with a 0x prefix; a leading 0 is not octal.
+        const char *digits = start + (*start == '-');
+        int base = digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') ? 16 : 10;
+        char *end;
+        errno = 0;
+        fNumber = strtoll(start, &end, base);
+        if (errno != 0 || isalnum((unsigned char) *end) || *end == '_') {
+          Fail("invalid number");
+          return;
+        }
+        fToken = TOKEN_NUMBER;
+        fText.assign(start, end - start);
+        fPos += end - start;
+      } else if (isalpha((unsigned char) *start) || *start == '_') {
+        size_t length = 0;
+        while (isalnum((unsigned char) start[length]) || start[length] == '_') {
+          length++;
+        }
+        fToken = TOKEN_NAME;
+        fText.assign(start, length);
+        fPos += length;
+      } else {
+        static const char *operators[] = {
+          "&&", "||", "==", "!=", "<=", ">=", "<", ">", "!", "&", "(", ")", "{", "}", ","
+        };
+        for (const char *op : operators) {
+          size_t length = strlen(op);
+          if (strncmp(start, op, length) == 0) {
+            fToken = TOKEN_OPERATOR;
+            fText = op;
+            fPos += length;
+            return;
+          }
+        }
+        Fail(std::string("unexpected character '") + *start + "'");
+      }
+    }
+
+    bool Accept(const char *op) {
+      if (fToken == TOKEN_OPERATOR && fText == op) {
+        Next();
+        return true;
+      }
+      return false;
+    }
+
+    void Expect(const char *op) {
+      if (!Accept(op)) {
+        Fail(std::string("expected '") + op + "' instead of '" + fText + "'");
+      }
+    }
+
+    size_t Emit(filter_op op, int stack_effect, int64_t value = 0) {
+      if (fProgram->code.size() >= FILTER_MAX_INSTRUCTIONS) {
+        Fail("expression too long");
+        return 0;
+      }
+
+      fDepth += stack_effect;
+      if (fDepth > FILTER_MAX_STACK) {
+        Fail("expression nested too deeply");
+        return 0;
+      }
+
+      filter_instruction instruction = {};
+      instruction.op = (uint8_t) op;
+      instruction.value = value;
+      fProgram->code.push_back(instruction);
+      return fProgram->code.size() - 1;
+    }
+
+    // a || b || c: every operand but the last may end the evaluation.
+    void ParseOr() {
+      ParseAnd();
+      while (fError.empty() && fToken == TOKEN_OPERATOR && fText == "||") {
+        Next();
+        size_t jump = Emit(OP_JUMP_IF_TRUE, -1);
+        ParseAnd();
+        Patch(jump);
+      }
+    }
+
+    void ParseAnd() {
+      ParseUnary();
+      while (fError.empty() && fToken == TOKEN_OPERATOR && fText == "&&") {
+        Next();
+        size_t jump = Emit(OP_JUMP_IF_FALSE, -1);
+        ParseUnary();
+        Patch(jump);
+      }
+    }
+
+    void Patch(size_t jump) {
+      if (fError.empty()) {
+        fProgram->code[jump].offset = (uint32_t) fProgram->code.size();
+      }
+    }
+
+    void ParseUnary() {
+      if (Accept("!")) {
+        if (++fNesting > FILTER_MAX_NESTING) {
+          Fail("expression nested too deeply");
+          return;
+        }
+        ParseUnary();
+        fNesting--;
+        Emit(OP_NOT, 0);
+      } else {
+        ParseComparison();
+      }
+    }
+
+    void ParseComparison() {
+      ParseBitAnd();
+      if (!fError.empty()) {
+        return;
+      }
+
+      static const struct { const char *text; filter_op op; } comparisons[] = {
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<", OP_LT }, { "<=", OP_LE }, { ">", OP_GT }, { ">=", OP_GE }
+      };
+
+      if (fToken == TOKEN_NAME && fText == "in") {
+        Next();
+        ParseSet();
+        return;
+      }
+
+      for (const auto &comparison : comparisons) {
+        if (Accept(comparison.text)) {
+          ParseBitAnd();
+          Emit(comparison.op, -1);
+          return;
+        }
+      }
+    }
+
+    void ParseBitAnd() {
+      ParsePrimary();
+      while (Accept("&")) {
+        ParsePrimary();
+        Emit(OP_BITAND, -1);
+      }
+    }
+
+    void ParsePrimary() {
+      if (fToken == TOKEN_NUMBER) {
+        Emit(OP_CONST, 1, fNumber);
+        Next();
+      } else if (fToken == TOKEN_NAME) {
+        int64_t value;
+        if (lookup_name(sFields, sizeof(sFields) / sizeof(sFields[0]), fText, &value)) {
+          size_t field = Emit(OP_FIELD, 1);
+          if (fError.empty()) {
+            fProgram->code[field].field = (uint8_t) value;
+          }
+        } else if (lookup_name(sConstants, sizeof(sConstants) / sizeof(sConstants[0]), fText, &value)) {
+          Emit(OP_CONST, 1, value);
+        } else {
+          Fail("unknown name '" + fText + "'");
+          return;
+        }
+        Next();
+      } else if (Accept("(")) {
+        if (++fNesting > FILTER_MAX_NESTING) {
+          Fail("expression nested too deeply");
+          return;
+        }
+        ParseOr();
+        fNesting--;
+        Expect(")");
+      } else {
+        Fail("unexpected '" + fText + "'");
+      }
+    }
+
+    // (a, b, c) or {a, b, c} of integers and names.  Sets of small values
+    // compile to a bit test, others to a sorted range searched by bisection.
+    void ParseSet() {
+      const char *close = "}";
+      if (Accept("(")) {
+        close = ")";
+      } else {
+        Expect("{");
+      }
+
+      std::vector<int64_t> values;
+      while (fError.empty()) {
+        int64_t value;
+        if (fToken == TOKEN_NUMBER) {
+          value = fNumber;
+        } else if (fToken != TOKEN_NAME || !lookup_name(sConstants, sizeof(sConstants) / sizeof(sConstants[0]), fText, &value)) {
+          Fail("expected a set member instead of '" + fText + "'");
+          return;
+        }
+        values.push_back(value);
+        Next();
+
+        if (!Accept(",")) {
+          Expect(close);
+          break;
+        }
+      }
+      if (!fError.empty()) {
+        return;
+      }
+
+      std::sort(values.begin(), values.end());
+      values.erase(std::unique(values.begin(), values.end()), values.end());
+
+      if (values.front() >= 0 && values.back() < 64) {
+        uint64_t mask = 0;
+        for (int64_t value : values) {
+          mask |= 1ULL << value;
+        }
+        Emit(OP_IN_MASK, 0, (int64_t) mask);
+        return;
+      }
+
+      if (fProgram->sets.size() + values.size() > FILTER_MAX_SET_VALUES) {
+        Fail("sets too large");
+        return;
+      }
+
+      size_t in = Emit(OP_IN_SET, 0);
+      if (fError.empty()) {
+        fProgram->code[in].offset = (uint32_t) fProgram->sets.size();
+        fProgram->code[in].length = (uint16_t) values.size();
+        fProgram->sets.insert(fProgram->sets.end(), values.begin(), values.end());
+      }
+    }
+};
+
+bool filter_compile(const char *expression, filter_program *program, std::string *error) {
+  program->code.clear();
+  program->sets.clear();
+
+  FilterCompiler compiler(expression, program);
+  if (!compiler.Compile(error)) {
+    program->code.clear();
+    program->sets.clear();
+    return false;
+  }
+  return true;
+}
+
+static int64_t read_field(const uiohook_event &event, uint8_t field) {
+  bool keyboard = event.type >= EVENT_KEY_TYPED && event.type <= EVENT_KEY_RELEASED;
+  bool mouse = event.type >= EVENT_MOUSE_CLICKED && event.type <= EVENT_MOUSE_DRAGGED;
+  bool wheel = event.type == EVENT_MOUSE_WHEEL;
+
+  switch (field) {
+    case FIELD_TYPE:      return event.type;
+    case FIELD_MASK:      return event.mask;
+    case FIELD_KEYCODE:   return keyboard ? event.data.keyboard.keycode : 0;
+    case FIELD_RAWCODE:   return keyboard ? event.data.keyboard.rawcode : 0;
+    case FIELD_KEYCHAR:   return keyboard ? event.data.keyboard.keychar : 0;
+    case FIELD_BUTTON:    return mouse ? event.data.mouse.button : 0;
+    case FIELD_CLICKS:    return mouse ? event.data.mouse.clicks : 0;
+    case FIELD_X:         return mouse ? event.data.mouse.x : (wheel ? event.data.wheel.x : 0);
+    case FIELD_Y:         return mouse ? event.data.mouse.y : (wheel ? event.data.wheel.y : 0);
+    case FIELD_ROTATION:  return wheel ? event.data.wheel.rotation : 0;
+    case FIELD_DELTA:     return wheel ? event.data.wheel.delta : 0;
+    case FIELD_DIRECTION: return wheel ? event.data.wheel.direction : 0;
+  }
+  return 0;
+}
+
+bool filter_matches(const filter_program &program, const uiohook_event &event) {
+  int64_t stack[FILTER_MAX_STACK];
+  int top = -1;
+
+  const filter_instruction *code = program.code.data();
+  size_t length = program.code.size();
+  for (size_t pc = 0; pc < length; pc++) {
+    const filter_instruction &in = code[pc];
+    switch (in.op) {
+      case OP_FIELD:  stack[++top] = read_field(event, in.field); break;
+      case OP_CONST:  stack[++top] = in.value; break;
+      case OP_NOT:    stack[top] = !stack[top]; break;
+      case OP_BITAND: top--; stack[top] = stack[top] & stack[top + 1]; break;
+      case OP_EQ:     top--; stack[top] = stack[top] == stack[top + 1]; break;
+      case OP_NE:     top--; stack[top] = stack[top] != stack[top + 1]; break;
+      case OP_LT:     top--; stack[top] = stack[top] < stack[top + 1]; break;
+      case OP_LE:     top--; stack[top] = stack[top] <= stack[top + 1]; break;
+      case OP_GT:     top--; stack[top] = stack[top] > stack[top + 1]; break;
+      case OP_GE:     top--; stack[top] = stack[top] >= stack[top + 1]; break;
+
+      case OP_IN_MASK:
+        stack[top] = stack[top] >= 0 && stack[top] < 64 && ((uint64_t) in.value >> stack[top]) & 1;
+        break;
+
+      case OP_IN_SET: {
+        const int64_t *first = program.sets.data() + in.offset;
+        stack[top] = std::binary_search(first, first + in.length, stack[top]);
+        break;
+      }
+
+      case OP_JUMP_IF_FALSE:
+        if (!stack[top]) {
+          pc = in.offset - 1;
+        } else {
+          top--;
+        }
+        break;
+
+      case OP_JUMP_IF_TRUE:
+        if (stack[top]) {
+          pc = in.offset - 1;
+        } else {
+          top--;
+        }
+        break;
+    }
+  }
+
+  return top >= 0 && stack[top] != 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "uiohook.h"
+
+// Event filter expressions, compiled once into a small stack machine program
+// and evaluated on the pipeline worker thread for every event.  Example:
+//
+//   type in (keydown, keyup) && (mask & CTRL) && keycode in {30, 31, 32}
+//
+// Operands are event fields (type, mask, keycode, rawcode, keychar, button,
+// clicks, x, y, rotation, delta, direction; fields that do not apply to an
+// event read as 0), decimal or 0x hexadecimal integers, event names and
+// MASK_* names without the prefix.  Operators, by increasing precedence: ||,
+// &&, !, comparisons (== != < <= > >=) and set membership (in), &.
+//
+// Programs only jump forward, so evaluating one takes at most
+// FILTER_MAX_INSTRUCTIONS steps, each constant time except set lookups,
+// which are a bit test or a binary search.
+
+#define FILTER_MAX_INSTRUCTIONS   128
+#define FILTER_MAX_STACK          32
+#define FILTER_MAX_SET_VALUES     1024
+
+struct filter_instruction {
+  uint8_t op;
+  uint8_t field;
+  uint16_t length;
+  uint32_t offset;
+  int64_t value;
+};
+
+struct filter_program {
+  std::vector<filter_instruction> code;
+  std::vector<int64_t> sets;
+};
+
+// Returns false and a description of the problem (with the offending
+// position) if the expression is invalid.
+bool filter_compile(const char *expression, filter_program *program, std::string *error);
+
+bool filter_matches(const filter_program &program, const uiohook_event &event);
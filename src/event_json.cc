@@ -0,0 +1,137 @@
+#include "event_json.h"
+
+#include <string.h>
+
+static const char *event_name(uint8_t type) {
+  switch (type) {
+    case EVENT_KEY_TYPED:      return "keypress";
+    case EVENT_KEY_PRESSED:    return "keydown";
+    case EVENT_KEY_RELEASED:   return "keyup";
+    case EVENT_MOUSE_CLICKED:  return "mouseclick";
+    case EVENT_MOUSE_PRESSED:  return "mousedown";
+    case EVENT_MOUSE_RELEASED: return "mouseup";
+    case EVENT_MOUSE_MOVED:    return "mousemove";
+    case EVENT_MOUSE_DRAGGED:  return "mousedrag";
+    case EVENT_MOUSE_WHEEL:    return "mousewheel";
+  }
+  return nullptr;
+}
+
+static char *put_string(char *out, const char *text) {
+  size_t length = strlen(text);
+  memcpy(out, text, length);
+  return out + length;
+}
+
+static char *put_unsigned(char *out, uint64_t value) {
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[count++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+static char *put_signed(char *out, int64_t value) {
+  if (value < 0) {
+    *out++ = '-';
+    return put_unsigned(out, (uint64_t) 0 - (uint64_t) value);
+  }
+  return put_unsigned(out, (uint64_t) value);
+}
+
+// ,"name":value
+static char *put_field(char *out, const char *name, int64_t value) {
+  *out++ = ',';
+  *out++ = '"';
+  out = put_string(out, name);
+  *out++ = '"';
+  *out++ = ':';
+  return put_signed(out, value);
+}
+
+// A keychar is a single UTF-16 code unit, which JSON can always represent as
+// an escape; printable ASCII is written as is.
+static char *put_keychar(char *out, uint16_t keychar) {
+  static const char hex[] = "0123456789abcdef";
+
+  *out++ = '"';
+  if (keychar >= 0x20 && keychar < 0x7F && keychar != '"' && keychar != '\\') {
+    *out++ = (char) keychar;
+  } else if (keychar == '"' || keychar == '\\') {
+    *out++ = '\\';
+    *out++ = (char) keychar;
+  } else {
+    *out++ = '\\';
+    *out++ = 'u';
+    *out++ = hex[(keychar >> 12) & 0xF];
+    *out++ = hex[(keychar >> 8) & 0xF];
+    *out++ = hex[(keychar >> 4) & 0xF];
+    *out++ = hex[keychar & 0xF];
+  }
+  *out++ = '"';
+  return out;
+}
+
+size_t event_json_write(const uiohook_event &event, char *out) {
+  char *start = out;
+
+  out = put_string(out, "{\"type\":");
+  const char *name = event_name((uint8_t) event.type);
+  if (name != nullptr) {
+    *out++ = '"';
+    out = put_string(out, name);
+    *out++ = '"';
+  } else {
+    out = put_unsigned(out, (uint8_t) event.type);
+  }
+  out = put_string(out, ",\"time\":");
+  out = put_unsigned(out, event.time);
+  out = put_field(out, "mask", event.mask);
+
+  switch (event.type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+      out = put_field(out, "keycode", event.data.keyboard.keycode);
+      out = put_field(out, "rawcode", event.data.keyboard.rawcode);
+      if (event.type == EVENT_KEY_TYPED) {
+        out = put_field(out, "keychar", event.data.keyboard.keychar);
+        out = put_string(out, ",\"key\":");
+        out = put_keychar(out, event.data.keyboard.keychar);
+      }
+      break;
+
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+      out = put_field(out, "button", event.data.mouse.button);
+      out = put_field(out, "clicks", event.data.mouse.clicks);
+      out = put_field(out, "x", event.data.mouse.x);
+      out = put_field(out, "y", event.data.mouse.y);
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      out = put_field(out, "x", event.data.wheel.x);
+      out = put_field(out, "y", event.data.wheel.y);
+      out = put_field(out, "rotation", event.data.wheel.rotation);
+      out = put_field(out, "delta", event.data.wheel.delta);
+      out = put_field(out, "direction", event.data.wheel.direction);
+      out = put_field(out, "scrollType", event.data.wheel.type);
+      break;
+
+    default:
+      break;
+  }
+
+  *out++ = '}';
+  *out++ = '\n';
+  return (size_t) (out - start);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uiohook.h"
+
+// Newline delimited JSON for hooked events, one object per line with the
+// event name and the fields that apply to its type:
+//
+//   {"type":"mousemove","time":1700000000000,"mask":0,"button":0,"clicks":0,"x":10,"y":20}
+//   {"type":"keypress","time":1700000000000,"mask":1,"keycode":0,"rawcode":65,"keychar":65,"key":"A"}
+//   {"type":"mousewheel","time":1700000000000,"mask":0,"x":10,"y":20,"rotation":-1,"delta":40,"direction":3,"scrollType":1}
+//
+// Hand-rolled rather than going through a JSON library, as it runs for
+// every event.
+
+// Longest line event_json_write() produces, newline included.
+#define EVENT_JSON_MAX_LENGTH   224
+
+// Writes one line for event to out, which must have room for
+// EVENT_JSON_MAX_LENGTH bytes, and returns its length.  Events of other
+// types than the hooked ones are written as {"type":<number>,...}.
+size_t event_json_write(const uiohook_event &event, char *out);
@@ -0,0 +1,54 @@
+#include "event_projection.h"
+#include "uiohook.h"
+
+#include <string.h>
+
+#define CATEGORY_KEY    1
+#define CATEGORY_MOUSE  2
+#define CATEGORY_WHEEL  4
+
+struct projection_name {
+  const char *name;
+  uint32_t bit;
+  uint8_t categories;
+};
+
+static const projection_name sNames[] = {
+  { "shiftKey",  PROJECT_SHIFT_KEY,   CATEGORY_KEY },
+  { "altKey",    PROJECT_ALT_KEY,     CATEGORY_KEY },
+  { "ctrlKey",   PROJECT_CTRL_KEY,    CATEGORY_KEY },
+  { "metaKey",   PROJECT_META_KEY,    CATEGORY_KEY },
+  { "keychar",   PROJECT_KEYCHAR,     CATEGORY_KEY },
+  { "key",       PROJECT_KEY,         CATEGORY_KEY },
+  { "keycode",   PROJECT_KEYCODE,     CATEGORY_KEY },
+  { "rawcode",   PROJECT_RAWCODE,     CATEGORY_KEY },
+  { "button",    PROJECT_BUTTON,      CATEGORY_MOUSE },
+  { "clicks",    PROJECT_CLICKS,      CATEGORY_MOUSE },
+  { "x",         PROJECT_X,           CATEGORY_MOUSE | CATEGORY_WHEEL },
+  { "y",         PROJECT_Y,           CATEGORY_MOUSE | CATEGORY_WHEEL },
+  { "delta",     PROJECT_DELTA,       CATEGORY_WHEEL },
+  { "direction", PROJECT_DIRECTION,   CATEGORY_WHEEL },
+  { "rotation",  PROJECT_ROTATION,    CATEGORY_WHEEL },
+  { "count",     PROJECT_COUNT,       CATEGORY_WHEEL },
+};
+
+static uint8_t category(uint8_t type) {
+  if (type >= EVENT_KEY_TYPED && type <= EVENT_KEY_RELEASED) {
+    return CATEGORY_KEY;
+  } else if (type >= EVENT_MOUSE_CLICKED && type < EVENT_MOUSE_WHEEL) {
+    return CATEGORY_MOUSE;
+  } else if (type == EVENT_MOUSE_WHEEL) {
+    return CATEGORY_WHEEL;
+  }
+  return 0;
+}
+
+uint32_t projection_field(uint8_t type, const char *name) {
+  uint8_t categories = category(type);
+  for (const projection_name &entry : sNames) {
+    if ((entry.categories & categories) != 0 && strcmp(entry.name, name) == 0) {
+      return entry.bit;
+    }
+  }
+  return 0;
+}
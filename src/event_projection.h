@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Properties of the event objects built for JavaScript, one bit each.  A
+// projection is the set of properties to materialize for one event type;
+// properties are always set in the order below, so every object built for
+// the same projection gets the same hidden class in V8.
+
+// keydown, keyup, keypress
+#define PROJECT_SHIFT_KEY     (1u << 0)
+#define PROJECT_ALT_KEY       (1u << 1)
+#define PROJECT_CTRL_KEY      (1u << 2)
+#define PROJECT_META_KEY      (1u << 3)
+#define PROJECT_KEYCHAR       (1u << 4)
+#define PROJECT_KEY           (1u << 5)
+#define PROJECT_KEYCODE       (1u << 6)
+#define PROJECT_RAWCODE       (1u << 7)
+
+// Mouse events
+#define PROJECT_BUTTON        (1u << 8)
+#define PROJECT_CLICKS        (1u << 9)
+
+// Mouse and wheel events
+#define PROJECT_X             (1u << 10)
+#define PROJECT_Y             (1u << 11)
+
+// Wheel events
+#define PROJECT_DELTA         (1u << 12)
+#define PROJECT_DIRECTION     (1u << 13)
+#define PROJECT_ROTATION      (1u << 14)
+#define PROJECT_COUNT         (1u << 15)
+
+// Full objects also carry the outer mask and time and the wheel type.
+// Listeners never see those: they receive the inner object, whose type the
+// JavaScript handler replaces with the event name.  So they have no bit and
+// cannot be requested.
+#define PROJECT_ALL           0xFFFFFFFFu
+
+// Bit of the property called name in events of the given type, 0 if events
+// of that type do not have it.
+uint32_t projection_field(uint8_t type, const char *name);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring buffer.  push() may only be
+// called from one thread and peek()/pop() from one other thread; neither side
+// ever blocks or allocates.  The capacity is rounded up to a power of two.
+template<typename T>
+class SpscRing {
+  public:
+
+    explicit SpscRing(size_t capacity) : fHead(0), fTail(0) {
+      size_t size = 1;
+      while (size < capacity) {
+        size <<= 1;
+      }
+      fItems.resize(size);
+      fMask = size - 1;
+    }
+
+    size_t capacity() const { return fMask + 1; }
+
+    // Producer side.  Returns false and drops the item when the ring is full.
+    bool push(const T &item) {
+      size_t head = fHead.load(std::memory_order_relaxed);
+      if (head - fTail.load(std::memory_order_acquire) > fMask) {
+        return false;
+      }
+
+      fItems[head & fMask] = item;
+      fHead.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Producer side.  Stores as many of the items as fit and makes them
+    // visible to the consumer at once; returns how many were stored.
+    size_t push(const T *items, size_t count) {
+      size_t head = fHead.load(std::memory_order_relaxed);
+      size_t space = fMask + 1 - (head - fTail.load(std::memory_order_acquire));
+      if (count > space) {
+        count = space;
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        fItems[(head + i) & fMask] = items[i];
+      }
+      fHead.store(head + count, std::memory_order_release);
+      return count;
+    }
+
+    // Producer side.  True once the consumer has popped everything pushed so
+    // far.
+    bool drained() const {
+      return fHead.load(std::memory_order_relaxed) == fTail.load(std::memory_order_acquire);
+    }
+
+    // Consumer side.  Returns nullptr when the ring is empty.
+    const T *peek() const {
+      size_t tail = fTail.load(std::memory_order_relaxed);
+      if (tail == fHead.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+
+      return &fItems[tail & fMask];
+    }
+
+    bool pop(T *item) {
+      const T *front = peek();
+      if (front == nullptr) {
+        return false;
+      }
+
+      *item = *front;
+      fTail.store(fTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side; the producer may add more items concurrently.
+    size_t size() const {
+      return fHead.load(std::memory_order_acquire) - fTail.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+  private:
+
+    std::vector<T> fItems;
+    size_t fMask;
+
+    // Keep the producer and consumer indexes on separate cache lines.
+    alignas(64) std::atomic<size_t> fHead;
+    alignas(64) std::atomic<size_t> fTail;
+};
@@ -0,0 +1,239 @@
+#include "event_sampler.h"
+#include "epoch_guard.h"
+
+#include <atomic>
+#include <mutex>
+
+#define SAMPLER_TYPES   (EVENT_MOUSE_WHEEL + 1)
+
+struct sampler {
+  sampler_config config;
+  std::atomic<uint64_t> seen;
+  std::atomic<uint64_t> sampled;
+
+  // Worker thread state.
+  uint64_t last_time;
+  bool has_last;
+  uint64_t window_end;
+  uint64_t window_seen;
+  uint64_t random;
+  std::vector<uiohook_event> reservoir;
+
+  explicit sampler(const sampler_config &config) : config(config), seen(0), sampled(0),
+      last_time(0), has_last(false), window_end(0), window_seen(0),
+      random(0x9E3779B97F4A7C15ULL ^ (uint64_t) (uintptr_t) this) {
+    if (config.mode == SAMPLER_RESERVOIR) {
+      reservoir.reserve(config.size);
+    }
+  }
+};
+
+// Swapped by the main thread and retired through sEpoch, see epoch_guard.h.
+static std::atomic<sampler*> sSamplers[SAMPLER_TYPES];
+static std::atomic<uint32_t> sActive(0);
+static std::atomic<uint64_t> sEpoch(0);
+
+// Worker thread: earliest time at which a reservoir window may have closed.
+static uint64_t sNextFlush = UINT64_MAX;
+
+// Samples held by replaced samplers, released by the next sampler_flush().
+static std::mutex sRetiredMutex;
+static std::vector<uiohook_event> sRetired;
+static std::atomic<bool> sRetiredPending(false);
+
+static uint64_t next_random(sampler *s) {
+  // xorshift64*
+  s->random ^= s->random >> 12;
+  s->random ^= s->random << 25;
+  s->random ^= s->random >> 27;
+  return s->random * 0x2545F4914F6CDD1DULL;
+}
+
+// Replacement scrambles the order; samples are few, insertion sort is fine.
+static void sort_by_time(std::vector<uiohook_event> &held) {
+  for (size_t i = 1; i < held.size(); i++) {
+    uiohook_event event = held[i];
+    size_t j = i;
+    for (; j > 0 && held[j - 1].time > event.time; j--) {
+      held[j] = held[j - 1];
+    }
+    held[j] = event;
+  }
+}
+
+static void release_reservoir(sampler *s, sampler_emit_proc emit) {
+  std::vector<uiohook_event> &held = s->reservoir;
+  sort_by_time(held);
+
+  if (!held.empty()) {
+    s->sampled.fetch_add(held.size(), std::memory_order_relaxed);
+    emit(held.data(), held.size());
+    held.clear();
+  }
+  s->window_seen = 0;
+}
+
+// Releases the samples of every window that closed before now.
+static void flush_reservoirs(uint64_t now, sampler_emit_proc emit) {
+  sNextFlush = UINT64_MAX;
+  for (int type = 0; type < SAMPLER_TYPES; type++) {
+    sampler *s = sSamplers[type].load();
+    if (s == nullptr || s->config.mode != SAMPLER_RESERVOIR || s->window_seen == 0) {
+      continue;
+    }
+
+    if (now >= s->window_end) {
+      release_reservoir(s, emit);
+    } else if (s->window_end < sNextFlush) {
+      sNextFlush = s->window_end;
+    }
+  }
+}
+
+static bool sample(sampler *s, const uiohook_event &event) {
+  s->seen.fetch_add(1, std::memory_order_relaxed);
+
+  switch (s->config.mode) {
+    case SAMPLER_EVERY:
+      if ((s->seen.load(std::memory_order_relaxed) - 1) % s->config.n != 0) {
+        return false;
+      }
+      break;
+
+    case SAMPLER_INTERVAL:
+      if (s->has_last && event.time - s->last_time < s->config.interval_ms) {
+        return false;
+      }
+      s->last_time = event.time;
+      s->has_last = true;
+      break;
+
+    case SAMPLER_RESERVOIR: {
+      // Algorithm R: the i-th event of the window replaces a random sample
+      // with probability size / i.
+      if (s->window_seen == 0) {
+        s->window_end = event.time + s->config.window_ms;
+        if (s->window_end < sNextFlush) {
+          sNextFlush = s->window_end;
+        }
+      }
+      s->window_seen++;
+
+      if (s->reservoir.size() < s->config.size) {
+        s->reservoir.push_back(event);
+      } else {
+        uint64_t slot = next_random(s) % s->window_seen;
+        if (slot < s->config.size) {
+          s->reservoir[(size_t) slot] = event;
+        }
+      }
+      return false;
+    }
+  }
+
+  s->sampled.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool sampler_active() {
+  return sActive.load(std::memory_order_relaxed) != 0;
+}
+
+bool sampler_accept(const uiohook_event &event, sampler_emit_proc emit) {
+  if (sActive.load(std::memory_order_relaxed) == 0) {
+    return true;
+  }
+
+  epoch_guard guard(sEpoch);
+  if (event.time >= sNextFlush) {
+    flush_reservoirs(event.time, emit);
+  }
+
+  bool accepted = true;
+  if (event.type < SAMPLER_TYPES) {
+    sampler *s = sSamplers[event.type].load();
+    if (s != nullptr) {
+      accepted = sample(s, event);
+    }
+  }
+
+  return accepted;
+}
+
+bool sampler_pending() {
+  return sNextFlush != UINT64_MAX || sRetiredPending.load(std::memory_order_relaxed);
+}
+
+void sampler_flush(uint64_t now, sampler_emit_proc emit) {
+  if (sRetiredPending.load()) {
+    std::vector<uiohook_event> retired;
+    {
+      std::lock_guard<std::mutex> lock(sRetiredMutex);
+      retired.swap(sRetired);
+      sRetiredPending.store(false);
+    }
+    emit(retired.data(), retired.size());
+  }
+
+  if (now >= sNextFlush) {
+    epoch_guard guard(sEpoch);
+    flush_reservoirs(now, emit);
+  }
+}
+
+uint64_t sampler_next_flush() {
+  return sNextFlush;
+}
+
+void sampler_configure(uint8_t type, const sampler_config &config) {
+  if (type >= SAMPLER_TYPES) {
+    return;
+  }
+
+  sampler *replacement = nullptr;
+  if (config.mode != SAMPLER_NONE) {
+    sampler_config checked = config;
+    checked.n = checked.n > 0 ? checked.n : 1;
+    checked.size = checked.size > 0 ? (checked.size < SAMPLER_MAX_RESERVOIR ? checked.size : SAMPLER_MAX_RESERVOIR) : 1;
+    replacement = new sampler(checked);
+  }
+
+  sampler *previous = sSamplers[type].exchange(replacement);
+  if (previous == nullptr && replacement != nullptr) {
+    sActive.fetch_add(1);
+  } else if (previous != nullptr && replacement == nullptr) {
+    sActive.fetch_sub(1);
+  }
+
+  if (previous == nullptr) {
+    return;
+  }
+
+  // Once the worker thread no longer sees the sampler, the sample it held
+  // goes out with the next flush.
+  wait_until_quiescent(sEpoch);
+  if (!previous->reservoir.empty()) {
+    sort_by_time(previous->reservoir);
+    std::lock_guard<std::mutex> lock(sRetiredMutex);
+    sRetired.insert(sRetired.end(), previous->reservoir.begin(), previous->reservoir.end());
+    sRetiredPending.store(true);
+  }
+  delete previous;
+}
+
+void sampler_get_stats(std::vector<sampler_stats> *stats) {
+  stats->clear();
+  for (int type = 0; type < SAMPLER_TYPES; type++) {
+    sampler *s = sSamplers[type].load();
+    if (s == nullptr) {
+      continue;
+    }
+
+    sampler_stats entry;
+    entry.type = (uint8_t) type;
+    entry.mode = s->config.mode;
+    entry.seen = s->seen.load(std::memory_order_relaxed);
+    entry.sampled = s->sampled.load(std::memory_order_relaxed);
+    stats->push_back(entry);
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "uiohook.h"
+
+// Per event type sampling, applied on the pipeline worker thread after
+// filtering and before events are queued for JavaScript:
+//
+//   every     the first of every n events
+//   interval  at most one event per interval (by event time)
+//   reservoir a uniform random sample of up to size events per window; the
+//             sample is held back and released, in time order, by
+//             sampler_flush() or the first event of any type once the window
+//             has closed
+//
+// Each sampler counts the events it has seen and let through, so that
+// sampled data can be re-weighted.
+
+#define SAMPLER_NONE        0
+#define SAMPLER_EVERY       1
+#define SAMPLER_INTERVAL    2
+#define SAMPLER_RESERVOIR   3
+
+#define SAMPLER_MAX_RESERVOIR   1024
+
+struct sampler_config {
+  uint8_t mode;
+  uint32_t n;
+  uint32_t interval_ms;
+  uint32_t size;
+  uint32_t window_ms;
+};
+
+struct sampler_stats {
+  uint8_t type;
+  uint8_t mode;
+  uint64_t seen;
+  uint64_t sampled;
+};
+
+// Hands released reservoir samples on, from the worker thread.
+typedef void (*sampler_emit_proc)(uiohook_event * const events, size_t count);
+
+// Main thread.  Replaces the sampler of an event type and its counters;
+// SAMPLER_NONE removes it.  A pending reservoir sample is handed to the next
+// sampler_flush().
+void sampler_configure(uint8_t type, const sampler_config &config);
+
+// Any thread.  Whether any event type has a sampler.
+bool sampler_active();
+
+// Worker thread.  Returns whether the event passes now; events taken into a
+// reservoir are emitted later.
+bool sampler_accept(const uiohook_event &event, sampler_emit_proc emit);
+
+// Worker thread.  Whether sampler_flush() has samples to release, now or
+// once a window closes.
+bool sampler_pending();
+
+// Worker thread.  Releases the samples of replaced samplers and of every
+// window that closed before now (event time, UINT64_MAX to close them all).
+void sampler_flush(uint64_t now, sampler_emit_proc emit);
+
+// Worker thread.  When the next open window closes, UINT64_MAX if none is
+// open.
+uint64_t sampler_next_flush();
+
+// Main thread.  One entry per configured sampler.
+void sampler_get_stats(std::vector<sampler_stats> *stats);
@@ -0,0 +1,178 @@
+#include "flight_recorder.h"
+#include "epoch_guard.h"
+#include "input_state.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+
+struct recorder {
+  size_t mask;
+  bool redact;
+
+  // Two words per packed event, so that a dump racing with the worker thread
+  // reads torn slots (which it then discards) without undefined behaviour.
+  std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+  // claimed is stored before a slot is overwritten and head after, so a dump
+  // can tell which of the slots it copied may have changed underneath it.
+  std::atomic<uint64_t> claimed;
+  std::atomic<uint64_t> head;
+
+  // Only the low 32 bits of the time are kept per event; full times are
+  // rebuilt from the newest one.
+  std::atomic<uint64_t> last_time;
+
+  explicit recorder(size_t capacity) : mask(capacity - 1), redact(FLIGHT_RECORDER_DEFAULT_REDACT),
+      slots(new std::atomic<uint64_t>[capacity * 2]), claimed(0), head(0), last_time(0) {
+  }
+};
+
+// Swapped by the main thread and retired through sEpoch, see epoch_guard.h.
+static std::atomic<recorder*> sRecorder(new recorder(FLIGHT_RECORDER_DEFAULT_CAPACITY));
+static std::atomic<uint64_t> sEpoch(0);
+static std::atomic<uint32_t> sMaxAgeMs(FLIGHT_RECORDER_DEFAULT_MAX_AGE_MS);
+static std::atomic<bool> sRedact(FLIGHT_RECORDER_DEFAULT_REDACT);
+
+static void redact(const uiohook_event &event, packed_event *packed) {
+  if (event.type < EVENT_KEY_TYPED || event.type > EVENT_KEY_RELEASED) {
+    return;
+  }
+  if ((event.mask & (MASK_CTRL | MASK_ALT | MASK_META)) || is_modifier_key(event.data.keyboard.keycode)) {
+    return;
+  }
+  packed->data[0] = 0;
+  packed->data[1] = 0;
+}
+
+bool flight_recorder_active() {
+  return sRecorder.load(std::memory_order_relaxed) != nullptr;
+}
+
+void flight_recorder_record(const uiohook_event &event) {
+  if (sRecorder.load(std::memory_order_relaxed) == nullptr) {
+    return;
+  }
+
+  epoch_guard guard(sEpoch);
+  recorder *ring = sRecorder.load();
+  if (ring != nullptr) {
+    packed_event packed;
+    pack_event(event, 0, &packed);
+    if (ring->redact) {
+      redact(event, &packed);
+    }
+
+    uint64_t words[2];
+    memcpy(words, &packed, sizeof(words));
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ring->claimed.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::atomic<uint64_t> *slot = &ring->slots[(head & ring->mask) * 2];
+    slot[0].store(words[0], std::memory_order_relaxed);
+    slot[1].store(words[1], std::memory_order_relaxed);
+    ring->last_time.store(event.time, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+}
+
+void flight_recorder_configure(size_t capacity, uint32_t max_age_ms, bool redact) {
+  sMaxAgeMs.store(max_age_ms);
+  sRedact.store(redact);
+
+  recorder *current = sRecorder.load();
+  size_t size = 0;
+  if (capacity > 0) {
+    size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+  }
+
+  // Same size and redaction: keep the history recorded so far.
+  if (current != nullptr && size == current->mask + 1 && current->redact == redact) {
+    return;
+  }
+  if (current == nullptr && size == 0) {
+    return;
+  }
+
+  recorder *replacement = nullptr;
+  if (size > 0) {
+    replacement = new recorder(size);
+    replacement->redact = redact;
+  }
+
+  retire_when_quiescent(sEpoch, sRecorder.exchange(replacement));
+}
+
+void flight_recorder_dump(std::vector<packed_event> *events, uint64_t *time_base) {
+  events->clear();
+  *time_base = 0;
+
+  // The ring is only freed by the main thread, which is also the caller.
+  recorder *ring = sRecorder.load();
+  if (ring == nullptr) {
+    return;
+  }
+
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  uint64_t last_time = ring->last_time.load(std::memory_order_relaxed);
+  size_t capacity = ring->mask + 1;
+  uint64_t first = head > capacity ? head - capacity : 0;
+
+  std::vector<packed_event> copy((size_t) (head - first));
+  for (uint64_t index = first; index < head; index++) {
+    const std::atomic<uint64_t> *slot = &ring->slots[(index & ring->mask) * 2];
+    uint64_t words[2] = {
+      slot[0].load(std::memory_order_relaxed),
+      slot[1].load(std::memory_order_relaxed)
+    };
+    memcpy(&copy[(size_t) (index - first)], words, sizeof(words));
+  }
+
+  // Slots the worker thread claimed since the copy started may be torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t claimed = ring->claimed.load(std::memory_order_relaxed);
+  uint64_t valid = claimed > capacity ? claimed - capacity : 0;
+  valid = valid < first ? first : (valid > head ? head : valid);
+
+  // Times are stored modulo 2^32 ms; the ring never spans that long, so the
+  // distance to the newest recorded time is exact.
+  uint32_t max_age_ms = sMaxAgeMs.load();
+  uint64_t oldest = UINT64_MAX;
+  events->reserve((size_t) (head - valid));
+  for (uint64_t index = valid; index < head; index++) {
+    packed_event packed = copy[(size_t) (index - first)];
+    uint32_t age = (uint32_t) last_time - packed.time;
+    if (max_age_ms > 0 && age > max_age_ms) {
+      continue;
+    }
+
+    uint64_t time = last_time - age;
+    oldest = time < oldest ? time : oldest;
+    packed.time = age;
+    events->push_back(packed);
+  }
+
+  if (events->empty()) {
+    return;
+  }
+
+  // Rebase from ages to times relative to the oldest event kept.
+  *time_base = oldest;
+  for (packed_event &packed : *events) {
+    packed.time = (uint32_t) (last_time - packed.time - oldest);
+  }
+}
+
+void flight_recorder_get_stats(flight_recorder_stats *stats) {
+  recorder *ring = sRecorder.load();
+  stats->capacity = ring != nullptr ? ring->mask + 1 : 0;
+  stats->max_age_ms = sMaxAgeMs.load();
+  stats->redact = sRedact.load();
+  stats->recorded = ring != nullptr ? ring->head.load() : 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "packed_event.h"
+
+// Always-on history of the most recent hooked events, kept in a fixed size
+// ring of packed events that the pipeline worker thread overwrites without ever
+// blocking.  Dumping copies the ring while the hook keeps running: events
+// overwritten during the copy are detected and left out.
+//
+// With redaction on, key events are stored without keychar, keycode and
+// rawcode unless a Ctrl, Alt or Meta modifier is held or the key is itself a
+// modifier, so typed text never reaches the ring while shortcuts stay
+// readable.  Redaction is on by default.
+
+#define FLIGHT_RECORDER_DEFAULT_CAPACITY    4096
+#define FLIGHT_RECORDER_DEFAULT_MAX_AGE_MS  30000
+#define FLIGHT_RECORDER_DEFAULT_REDACT      true
+
+struct flight_recorder_stats {
+  size_t capacity;
+  uint32_t max_age_ms;
+  bool redact;
+  uint64_t recorded;
+};
+
+// Main thread.  A capacity of 0 turns the recorder off and frees the ring;
+// the capacity is rounded up to a power of two.  A max age of 0 keeps
+// whatever fits.  Changing the capacity starts a new, empty ring.
+void flight_recorder_configure(size_t capacity, uint32_t max_age_ms, bool redact);
+
+// Any thread.  Whether the recorder is on.
+bool flight_recorder_active();
+
+// Worker thread.
+void flight_recorder_record(const uiohook_event &event);
+
+// Main thread.  Copies the recorded events, oldest first, with times
+// relative to *time_base.
+void flight_recorder_dump(std::vector<packed_event> *events, uint64_t *time_base);
+
+void flight_recorder_get_stats(flight_recorder_stats *stats);
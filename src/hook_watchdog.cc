@@ -0,0 +1,133 @@
+#include "hook_watchdog.h"
+#include "x11_guard.h"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__) && defined(__MACH__)
+#include <ApplicationServices/ApplicationServices.h>
+#else
+#include <X11/Xlib.h>
+#endif
+
+static std::atomic<bool> sEnabled(true);
+static std::atomic<uint32_t> sStallMs(WATCHDOG_DEFAULT_STALL_MS);
+static std::atomic<uint32_t> sProbeMs(WATCHDOG_DEFAULT_PROBE_MS);
+static std::atomic<uint32_t> sMinBackoffMs(WATCHDOG_DEFAULT_MIN_BACKOFF_MS);
+static std::atomic<uint32_t> sMaxBackoffMs(WATCHDOG_DEFAULT_MAX_BACKOFF_MS);
+
+void watchdog_configure(const watchdog_config &config) {
+  sEnabled.store(config.enabled);
+  sStallMs.store(config.stall_ms);
+  sProbeMs.store(config.probe_ms > 0 ? config.probe_ms : 1);
+  sMinBackoffMs.store(config.min_backoff_ms);
+  sMaxBackoffMs.store(config.max_backoff_ms > config.min_backoff_ms ? config.max_backoff_ms : config.min_backoff_ms);
+}
+
+void watchdog_get_config(watchdog_config *config) {
+  config->enabled = sEnabled.load();
+  config->stall_ms = sStallMs.load();
+  config->probe_ms = sProbeMs.load();
+  config->min_backoff_ms = sMinBackoffMs.load();
+  config->max_backoff_ms = sMaxBackoffMs.load();
+}
+
+uint32_t watchdog_backoff_ms(uint32_t attempt) {
+  uint64_t delay = sMinBackoffMs.load();
+  uint32_t max = sMaxBackoffMs.load();
+  for (uint32_t i = 1; i < attempt && delay < max; i++) {
+    delay *= 2;
+  }
+  return (uint32_t) (delay < max ? delay : max);
+}
+
+#ifdef _WIN32
+
+bool watchdog_probe_cursor(int16_t *x, int16_t *y) {
+  POINT point;
+  if (!GetCursorPos(&point)) {
+    return false;
+  }
+  *x = (int16_t) point.x;
+  *y = (int16_t) point.y;
+  return true;
+}
+
+void watchdog_probe_close() {
+}
+
+#elif defined(__APPLE__) && defined(__MACH__)
+
+bool watchdog_probe_cursor(int16_t *x, int16_t *y) {
+  CGEventRef event = CGEventCreate(NULL);
+  if (event == NULL) {
+    return false;
+  }
+  CGPoint point = CGEventGetLocation(event);
+  CFRelease(event);
+
+  *x = (int16_t) point.x;
+  *y = (int16_t) point.y;
+  return true;
+}
+
+void watchdog_probe_close() {
+}
+
+#else
+
+// A connection of its own: the hook's connection is busy inside XRecord.
+// When the X server goes away the connection is dropped (it cannot even be
+// closed) and the next probe opens a new one.
+static Display *sDisplay = NULL;
+
+struct pointer_query {
+  Bool found;
+  int x;
+  int y;
+};
+
+static void query_pointer(void *user_data) {
+  pointer_query *query = (pointer_query *) user_data;
+
+  Window root, child;
+  int win_x, win_y;
+  unsigned int mask;
+  query->found = XQueryPointer(sDisplay, DefaultRootWindow(sDisplay), &root, &child, &query->x, &query->y, &win_x, &win_y, &mask);
+}
+
+static void close_display(void *user_data) {
+  XCloseDisplay((Display *) user_data);
+}
+
+bool watchdog_probe_cursor(int16_t *x, int16_t *y) {
+  if (sDisplay == NULL) {
+    sDisplay = XOpenDisplay(NULL);
+    if (sDisplay == NULL) {
+      return false;
+    }
+  }
+
+  pointer_query query = { False, 0, 0 };
+  if (!x11_guarded(&query_pointer, &query)) {
+    sDisplay = NULL;
+    return false;
+  }
+  if (!query.found) {
+    return false;
+  }
+
+  *x = (int16_t) query.x;
+  *y = (int16_t) query.y;
+  return true;
+}
+
+void watchdog_probe_close() {
+  if (sDisplay != NULL) {
+    x11_guarded(&close_display, sDisplay);
+    sDisplay = NULL;
+  }
+}
+
+#endif
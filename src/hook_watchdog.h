@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hook health monitoring.  The hook backend can die (hook_run() returns
+// while no stop was requested, e.g. when the XRecord connection fails) or
+// stall (it stops delivering events while input keeps happening).  The
+// session loop in iohook_core.cc restarts a dead hook after a delay that
+// doubles with every failed attempt; a stall is detected by the monitor
+// thread, which then stops the hook so that it gets restarted.
+//
+// A stall is assumed when no event was hooked for stall_ms while the pointer
+// position reported by the OS changed between two probes, so an idle user is
+// never mistaken for a stalled hook.  Keyboard only activity during a stall
+// is not detected.
+
+#define WATCHDOG_DEFAULT_STALL_MS       5000
+#define WATCHDOG_DEFAULT_PROBE_MS       1000
+#define WATCHDOG_DEFAULT_MIN_BACKOFF_MS 100
+#define WATCHDOG_DEFAULT_MAX_BACKOFF_MS 30000
+
+// A hook that stayed up this long before failing starts over from the
+// minimum delay.
+#define WATCHDOG_BACKOFF_RESET_MS       10000
+
+struct watchdog_config {
+  bool enabled;
+  uint32_t stall_ms;
+  uint32_t probe_ms;
+  uint32_t min_backoff_ms;
+  uint32_t max_backoff_ms;
+};
+
+void watchdog_configure(const watchdog_config &config);
+void watchdog_get_config(watchdog_config *config);
+
+// Delay before restart attempt number attempt (1 based).
+uint32_t watchdog_backoff_ms(uint32_t attempt);
+
+// Monitor thread.  Current pointer position according to the OS, in the
+// coordinates of hooked events; false if it cannot be queried.
+bool watchdog_probe_cursor(int16_t *x, int16_t *y);
+
+// Monitor thread.  Releases what watchdog_probe_cursor() opened.
+void watchdog_probe_close();
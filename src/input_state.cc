@@ -0,0 +1,83 @@
+#include "input_state.h"
+
+#include <atomic>
+
+static std::atomic<uint32_t> sKeys[8];
+static std::atomic<uint32_t> sButtons(0);
+static std::atomic<uint32_t> sMask(0);
+
+// x | y << 16, so both coordinates are read together.
+static std::atomic<uint32_t> sCursor(0);
+
+// Single writer: plain load and store instead of a locked read-modify-write.
+static inline void set_bit(std::atomic<uint32_t> &word, uint32_t bit, bool value) {
+  uint32_t current = word.load(std::memory_order_relaxed);
+  word.store(value ? (current | bit) : (current & ~bit), std::memory_order_relaxed);
+}
+
+static inline void set_cursor(int16_t x, int16_t y) {
+  sCursor.store((uint32_t) (uint16_t) x | ((uint32_t) (uint16_t) y << 16), std::memory_order_relaxed);
+}
+
+void input_state_update(const uiohook_event &event) {
+  switch (event.type) {
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED: {
+      uint8_t index = input_state_key_index(event.data.keyboard.keycode);
+      set_bit(sKeys[index >> 5], 1u << (index & 31), event.type == EVENT_KEY_PRESSED);
+      break;
+    }
+
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+      if (event.data.mouse.button > 0 && event.data.mouse.button <= 16) {
+        set_bit(sButtons, 1u << (event.data.mouse.button - 1), event.type == EVENT_MOUSE_PRESSED);
+      }
+      set_cursor(event.data.mouse.x, event.data.mouse.y);
+      break;
+
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+      set_cursor(event.data.mouse.x, event.data.mouse.y);
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      set_cursor(event.data.wheel.x, event.data.wheel.y);
+      break;
+
+    default:
+      return;
+  }
+
+  sMask.store(event.mask, std::memory_order_relaxed);
+}
+
+void input_state_reset() {
+  for (std::atomic<uint32_t> &word : sKeys) {
+    word.store(0, std::memory_order_relaxed);
+  }
+  sButtons.store(0, std::memory_order_relaxed);
+  sMask.store(0, std::memory_order_relaxed);
+}
+
+bool input_state_key_down(uint16_t keycode) {
+  uint8_t index = input_state_key_index(keycode);
+  return (sKeys[index >> 5].load(std::memory_order_relaxed) >> (index & 31)) & 1;
+}
+
+bool input_state_button_down(uint16_t button) {
+  return button > 0 && button <= 16 && ((sButtons.load(std::memory_order_relaxed) >> (button - 1)) & 1);
+}
+
+void input_state_get(input_state *state) {
+  for (int i = 0; i < 8; i++) {
+    state->keys[i] = sKeys[i].load(std::memory_order_relaxed);
+  }
+  state->mask = (uint16_t) sMask.load(std::memory_order_relaxed);
+  state->buttons = (uint16_t) sButtons.load(std::memory_order_relaxed);
+
+  uint32_t cursor = sCursor.load(std::memory_order_relaxed);
+  state->x = (int16_t) (cursor & 0xFFFF);
+  state->y = (int16_t) (cursor >> 16);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "uiohook.h"
+
+// Live input state kept by the pipeline worker thread (see pipeline.h): which
+// keys and mouse buttons are held, the modifier mask and the last cursor
+// position.  Every field is a single atomic word written only by the worker
+// thread, so reading the state from any thread is a few loads, without an X
+// round trip or a queued event.
+//
+// Keys are tracked in a 256 bit set indexed by input_state_key_index(): the
+// scancode in the low 7 bits and bit 7 set for extended (0x0E.. and 0xE0..)
+// keycodes.  Keypad keys reported with numlock off (0xEE..) map to the same
+// bit as with numlock on, since they are the same physical key.
+
+struct input_state {
+  uint32_t keys[8];
+  uint16_t mask;
+  uint16_t buttons;
+  int16_t x;
+  int16_t y;
+};
+
+static inline uint8_t input_state_key_index(uint16_t keycode) {
+  uint8_t index = (uint8_t) (keycode & 0x7F);
+  uint8_t prefix = (uint8_t) (keycode >> 8);
+  if (prefix == 0x0E || prefix == 0xE0) {
+    index |= 0x80;
+  }
+  return index;
+}
+
+static inline bool is_modifier_key(uint16_t keycode) {
+  switch (keycode) {
+    case VC_SHIFT_L:
+    case VC_SHIFT_R:
+    case VC_CONTROL_L:
+    case VC_CONTROL_R:
+    case VC_ALT_L:
+    case VC_ALT_R:
+    case VC_META_L:
+    case VC_META_R:
+      return true;
+  }
+  return false;
+}
+
+// Worker thread, for every event before filtering.
+void input_state_update(const uiohook_event &event);
+
+// Hook start: forget keys and buttons held while the hook was not running.
+void input_state_reset();
+
+bool input_state_key_down(uint16_t keycode);
+bool input_state_button_down(uint16_t button);
+void input_state_get(input_state *state);
@@ -1,507 +1,791 @@
 #include "iohook.h"
+#include "iohook_core.h"
 #include "uiohook.h"
-
-#ifdef _WIN32
-#include <windows.h>
-#else
-#if defined(__APPLE__) && defined(__MACH__)
-#include <CoreFoundation/CoreFoundation.h>
-#endif
-
-#include <pthread.h>
-#endif
-#include <queue>
+#include "analytics.h"
+#include "clock.h"
+#include "event_filter.h"
+#include "event_projection.h"
+#include "event_sampler.h"
+#include "flight_recorder.h"
+#include "hook_watchdog.h"
+#include "input_state.h"
+#include "key_sketch.h"
+#include "event_ring.h"
+#include "packed_event.h"
+#include "pipeline.h"
+#include "plugin_host.h"
+#include "raw_input.h"
+#include "synthetic_source.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 using namespace v8;
 using Callback = Nan::Callback;
 static bool sIsRunning = false;
 static bool sIsDebug = false;
+static bool sIsBatchMode = false;
+static bool sIsWheelCoalescing = false;
 
 static HookProcessWorker* sIOHook = nullptr;
+static MacroPlayer* sMacroPlayer = nullptr;
 
-static std::queue<uiohook_event> zqueue;
-
-// Native thread errors.
-#define UIOHOOK_ERROR_THREAD_CREATE       0x10
-
-// Thread and mutex variables.
-#ifdef _WIN32
-static HANDLE hook_thread;
-
-static CRITICAL_SECTION hook_running_mutex;
-static CRITICAL_SECTION hook_control_mutex;
-static CONDITION_VARIABLE hook_control_cond;
-#else
-static pthread_t hook_thread;
-
-static pthread_mutex_t hook_running_mutex;
-static pthread_mutex_t hook_control_mutex;
-static pthread_cond_t hook_control_cond;
-#endif
-
-static void logger_proc(unsigned int level, void *user_data, const char *format, va_list args) {
-    switch (level) {
-        case LOG_LEVEL_INFO:
-            vfprintf(stdout, format, args);
-            break;
-
-        case LOG_LEVEL_WARN:
-        case LOG_LEVEL_ERROR:
-            vfprintf(stderr, format, args);
-            break;
-    }
-}
-
-static void logger(unsigned int level, const char *format, ...) {
-    va_list args;
-
-    va_start(args, format);
-    logger_proc(level, NULL, format, args);
-    va_end(args);
-}
-
-// NOTE: The following callback executes on the same thread that hook_run() is called
-// from.  This is important because hook_run() attaches to the operating systems
-// event dispatcher and may delay event delivery to the target application.
-// Furthermore, some operating systems may choose to disable your hook if it
-// takes to long to process.  If you need to do any extended processing, please
-// do so by copying the event to your own queued dispatch thread.
-void dispatch_proc(uiohook_event * const event, void *user_data) {
-  switch (event->type) {
-    case EVENT_HOOK_ENABLED:
-      // Lock the running mutex so we know if the hook is enabled.
-      #ifdef _WIN32
-      EnterCriticalSection(&hook_running_mutex);
-      #else
-      pthread_mutex_lock(&hook_running_mutex);
-      #endif
-
-      // Unlock the control mutex so hook_enable() can continue.
-      #ifdef _WIN32
-      WakeConditionVariable(&hook_control_cond);
-      LeaveCriticalSection(&hook_control_mutex);
-      #else
-      // Unlock the control mutex so hook_enable() can continue.
-      pthread_cond_signal(&hook_control_cond);
-      pthread_mutex_unlock(&hook_control_mutex);
-      #endif
-      break;
+// Progress handle of the worker whose session is running.
+static std::atomic<const HookProcessWorker::HookExecution*> sHookExecution(nullptr);
 
-    case EVENT_HOOK_DISABLED:
-      // Lock the control mutex until we exit.
-      #ifdef _WIN32
-      EnterCriticalSection(&hook_control_mutex);
-      #else
-      pthread_mutex_lock(&hook_control_mutex);
-      #endif
-
-      // Unlock the running mutex so we know if the hook is disabled.
-      #ifdef _WIN32
-      LeaveCriticalSection(&hook_running_mutex);
-      #else
-      #if defined(__APPLE__) && defined(__MACH__)
-      // Stop the main runloop so that this program ends.
-      CFRunLoopStop(CFRunLoopGetMain());
-      #endif
-
-      pthread_mutex_unlock(&hook_running_mutex);
-      #endif
-      break;
+// The engine lives in iohook_core.cc; its queue is drained here.
+static SpscRing<packed_event> &zqueue = iohook_core_queue();
 
-    case EVENT_KEY_PRESSED:
-    case EVENT_KEY_RELEASED:
-    case EVENT_KEY_TYPED:
-    case EVENT_MOUSE_PRESSED:
-    case EVENT_MOUSE_RELEASED:
-    case EVENT_MOUSE_CLICKED:
-    case EVENT_MOUSE_MOVED:
-    case EVENT_MOUSE_DRAGGED:
-    case EVENT_MOUSE_WHEEL:
-      uiohook_event event_copy;
-      memcpy(&event_copy, event, sizeof(uiohook_event));
-      zqueue.push(event_copy);
-      sIOHook->fHookExecution->Send(event, sizeof(uiohook_event));
-      break;
+static latency_counter sDeliverLatency;
+
+// Delivery mode: 0 delivers as soon as possible, otherwise events are held
+// for at most this many milliseconds and delivered together.
+static uint64_t sDeliveryIntervalMs = 0;
+static uv_timer_t sDeliveryTimer;
+static bool sDeliveryTimerInit = false;
+static bool sDeliveryTimerArmed = false;
+
+// Properties materialized per event type, set by setProjection().  Main
+// thread only.
+static uint32_t sProjection[EVENT_MOUSE_WHEEL + 1] = {
+  PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL,
+  PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL, PROJECT_ALL
+};
+
+// Per-drain budget of HandleProgressCallback, 0 means unlimited.
+static size_t sDrainMaxEvents = 0;
+static uint64_t sDrainMaxNs = 0;
+
+// The batch path checks the time budget every this many events.
+#define DRAIN_CLOCK_INTERVAL 64
+
+// True once a drain that started at start has used up its time budget.  At
+// least one event is always delivered so a tiny budget cannot stall delivery.
+static inline bool drainBudgetSpent(uint64_t start, size_t delivered) {
+  return sDrainMaxNs > 0 && delivered > 0 && monotonic_ns() - start >= sDrainMaxNs;
+}
+
+// Main thread delivery statistics.
+static uint64_t sWakeupCount = 0;
+static uint64_t sDrainCount = 0;
+static uint64_t sDrainYieldCount = 0;
+static uint64_t sDrainEventCount = 0;
+static uint64_t sDrainMaxBlockedNs = 0;
+
+// Only the properties in fields are set, see event_projection.h.
+v8::Local<v8::Object> fillEventObject(uiohook_event event, uint32_t count = 1, uint32_t fields = PROJECT_ALL) {
+  v8::Local<v8::Context> context = v8::Isolate::GetCurrent()->GetCurrentContext();
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+
+  obj->Set(context, Nan::New("type").ToLocalChecked(), Nan::New((uint16_t)event.type));
+  if (fields == PROJECT_ALL) {
+    obj->Set(context, Nan::New("mask").ToLocalChecked(), Nan::New((uint16_t)event.mask));
+    obj->Set(context, Nan::New("time").ToLocalChecked(), Nan::New((double)event.time));
+  }
+
+  if ((event.type >= EVENT_KEY_TYPED) && (event.type <= EVENT_KEY_RELEASED)) {
+    v8::Local<v8::Object> keyboard = Nan::New<v8::Object>();
+    uint16_t keycode = event.data.keyboard.keycode;
+
+    if (fields & PROJECT_SHIFT_KEY) {
+      keyboard->Set(context, Nan::New("shiftKey").ToLocalChecked(), Nan::New(keycode == VC_SHIFT_L || keycode == VC_SHIFT_R));
+    }
+    if (fields & PROJECT_ALT_KEY) {
+      keyboard->Set(context, Nan::New("altKey").ToLocalChecked(), Nan::New(keycode == VC_ALT_L || keycode == VC_ALT_R));
+    }
+    if (fields & PROJECT_CTRL_KEY) {
+      keyboard->Set(context, Nan::New("ctrlKey").ToLocalChecked(), Nan::New(keycode == VC_CONTROL_L || keycode == VC_CONTROL_R));
+    }
+    if (fields & PROJECT_META_KEY) {
+      keyboard->Set(context, Nan::New("metaKey").ToLocalChecked(), Nan::New(keycode == VC_META_L || keycode == VC_META_R));
+    }
+
+    if (event.type == EVENT_KEY_TYPED) {
+      char* character = (char*) &event.data.keyboard.keychar;
+
+      if (fields & PROJECT_KEYCHAR) {
+        keyboard->Set(context, Nan::New("keychar").ToLocalChecked(), Nan::New((uint16_t)event.data.keyboard.keychar));
+      }
+      if (fields & PROJECT_KEY) {
+        keyboard->Set(context, Nan::New("key").ToLocalChecked(), Nan::New(character).ToLocalChecked());
+      }
+    }
+
+    if (fields & PROJECT_KEYCODE) {
+      keyboard->Set(context, Nan::New("keycode").ToLocalChecked(), Nan::New(keycode));
+    }
+    if (fields & PROJECT_RAWCODE) {
+      keyboard->Set(context, Nan::New("rawcode").ToLocalChecked(), Nan::New((uint16_t)event.data.keyboard.rawcode));
+    }
+
+    obj->Set(context, Nan::New("keyboard").ToLocalChecked(), keyboard);
+  } else if ((event.type >= EVENT_MOUSE_CLICKED) && (event.type < EVENT_MOUSE_WHEEL)) {
+    v8::Local<v8::Object> mouse = Nan::New<v8::Object>();
+    if (fields & PROJECT_BUTTON) {
+      mouse->Set(context, Nan::New("button").ToLocalChecked(), Nan::New((uint16_t)event.data.mouse.button));
+    }
+    if (fields & PROJECT_CLICKS) {
+      mouse->Set(context, Nan::New("clicks").ToLocalChecked(), Nan::New((uint16_t)event.data.mouse.clicks));
+    }
+    if (fields & PROJECT_X) {
+      mouse->Set(context, Nan::New("x").ToLocalChecked(), Nan::New((int16_t)event.data.mouse.x));
+    }
+    if (fields & PROJECT_Y) {
+      mouse->Set(context, Nan::New("y").ToLocalChecked(), Nan::New((int16_t)event.data.mouse.y));
+    }
+
+    obj->Set(context, Nan::New("mouse").ToLocalChecked(), mouse);
+  } else if (event.type == EVENT_MOUSE_WHEEL) {
+    v8::Local<v8::Object> wheel = Nan::New<v8::Object>();
+    if (fields & PROJECT_DELTA) {
+      wheel->Set(context, Nan::New("delta").ToLocalChecked(), Nan::New((uint16_t)event.data.wheel.delta));
+    }
+    if (fields & PROJECT_DIRECTION) {
+      wheel->Set(context, Nan::New("direction").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.direction));
+    }
+    if (fields & PROJECT_ROTATION) {
+      wheel->Set(context, Nan::New("rotation").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.rotation));
+    }
+    if (fields == PROJECT_ALL) {
+      wheel->Set(context, Nan::New("type").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.type));
+    }
+    if (fields & PROJECT_X) {
+      wheel->Set(context, Nan::New("x").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.x));
+    }
+    if (fields & PROJECT_Y) {
+      wheel->Set(context, Nan::New("y").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.y));
+    }
+
+    if (sIsWheelCoalescing && (fields & PROJECT_COUNT)) {
+      wheel->Set(context, Nan::New("count").ToLocalChecked(), Nan::New(count));
+    }
+
+    obj->Set(context, Nan::New("wheel").ToLocalChecked(), wheel);
   }
+  return obj;
 }
 
-#ifdef _WIN32
-DWORD WINAPI hook_thread_proc(LPVOID arg) {
-#else
-void *hook_thread_proc(void *arg) {
-#endif
-  // Set the hook status.
-  int status = hook_run();
-  if (status != UIOHOOK_SUCCESS) {
-    #ifdef _WIN32
-    *(DWORD *) arg = status;
-    #else
-    *(int *) arg = status;
-    #endif
-  }
-
-  // Make sure we signal that we have passed any exception throwing code for
-  // the waiting hook_enable().
-  #ifdef _WIN32
-  WakeConditionVariable(&hook_control_cond);
-  LeaveCriticalSection(&hook_control_mutex);
-
-  return status;
-  #else
-  // Make sure we signal that we have passed any exception throwing code for
-  // the waiting hook_enable().
-  pthread_cond_signal(&hook_control_cond);
-  pthread_mutex_unlock(&hook_control_mutex);
-
-  return arg;
-  #endif
-}
-
-int hook_enable() {
-  // Lock the thread control mutex.  This will be unlocked when the
-  // thread has finished starting, or when it has fully stopped.
-  #ifdef _WIN32
-  EnterCriticalSection(&hook_control_mutex);
-  #else
-  pthread_mutex_lock(&hook_control_mutex);
-  #endif
-
-  // Set the initial status.
-  int status = UIOHOOK_FAILURE;
-
-  #ifndef _WIN32
-  // Create the thread attribute.
-  pthread_attr_t hook_thread_attr;
-  pthread_attr_init(&hook_thread_attr);
-
-  // Get the policy and priority for the thread attr.
-  int policy;
-  pthread_attr_getschedpolicy(&hook_thread_attr, &policy);
-  int priority = sched_get_priority_max(policy);
-  #endif
-
-  #if defined(_WIN32)
-  DWORD hook_thread_id;
-  DWORD *hook_thread_status = (DWORD *) malloc(sizeof(DWORD));
-  hook_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) hook_thread_proc, hook_thread_status, 0, &hook_thread_id);
-  if (hook_thread != INVALID_HANDLE_VALUE) {
-  #else
-  int *hook_thread_status = (int*)malloc(sizeof(int));
-  if (pthread_create(&hook_thread, &hook_thread_attr, hook_thread_proc, hook_thread_status) == 0) {
-  #endif
-    #if defined(_WIN32)
-    // Attempt to set the thread priority to time critical.
-    if (SetThreadPriority(hook_thread, THREAD_PRIORITY_TIME_CRITICAL) == 0) {
-      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %li for thread %#p! (%#lX)\n",
-          __FUNCTION__, __LINE__, (long) THREAD_PRIORITY_TIME_CRITICAL,
-          hook_thread, (unsigned long) GetLastError());
-    }
-    #elif (defined(__APPLE__) && defined(__MACH__)) || _POSIX_C_SOURCE >= 200112L
-    // Some POSIX revisions do not support pthread_setschedprio so we will
-    // use pthread_setschedparam instead.
-    struct sched_param param = { .sched_priority = priority };
-    if (pthread_setschedparam(hook_thread, SCHED_OTHER, &param) != 0) {
-      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
-          __FUNCTION__, __LINE__, priority, (unsigned long) hook_thread);
-    }
-    #else
-    // Raise the thread priority using glibc pthread_setschedprio.
-    if (pthread_setschedprio(hook_thread, priority) != 0) {
-      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
-          __FUNCTION__, __LINE__, priority, (unsigned long) hook_thread);
-    }
-    #endif
-
-
-    // Wait for the thread to indicate that it has passed the
-    // initialization portion by blocking until either a EVENT_HOOK_ENABLED
-    // event is received or the thread terminates.
-    // NOTE This unlocks the hook_control_mutex while we wait.
-    #ifdef _WIN32
-    SleepConditionVariableCS(&hook_control_cond, &hook_control_mutex, INFINITE);
-    #else
-    pthread_cond_wait(&hook_control_cond, &hook_control_mutex);
-    #endif
-
-    #ifdef _WIN32
-    if (TryEnterCriticalSection(&hook_running_mutex) != FALSE) {
-    #else
-    if (pthread_mutex_trylock(&hook_running_mutex) == 0) {
-    #endif
-      // Lock Successful; The hook is not running but the hook_control_cond
-      // was signaled!  This indicates that there was a startup problem!
-
-      // Get the status back from the thread.
-      #ifdef _WIN32
-      WaitForSingleObject(hook_thread,  INFINITE);
-      GetExitCodeThread(hook_thread, hook_thread_status);
-      #else
-      pthread_join(hook_thread, (void **) &hook_thread_status);
-      status = *hook_thread_status;
-      #endif
-    }
-    else {
-      // Lock Failure; The hook is currently running and wait was signaled
-      // indicating that we have passed all possible start checks.  We can
-      // always assume a successful startup at this point.
-      status = UIOHOOK_SUCCESS;
-    }
-
-    free(hook_thread_status);
-
-    logger(LOG_LEVEL_DEBUG, "%s [%u]: Thread Result: (%#X).\n",
-        __FUNCTION__, __LINE__, status);
-  }
-  else {
-    status = UIOHOOK_ERROR_THREAD_CREATE;
-  }
-
-  // Make sure the control mutex is unlocked.
-  #ifdef _WIN32
-  LeaveCriticalSection(&hook_control_mutex);
-  #else
-  pthread_mutex_unlock(&hook_control_mutex);
-  #endif
-
-  return status;
-}
-
-void run() {
-  // Lock the thread control mutex.  This will be unlocked when the
-  // thread has finished starting, or when it has fully stopped.
-  #ifdef _WIN32
-  // Create event handles for the thread hook.
-  InitializeCriticalSection(&hook_running_mutex);
-  InitializeCriticalSection(&hook_control_mutex);
-  InitializeConditionVariable(&hook_control_cond);
-  #else
-  pthread_mutex_init(&hook_running_mutex, NULL);
-  pthread_mutex_init(&hook_control_mutex, NULL);
-  pthread_cond_init(&hook_control_cond, NULL);
-  #endif
-
-  // Set the logger callback for library output.
-  hook_set_logger_proc(&logger_proc, NULL);
-
-  // Set the event callback for uiohook events.
-  hook_set_dispatch_proc(&dispatch_proc, NULL);
-
-  // Start the hook and block.
-  // NOTE If EVENT_HOOK_ENABLED was delivered, the status will always succeed.
-  int status = hook_enable();
-  switch (status) {
-    case UIOHOOK_SUCCESS:
-      // We no longer block, so we need to explicitly wait for the thread to die.
-      #ifdef _WIN32
-      WaitForSingleObject(hook_thread,  INFINITE);
-      #else
-      #if defined(__APPLE__) && defined(__MACH__)
-      // NOTE Darwin requires that you start your own runloop from main.
-      CFRunLoopRun();
-      #endif
-
-      pthread_join(hook_thread, NULL);
-      #endif
-      break;
+static v8::Local<v8::Object> fillRawEventObject(const packed_event &packed) {
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  Nan::Set(obj, Nan::New("type").ToLocalChecked(), Nan::New((uint16_t) packed.type));
+  Nan::Set(obj, Nan::New("time").ToLocalChecked(), Nan::New((double) (raw_input_time_base() + packed.time)));
+
+  v8::Local<v8::Object> raw = Nan::New<v8::Object>();
+  Nan::Set(raw, Nan::New("sourceid").ToLocalChecked(), Nan::New((uint16_t) packed.mask));
+  if (packed.type == EVENT_RAW_MOTION) {
+    Nan::Set(raw, Nan::New("dx").ToLocalChecked(), Nan::New((int32_t) packed.data[0] / 65536.0));
+    Nan::Set(raw, Nan::New("dy").ToLocalChecked(), Nan::New((int32_t) packed.data[1] / 65536.0));
+  } else {
+    Nan::Set(raw, Nan::New("detail").ToLocalChecked(), Nan::New(packed.data[0]));
+  }
 
-    // System level errors.
-    case UIOHOOK_ERROR_OUT_OF_MEMORY:
-      logger(LOG_LEVEL_ERROR, "Failed to allocate memory. (%#X)\n", status);
-      break;
+  Nan::Set(obj, Nan::New("raw").ToLocalChecked(), raw);
+  return obj;
+}
 
+template<typename T, typename A>
+static v8::Local<A> newTypedArray(size_t length, T **data) {
+  v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(T));
+  v8::Local<A> array = A::New(buffer, 0, length);
 
-    // X11 specific errors.
-    case UIOHOOK_ERROR_X_OPEN_DISPLAY:
-      logger(LOG_LEVEL_ERROR, "Failed to open X11 display. (%#X)\n", status);
-      break;
+  Nan::TypedArrayContents<T> contents(array);
+  *data = *contents;
 
-    case UIOHOOK_ERROR_X_RECORD_NOT_FOUND:
-      logger(LOG_LEVEL_ERROR, "Unable to locate XRecord extension. (%#X)\n", status);
-      break;
+  return array;
+}
 
-    case UIOHOOK_ERROR_X_RECORD_ALLOC_RANGE:
-      logger(LOG_LEVEL_ERROR, "Unable to allocate XRecord range. (%#X)\n", status);
-      break;
+// Shorter view of the same storage, for batches cut by the drain budget.
+template<typename A>
+static v8::Local<A> truncateTypedArray(v8::Local<A> array, size_t length) {
+  return A::New(array->Buffer(), 0, length);
+}
 
-    case UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT:
-      logger(LOG_LEVEL_ERROR, "Unable to allocate XRecord context. (%#X)\n", status);
-      break;
+// Struct-of-arrays batch: one typed array per field, index i describes the
+// i-th event.  Fields that do not apply to an event type are 0.
+class BatchBuilder {
+  public:
+
+    explicit BatchBuilder(size_t length) : fLength(length) {
+      fTypeArray = newTypedArray<uint8_t, v8::Uint8Array>(length, &fType);
+      fTimeArray = newTypedArray<double, v8::Float64Array>(length, &fTime);
+      fXArray = newTypedArray<int32_t, v8::Int32Array>(length, &fX);
+      fYArray = newTypedArray<int32_t, v8::Int32Array>(length, &fY);
+      fKeycodeArray = newTypedArray<uint16_t, v8::Uint16Array>(length, &fKeycode);
+      fMaskArray = newTypedArray<uint16_t, v8::Uint16Array>(length, &fMask);
+    }
 
-    case UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT:
-      logger(LOG_LEVEL_ERROR, "Failed to enable XRecord context. (%#X)\n", status);
-      break;
+    void Set(size_t i, const uiohook_event &ev) {
+      fType[i] = (uint8_t) ev.type;
+      fTime[i] = (double) ev.time;
+      fMask[i] = ev.mask;
+      fX[i] = 0;
+      fY[i] = 0;
+      fKeycode[i] = 0;
+
+      if ((ev.type >= EVENT_KEY_TYPED) && (ev.type <= EVENT_KEY_RELEASED)) {
+        fKeycode[i] = ev.data.keyboard.keycode;
+      } else if ((ev.type >= EVENT_MOUSE_CLICKED) && (ev.type < EVENT_MOUSE_WHEEL)) {
+        fX[i] = ev.data.mouse.x;
+        fY[i] = ev.data.mouse.y;
+      } else if (ev.type == EVENT_MOUSE_WHEEL) {
+        fX[i] = ev.data.wheel.x;
+        fY[i] = ev.data.wheel.y;
+      }
+    }
 
+    void Truncate(size_t length) {
+      if (length < fLength) {
+        fLength = length;
+        fTypeArray = truncateTypedArray(fTypeArray, length);
+        fTimeArray = truncateTypedArray(fTimeArray, length);
+        fXArray = truncateTypedArray(fXArray, length);
+        fYArray = truncateTypedArray(fYArray, length);
+        fKeycodeArray = truncateTypedArray(fKeycodeArray, length);
+        fMaskArray = truncateTypedArray(fMaskArray, length);
+      }
+    }
 
-    // Windows specific errors.
-    case UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX:
-      logger(LOG_LEVEL_ERROR, "Failed to register low level windows hook. (%#X)\n", status);
-      break;
+    v8::Local<v8::Object> Build() {
+      v8::Local<v8::Object> batch = Nan::New<v8::Object>();
+      Nan::Set(batch, Nan::New("length").ToLocalChecked(), Nan::New((uint32_t) fLength));
+      Nan::Set(batch, Nan::New("type").ToLocalChecked(), fTypeArray);
+      Nan::Set(batch, Nan::New("time").ToLocalChecked(), fTimeArray);
+      Nan::Set(batch, Nan::New("x").ToLocalChecked(), fXArray);
+      Nan::Set(batch, Nan::New("y").ToLocalChecked(), fYArray);
+      Nan::Set(batch, Nan::New("keycode").ToLocalChecked(), fKeycodeArray);
+      Nan::Set(batch, Nan::New("mask").ToLocalChecked(), fMaskArray);
+      return batch;
+    }
 
+  private:
 
-    // Darwin specific errors.
-    case UIOHOOK_ERROR_AXAPI_DISABLED:
-      logger(LOG_LEVEL_ERROR, "Failed to enable access for assistive devices. (%#X)\n", status);
-      break;
+    size_t fLength;
+    uint8_t *fType;
+    double *fTime;
+    int32_t *fX, *fY;
+    uint16_t *fKeycode, *fMask;
+    v8::Local<v8::Uint8Array> fTypeArray;
+    v8::Local<v8::Float64Array> fTimeArray;
+    v8::Local<v8::Int32Array> fXArray, fYArray;
+    v8::Local<v8::Uint16Array> fKeycodeArray, fMaskArray;
+};
 
-    case UIOHOOK_ERROR_CREATE_EVENT_PORT:
-      logger(LOG_LEVEL_ERROR, "Failed to create apple event port. (%#X)\n", status);
-      break;
+size_t HookProcessWorker::HandleBatchProgress(size_t max_events, uint64_t start)
+{
+  HandleScope scope(Isolate::GetCurrent());
 
-    case UIOHOOK_ERROR_CREATE_RUN_LOOP_SOURCE:
-      logger(LOG_LEVEL_ERROR, "Failed to create apple run loop source. (%#X)\n", status);
-      break;
+  size_t length = std::min(zqueue.size(), max_events);
+  if (length == 0) {
+    return 0;
+  }
 
-    case UIOHOOK_ERROR_GET_RUNLOOP:
-      logger(LOG_LEVEL_ERROR, "Failed to acquire apple run loop. (%#X)\n", status);
+  BatchBuilder builder(length);
+  for (size_t i = 0; i < length; i++) {
+    if (i % DRAIN_CLOCK_INTERVAL == 0 && drainBudgetSpent(start, i)) {
+      builder.Truncate(i);
+      length = i;
       break;
+    }
 
-    case UIOHOOK_ERROR_CREATE_OBSERVER:
-      logger(LOG_LEVEL_ERROR, "Failed to create apple run loop observer. (%#X)\n", status);
-      break;
+    uiohook_event ev;
+    unpack_event(*zqueue.peek(), iohook_core_time_base(), &ev);
+    builder.Set(i, ev);
 
-    // Default error.
-    case UIOHOOK_FAILURE:
-    default:
-      logger(LOG_LEVEL_ERROR, "An unknown hook error occurred. (%#X)\n", status);
-      break;
+    packed_event consumed;
+    zqueue.pop(&consumed);
   }
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  Nan::Set(obj, Nan::New("batch").ToLocalChecked(), builder.Build());
+
+  v8::Local<v8::Value> argv[] = { obj };
+  callback->Call(1, argv);
+
+  return length;
 }
 
-void stop() {
-  int status = hook_stop();
-  switch (status) {
-    // System level errors.
-    case UIOHOOK_ERROR_OUT_OF_MEMORY:
-      logger(LOG_LEVEL_ERROR, "Failed to allocate memory. (%#X)", status);
-      break;
+// Hands a chunk back to the engine once its Buffer is collected.
+static void releaseNdjsonChunk(char *data, void *hint) {
+  iohook_core_release_ndjson(data);
+}
 
-    case UIOHOOK_ERROR_X_RECORD_GET_CONTEXT:
-      // NOTE This is the only platform specific error that occurs on hook_stop().
-      logger(LOG_LEVEL_ERROR, "Failed to get XRecord context. (%#X)", status);
-      break;
+// The pipeline worker formats NDJSON chunks, see iohook_core_set_ndjson();
+// each one is passed on as a Buffer over its memory, without a copy.  The
+// budget is checked between chunks.
+size_t HookProcessWorker::HandleNdjsonProgress(size_t max_events, uint64_t start)
+{
+  size_t delivered = 0;
+  iohook_ndjson_chunk chunk;
+  while (delivered < max_events && !drainBudgetSpent(start, delivered) && iohook_core_take_ndjson(&chunk)) {
+    HandleScope scope(Isolate::GetCurrent());
 
-    // Default error.
-    case UIOHOOK_FAILURE:
-    default:
-      logger(LOG_LEVEL_ERROR, "An unknown hook error occurred. (%#X)", status);
-      break;
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+    Nan::Set(obj, Nan::New("ndjson").ToLocalChecked(),
+      Nan::NewBuffer(chunk.data, (uint32_t) chunk.length, releaseNdjsonChunk, nullptr).ToLocalChecked());
+
+    v8::Local<v8::Value> argv[] = { obj };
+    callback->Call(1, argv);
+
+    delivered += chunk.count;
   }
 
-  #ifdef _WIN32
-  // Create event handles for the thread hook.
-  CloseHandle(hook_thread);
-  DeleteCriticalSection(&hook_running_mutex);
-  DeleteCriticalSection(&hook_control_mutex);
-  #else
-  pthread_mutex_destroy(&hook_running_mutex);
-  pthread_mutex_destroy(&hook_control_mutex);
-  pthread_cond_destroy(&hook_control_cond);
-  #endif
+  return delivered;
 }
 
-HookProcessWorker::HookProcessWorker(Nan::Callback * callback) :
-Nan::AsyncProgressWorkerBase<uiohook_event>(callback),
-fHookExecution(nullptr)
-{
+static void delivery_timer_proc(uv_timer_t *handle) {
+  sDeliveryTimerArmed = false;
 
+  if (sIsRunning && sIOHook != nullptr) {
+    Nan::HandleScope scope;
+    sIOHook->Drain();
+  }
 }
 
-v8::Local<v8::Object> fillEventObject(uiohook_event event) {
-  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+static void arm_delivery_timer(uint64_t timeout) {
+  if (!sDeliveryTimerInit) {
+    uv_timer_init(Nan::GetCurrentEventLoop(), &sDeliveryTimer);
+    uv_unref((uv_handle_t *) &sDeliveryTimer);
+    sDeliveryTimerInit = true;
+  }
 
-  obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("type").ToLocalChecked(), Nan::New((uint16_t)event.type));
-  obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("mask").ToLocalChecked(), Nan::New((uint16_t)event.mask));
-  obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("time").ToLocalChecked(), Nan::New((uint16_t)event.time));
+  uv_timer_start(&sDeliveryTimer, delivery_timer_proc, timeout, 0);
+  sDeliveryTimerArmed = true;
+}
 
-  if ((event.type >= EVENT_KEY_TYPED) && (event.type <= EVENT_KEY_RELEASED)) {
-    v8::Local<v8::Object> keyboard = Nan::New<v8::Object>();
+// Delivers the statuses posted since the last call as {status: {...}}.
+static void deliverStatuses(Nan::Callback *callback) {
+  std::vector<iohook_status> statuses;
+  iohook_core_take_statuses(&statuses);
 
-    if (event.data.keyboard.keycode == VC_SHIFT_L || event.data.keyboard.keycode == VC_SHIFT_R) {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("shiftKey").ToLocalChecked(), Nan::New(true));
-    } else {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("shiftKey").ToLocalChecked(), Nan::New(false));
-    }
+  for (const iohook_status &status : statuses) {
+    HandleScope scope(Isolate::GetCurrent());
 
-    if (event.data.keyboard.keycode == VC_ALT_L || event.data.keyboard.keycode == VC_ALT_R) {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("altKey").ToLocalChecked(), Nan::New(true));
-    } else {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("altKey").ToLocalChecked(), Nan::New(false));
+    v8::Local<v8::Object> detail = Nan::New<v8::Object>();
+    Nan::Set(detail, Nan::New("state").ToLocalChecked(), Nan::New(status.state).ToLocalChecked());
+    if (status.attempt > 0) {
+      Nan::Set(detail, Nan::New("attempt").ToLocalChecked(), Nan::New(status.attempt));
+      Nan::Set(detail, Nan::New("code").ToLocalChecked(), Nan::New(status.code));
     }
-
-    if (event.data.keyboard.keycode == VC_CONTROL_L || event.data.keyboard.keycode == VC_CONTROL_R) {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("ctrlKey").ToLocalChecked(), Nan::New(true));
-    } else {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("ctrlKey").ToLocalChecked(), Nan::New(false));
+    if (status.delay_ms > 0) {
+      Nan::Set(detail, Nan::New("delayMs").ToLocalChecked(), Nan::New(status.delay_ms));
     }
-
-    if (event.data.keyboard.keycode == VC_META_L || event.data.keyboard.keycode == VC_META_R) {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("metaKey").ToLocalChecked(), Nan::New(true));
-    } else {
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("metaKey").ToLocalChecked(), Nan::New(false));
+    if (strcmp(status.state, "up") == 0) {
+      Nan::Set(detail, Nan::New("downtimeMs").ToLocalChecked(), Nan::New(status.downtime_ms));
+    }
+    if (strcmp(status.state, "stalled") == 0) {
+      Nan::Set(detail, Nan::New("idleMs").ToLocalChecked(), Nan::New(status.idle_ms));
     }
 
-    if (event.type == EVENT_KEY_TYPED) {
-      char* character = (char*) &event.data.keyboard.keychar;
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+    Nan::Set(obj, Nan::New("status").ToLocalChecked(), detail);
+
+    v8::Local<v8::Value> argv[] = { obj };
+    callback->Call(1, argv);
+  }
+}
 
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("keychar").ToLocalChecked(), Nan::New((uint16_t)event.data.keyboard.keychar));
-      keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("key").ToLocalChecked(), Nan::New(character).ToLocalChecked());
+void HookProcessWorker::HandleProgressCallback(const uiohook_event * event, size_t size)
+{
+  sWakeupCount++;
+  deliverStatuses(callback);
+
+  // In batched mode the first wakeup of a burst only arms the delivery timer;
+  // further events do not wake us up until the timer has drained the queue.
+  if (sDeliveryIntervalMs > 0) {
+    if (!sDeliveryTimerArmed) {
+      arm_delivery_timer(sDeliveryIntervalMs);
     }
+    return;
+  }
 
-    keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("keycode").ToLocalChecked(), Nan::New((uint16_t)event.data.keyboard.keycode));
-    keyboard->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("rawcode").ToLocalChecked(), Nan::New((uint16_t)event.data.keyboard.rawcode));
+  Drain();
+}
 
-    obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("keyboard").ToLocalChecked(), keyboard);
-  } else if ((event.type >= EVENT_MOUSE_CLICKED) && (event.type < EVENT_MOUSE_WHEEL)) {
-    v8::Local<v8::Object> mouse = Nan::New<v8::Object>();
-    mouse->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("button").ToLocalChecked(), Nan::New((uint16_t)event.data.mouse.button));
-    mouse->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("clicks").ToLocalChecked(), Nan::New((uint16_t)event.data.mouse.clicks));
-    mouse->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("x").ToLocalChecked(), Nan::New((int16_t)event.data.mouse.x));
-    mouse->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("y").ToLocalChecked(), Nan::New((int16_t)event.data.mouse.y));
+// Folds the wheel events queued right behind ev into it, as long as they
+// scroll along the same axis, in the same direction and with the same scroll
+// type.  Rotation and delta are summed, the position and time are those of
+// the last event.  Returns the number of events folded together.
+static uint32_t coalesceWheelEvents(uiohook_event *ev, uint8_t aux) {
+  int32_t rotation = ev->data.wheel.rotation;
+  int32_t delta = ev->data.wheel.delta;
+  uint32_t count = 1;
+
+  const packed_event *next;
+  while ((next = zqueue.peek()) != nullptr && next->type == EVENT_MOUSE_WHEEL && next->aux == aux) {
+    uiohook_event following;
+    unpack_event(*next, iohook_core_time_base(), &following);
+    if ((following.data.wheel.rotation < 0) != (ev->data.wheel.rotation < 0)) {
+      break;
+    }
 
-    obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("mouse").ToLocalChecked(), mouse);
-  } else if (event.type == EVENT_MOUSE_WHEEL) {
-    v8::Local<v8::Object> wheel = Nan::New<v8::Object>();
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("delta").ToLocalChecked(), Nan::New((uint16_t)event.data.wheel.delta));
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("direction").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.direction));
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("rotation").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.rotation));
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("type").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.type));
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("x").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.x));
-    wheel->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("y").ToLocalChecked(), Nan::New((int16_t)event.data.wheel.y));
+    rotation += following.data.wheel.rotation;
+    delta += following.data.wheel.delta;
+    ev->time = following.time;
+    ev->mask = following.mask;
+    ev->data.wheel.x = following.data.wheel.x;
+    ev->data.wheel.y = following.data.wheel.y;
+    count++;
 
-    obj->Set(v8::Isolate::GetCurrent()->GetCurrentContext(), Nan::New("wheel").ToLocalChecked(), wheel);
+    packed_event consumed;
+    zqueue.pop(&consumed);
   }
-  return obj;
+
+  ev->data.wheel.rotation = (int16_t) std::max(-32768, std::min(32767, rotation));
+  ev->data.wheel.delta = (uint16_t) std::min(65535, delta);
+  return count;
 }
 
-void HookProcessWorker::HandleProgressCallback(const uiohook_event * event, size_t size)
+void HookProcessWorker::Drain()
 {
-  uiohook_event ev;
-  while (!zqueue.empty()) {
-    ev = zqueue.front();
+  uint64_t wakeup_ns;
+  if (iohook_core_begin_drain(&wakeup_ns)) {
+    sDeliverLatency.add(monotonic_ns() - wakeup_ns);
+  }
+  deliverStatuses(callback);
 
-    HandleScope scope(Isolate::GetCurrent());
+  uint64_t start = monotonic_ns();
+  size_t max_events = sDrainMaxEvents > 0 ? sDrainMaxEvents : SIZE_MAX;
+  // Chunks formatted before NDJSON mode was turned off still go out as such,
+  // and events queued before it was turned on as objects.
+  size_t delivered = HandleNdjsonProgress(max_events, start);
 
-    v8::Local<v8::Object> obj = fillEventObject(ev);
+  if (sIsBatchMode) {
+    if (delivered < max_events && !drainBudgetSpent(start, delivered)) {
+      delivered += HandleBatchProgress(max_events - delivered, start);
+    }
+  } else {
+    uiohook_event ev;
+    packed_event packed;
+    while (!zqueue.empty() && delivered < max_events) {
+      // Checking the clock every event is cheap compared to a call into JS.
+      if (drainBudgetSpent(start, delivered)) {
+        break;
+      }
 
-    v8::Local<v8::Value> argv[] = { obj };
+      packed = *zqueue.peek();
+      unpack_event(packed, iohook_core_time_base(), &ev);
+      zqueue.pop(&packed);
+
+      uint32_t count = 1;
+      if (sIsWheelCoalescing && ev.type == EVENT_MOUSE_WHEEL) {
+        count = coalesceWheelEvents(&ev, packed.aux);
+      }
+
+      HandleScope scope(Isolate::GetCurrent());
+
+      v8::Local<v8::Object> obj = fillEventObject(ev, count, ev.type <= EVENT_MOUSE_WHEEL ? sProjection[ev.type] : PROJECT_ALL);
+
+      v8::Local<v8::Value> argv[] = { obj };
+      callback->Call(1, argv);
+
+      delivered++;
+    }
+  }
+
+  // Raw input has a queue of its own and is always delivered event by event.
+  packed_event raw;
+  while (delivered < max_events && !drainBudgetSpent(start, delivered) && raw_input_pop(&raw)) {
+    HandleScope scope(Isolate::GetCurrent());
+
+    v8::Local<v8::Value> argv[] = { fillRawEventObject(raw) };
     callback->Call(1, argv);
 
-    zqueue.pop();
+    delivered++;
   }
+
+  uint64_t blocked = monotonic_ns() - start;
+  sDrainCount++;
+  sDrainEventCount += delivered;
+  sDrainMaxBlockedNs = std::max(sDrainMaxBlockedNs, blocked);
+
+  // Budget exhausted: give timers, I/O and rendering a turn and pick up the
+  // rest of the backlog on the next loop iteration.
+  if ((!zqueue.empty() || iohook_core_ndjson_pending() > 0 || raw_input_pending() > 0) && sIsRunning && fHookExecution != nullptr && sHookExecution.load() == fHookExecution) {
+    sDrainYieldCount++;
+    if (sDeliveryIntervalMs > 0) {
+      // The backlog is already late, do not hold it for another interval.
+      arm_delivery_timer(0);
+    } else {
+      fHookExecution->Send(nullptr, 0);
+    }
+  }
+}
+
+static void send_progress(void *execution) {
+  static_cast<const HookProcessWorker::HookExecution*>(execution)->Send(nullptr, 0);
+}
+
+HookProcessWorker::HookProcessWorker(Nan::Callback * callback) :
+Nan::AsyncProgressWorkerBase<uiohook_event>(callback),
+fHookExecution(nullptr)
+{
+  fSession = iohook_core_new_session();
 }
 
 void HookProcessWorker::Execute(const Nan::AsyncProgressWorkerBase<uiohook_event>::ExecutionProgress& progress)
 {
   fHookExecution = &progress;
-  run();
+  sHookExecution.store(&progress);
+  iohook_core_run_session(fSession, &send_progress, (void *) &progress);
+  sHookExecution.store(nullptr);
 }
 
 void HookProcessWorker::Stop()
 {
-  stop();
+  iohook_core_request_stop();
   sIsRunning = false;
 }
 
+void HookProcessWorker::Destroy()
+{
+  // The session is over, also when it ended on its own because the watchdog
+  // is off.  Nan deletes the worker after this, so nothing may still use it.
+  if (sIOHook == this) {
+    sIOHook = nullptr;
+    sIsRunning = false;
+    if (sDeliveryTimerArmed) {
+      uv_timer_stop(&sDeliveryTimer);
+      sDeliveryTimerArmed = false;
+    }
+  }
+
+  Nan::AsyncProgressWorkerBase<uiohook_event>::Destroy();
+}
+
+MacroPlayer::MacroPlayer(Nan::Callback * callback, std::vector<macro_step> steps) :
+fCallback(callback),
+fResource("iohook:macro"),
+fSteps(std::move(steps)),
+fCancel(false),
+fStats()
+{
+  fDone.data = this;
+}
+
+MacroPlayer::~MacroPlayer()
+{
+  delete fCallback;
+}
+
+void MacroPlayer::Start()
+{
+  uv_async_init(Nan::GetCurrentEventLoop(), &fDone, &MacroPlayer::DoneProc);
+  fThread = std::thread([this]() {
+    macro_play(fSteps, fCancel, &fStats);
+    uv_async_send(&fDone);
+  });
+}
+
+void MacroPlayer::Cancel()
+{
+  fCancel.store(true);
+}
+
+void MacroPlayer::DoneProc(uv_async_t *handle)
+{
+  static_cast<MacroPlayer*>(handle->data)->HandleDone();
+}
+
+void MacroPlayer::HandleDone()
+{
+  Nan::HandleScope scope;
+
+  fThread.join();
+  sMacroPlayer = nullptr;
+
+  v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+  Nan::Set(stats, Nan::New("planned").ToLocalChecked(), Nan::New((double) fStats.planned));
+  Nan::Set(stats, Nan::New("played").ToLocalChecked(), Nan::New((double) fStats.played));
+  Nan::Set(stats, Nan::New("cancelled").ToLocalChecked(), Nan::New(fStats.cancelled));
+  Nan::Set(stats, Nan::New("durationMs").ToLocalChecked(), Nan::New(fStats.duration_ms));
+  Nan::Set(stats, Nan::New("meanErrorUs").ToLocalChecked(), Nan::New(fStats.mean_error_us));
+  Nan::Set(stats, Nan::New("maxErrorUs").ToLocalChecked(), Nan::New(fStats.max_error_us));
+  Nan::Set(stats, Nan::New("p50ErrorUs").ToLocalChecked(), Nan::New(fStats.p50_error_us));
+  Nan::Set(stats, Nan::New("p99ErrorUs").ToLocalChecked(), Nan::New(fStats.p99_error_us));
+
+  v8::Local<v8::Value> argv[] = { Nan::Null(), stats };
+  fCallback->Call(2, argv, &fResource);
+
+  uv_close((uv_handle_t *) &fDone, [](uv_handle_t *handle) {
+    delete static_cast<MacroPlayer*>(handle->data);
+  });
+}
+
+static double getNumberProperty(v8::Local<v8::Object> obj, const char *key, double fallback) {
+  v8::Local<v8::Value> value;
+  if (Nan::Get(obj, Nan::New(key).ToLocalChecked()).ToLocal(&value) && value->IsNumber()) {
+    return Nan::To<double>(value).FromJust();
+  }
+
+  return fallback;
+}
+
+static macro_step macroStepFromObject(v8::Local<v8::Object> obj) {
+  macro_step step;
+  memset(&step, 0, sizeof(macro_step));
+
+  double time = getNumberProperty(obj, "time", 0);
+  step.offset_ns = time > 0 ? (uint64_t) (time * 1000000.0) : 0;
+
+  uiohook_event &event = step.event;
+  event.type = (event_type) (int) getNumberProperty(obj, "type", 0);
+  event.mask = (uint16_t) getNumberProperty(obj, "mask", 0);
+
+  if ((event.type >= EVENT_KEY_TYPED) && (event.type <= EVENT_KEY_RELEASED)) {
+    event.data.keyboard.keycode = (uint16_t) getNumberProperty(obj, "keycode", 0);
+    event.data.keyboard.rawcode = (uint16_t) getNumberProperty(obj, "rawcode", 0);
+    event.data.keyboard.keychar = (uint16_t) getNumberProperty(obj, "keychar", 0);
+  } else if ((event.type >= EVENT_MOUSE_CLICKED) && (event.type < EVENT_MOUSE_WHEEL)) {
+    event.data.mouse.button = (uint16_t) getNumberProperty(obj, "button", 0);
+    event.data.mouse.clicks = (uint16_t) getNumberProperty(obj, "clicks", 0);
+    event.data.mouse.x = (int16_t) getNumberProperty(obj, "x", 0);
+    event.data.mouse.y = (int16_t) getNumberProperty(obj, "y", 0);
+  } else if (event.type == EVENT_MOUSE_WHEEL) {
+    event.data.wheel.x = (int16_t) getNumberProperty(obj, "x", 0);
+    event.data.wheel.y = (int16_t) getNumberProperty(obj, "y", 0);
+    event.data.wheel.type = (uint8_t) getNumberProperty(obj, "scrollType", WHEEL_UNIT_SCROLL);
+    event.data.wheel.rotation = (int16_t) getNumberProperty(obj, "rotation", 0);
+    event.data.wheel.delta = (uint16_t) getNumberProperty(obj, "delta", 0);
+    event.data.wheel.direction = (uint8_t) getNumberProperty(obj, "direction", WHEEL_VERTICAL_DIRECTION);
+  }
+
+  return step;
+}
+
+NAN_METHOD(PlayMacro) {
+  if (info.Length() < 2 || !info[0]->IsArray() || !info[1]->IsFunction()) {
+    Nan::ThrowTypeError("playMacro expects an array of steps and a callback");
+    return;
+  }
+
+  //allow one single playback
+  if (sMacroPlayer != nullptr) {
+    Nan::ThrowError("A macro is already playing");
+    return;
+  }
+
+  v8::Local<v8::Array> array = info[0].As<v8::Array>();
+  std::vector<macro_step> steps;
+  steps.reserve(array->Length());
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    v8::Local<v8::Value> item;
+    if (!Nan::Get(array, i).ToLocal(&item) || !item->IsObject()) {
+      Nan::ThrowTypeError("playMacro steps must be objects");
+      return;
+    }
+
+    macro_step step = macroStepFromObject(item.As<v8::Object>());
+    if ((step.event.type < EVENT_KEY_TYPED) || (step.event.type > EVENT_MOUSE_WHEEL)) {
+      Nan::ThrowTypeError("playMacro steps must be keyboard or mouse events");
+      return;
+    }
+
+    steps.push_back(step);
+  }
+
+  // Deadlines are absolute, so the steps must be played in time order.
+  std::stable_sort(steps.begin(), steps.end(), [](const macro_step &a, const macro_step &b) {
+    return a.offset_ns < b.offset_ns;
+  });
+
+  Callback* callback = new Callback(info[1].As<Function>());
+  sMacroPlayer = new MacroPlayer(callback, std::move(steps));
+  sMacroPlayer->Start();
+}
+
+NAN_METHOD(StopMacro) {
+  if (sMacroPlayer != nullptr) {
+    sMacroPlayer->Cancel();
+  }
+}
+
+// Returns the contents of obj[key] if it is a typed array of T with at least
+// length elements, nullptr otherwise.
+template<typename T>
+static const T *getTypedArrayProperty(v8::Local<v8::Object> obj, const char *key, size_t length) {
+  v8::Local<v8::Value> value;
+  if (!Nan::Get(obj, Nan::New(key).ToLocalChecked()).ToLocal(&value) || !value->IsTypedArray()) {
+    return nullptr;
+  }
+
+  Nan::TypedArrayContents<T> contents(value);
+  if (contents.length() < length) {
+    return nullptr;
+  }
+
+  return *contents;
+}
+
+static v8::Local<v8::Uint32Array> newUint32Array(const uint32_t *data, size_t length) {
+  v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(uint32_t));
+  v8::Local<v8::Uint32Array> array = v8::Uint32Array::New(buffer, 0, length);
+
+  Nan::TypedArrayContents<uint32_t> contents(array);
+  memcpy(*contents, data, length * sizeof(uint32_t));
+
+  return array;
+}
+
+NAN_METHOD(AnalyzeBatch) {
+  if (info.Length() < 1 || !info[0]->IsObject()) {
+    Nan::ThrowTypeError("analyzeBatch expects a batch object");
+    return;
+  }
+
+  v8::Local<v8::Object> obj = info[0].As<v8::Object>();
+
+  batch_view batch;
+  batch.length = (size_t) getNumberProperty(obj, "length", 0);
+  batch.type = getTypedArrayProperty<uint8_t>(obj, "type", batch.length);
+  batch.time = getTypedArrayProperty<double>(obj, "time", batch.length);
+  batch.x = getTypedArrayProperty<int32_t>(obj, "x", batch.length);
+  batch.y = getTypedArrayProperty<int32_t>(obj, "y", batch.length);
+  batch.keycode = getTypedArrayProperty<uint16_t>(obj, "keycode", batch.length);
+  batch.mask = getTypedArrayProperty<uint16_t>(obj, "mask", batch.length);
+
+  if (!batch.type || !batch.time || !batch.x || !batch.y || !batch.keycode || !batch.mask) {
+    Nan::ThrowTypeError("analyzeBatch expects type, time, x, y, keycode and mask typed arrays of the batch length");
+    return;
+  }
+
+  batch_analysis analysis;
+  analyze_batch(batch, &analysis);
+
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("kernel").ToLocalChecked(), Nan::New(analytics_kernel_name()).ToLocalChecked());
+  Nan::Set(result, Nan::New("count").ToLocalChecked(), Nan::New((double) analysis.count));
+  Nan::Set(result, Nan::New("typeCounts").ToLocalChecked(), newUint32Array(analysis.type_counts, ANALYTICS_TYPE_COUNT));
+
+  v8::Local<v8::Object> modifiers = Nan::New<v8::Object>();
+  Nan::Set(modifiers, Nan::New("shift").ToLocalChecked(), Nan::New(analysis.shift_count));
+  Nan::Set(modifiers, Nan::New("ctrl").ToLocalChecked(), Nan::New(analysis.ctrl_count));
+  Nan::Set(modifiers, Nan::New("meta").ToLocalChecked(), Nan::New(analysis.meta_count));
+  Nan::Set(modifiers, Nan::New("alt").ToLocalChecked(), Nan::New(analysis.alt_count));
+  Nan::Set(result, Nan::New("modifierCounts").ToLocalChecked(), modifiers);
+  Nan::Set(result, Nan::New("maskPopcount").ToLocalChecked(), Nan::New((double) analysis.mask_popcount));
+
+  if (analysis.pointer_count > 0) {
+    v8::Local<v8::Object> box = Nan::New<v8::Object>();
+    Nan::Set(box, Nan::New("minX").ToLocalChecked(), Nan::New(analysis.min_x));
+    Nan::Set(box, Nan::New("minY").ToLocalChecked(), Nan::New(analysis.min_y));
+    Nan::Set(box, Nan::New("maxX").ToLocalChecked(), Nan::New(analysis.max_x));
+    Nan::Set(box, Nan::New("maxY").ToLocalChecked(), Nan::New(analysis.max_y));
+    Nan::Set(result, Nan::New("boundingBox").ToLocalChecked(), box);
+  } else {
+    Nan::Set(result, Nan::New("boundingBox").ToLocalChecked(), Nan::Null());
+  }
+
+  Nan::Set(result, Nan::New("moveCount").ToLocalChecked(), Nan::New((double) analysis.move_count));
+  Nan::Set(result, Nan::New("pathLength").ToLocalChecked(), Nan::New(analysis.path_length));
+  Nan::Set(result, Nan::New("maxVelocity").ToLocalChecked(), Nan::New(analysis.max_velocity));
+  Nan::Set(result, Nan::New("velocityHistogram").ToLocalChecked(), newUint32Array(analysis.velocity_histogram, ANALYTICS_HISTOGRAM_BUCKETS));
+  Nan::Set(result, Nan::New("accelerationHistogram").ToLocalChecked(), newUint32Array(analysis.acceleration_histogram, ANALYTICS_HISTOGRAM_BUCKETS));
+
+  info.GetReturnValue().Set(result);
+}
+
 NAN_METHOD(DebugEnable) {
   if (info.Length() > 0)
   {
@@ -509,6 +793,447 @@ NAN_METHOD(DebugEnable) {
   }
 }
 
+NAN_METHOD(SetBatchMode) {
+  if (info.Length() > 0)
+  {
+    sIsBatchMode = info[0]->IsTrue();
+  }
+}
+
+NAN_METHOD(SetNdjsonMode) {
+  if (info.Length() > 0)
+  {
+    iohook_core_set_ndjson(info[0]->IsTrue());
+  }
+}
+
+NAN_METHOD(SetDrainBudget) {
+  double max_events = info.Length() > 0 && info[0]->IsNumber() ? Nan::To<double>(info[0]).FromJust() : 0;
+  double max_ms = info.Length() > 1 && info[1]->IsNumber() ? Nan::To<double>(info[1]).FromJust() : 0;
+
+  sDrainMaxEvents = max_events > 0 ? (size_t) max_events : 0;
+  sDrainMaxNs = max_ms > 0 ? (uint64_t) (max_ms * 1000000.0) : 0;
+}
+
+NAN_METHOD(SetDeliveryMode) {
+  double interval = info.Length() > 0 && info[0]->IsNumber() ? Nan::To<double>(info[0]).FromJust() : 0;
+  sDeliveryIntervalMs = interval > 0 ? (uint64_t) interval : 0;
+
+  // Switching back to immediate delivery: flush whatever the timer was holding.
+  if (sDeliveryIntervalMs == 0 && sDeliveryTimerArmed) {
+    uv_timer_stop(&sDeliveryTimer);
+    delivery_timer_proc(&sDeliveryTimer);
+  }
+}
+
+NAN_METHOD(UseSyntheticSource) {
+  //only takes effect on the next startHook
+  iohook_core_use_synthetic_source(info.Length() > 0 && info[0]->IsTrue());
+  if (info.Length() > 1 && info[1]->IsNumber()) {
+    synthetic_set_rate(Nan::To<double>(info[1]).FromJust());
+  }
+  if (info.Length() > 2 && info[2]->IsNumber()) {
+    synthetic_set_limit((uint64_t) Nan::To<double>(info[2]).FromJust());
+  }
+  synthetic_set_fail_at_limit(info.Length() > 3 && info[3]->IsTrue());
+}
+
+static v8::Local<v8::Object> latencyObject(const latency_counter &latency) {
+  uint64_t count = latency.count.load(std::memory_order_relaxed);
+  uint64_t total_ns = latency.total_ns.load(std::memory_order_relaxed);
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  Nan::Set(obj, Nan::New("count").ToLocalChecked(), Nan::New((double) count));
+  Nan::Set(obj, Nan::New("meanUs").ToLocalChecked(), Nan::New(count > 0 ? (double) total_ns / count / 1e3 : 0.0));
+  Nan::Set(obj, Nan::New("maxUs").ToLocalChecked(), Nan::New((double) latency.max_ns.load(std::memory_order_relaxed) / 1e3));
+  return obj;
+}
+
+NAN_METHOD(GetStats) {
+  iohook_core_stats core;
+  iohook_core_get_stats(&core);
+
+  v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+
+  v8::Local<v8::Object> drain = Nan::New<v8::Object>();
+  Nan::Set(drain, Nan::New("wakeups").ToLocalChecked(), Nan::New((double) sWakeupCount));
+  Nan::Set(drain, Nan::New("drains").ToLocalChecked(), Nan::New((double) sDrainCount));
+  Nan::Set(drain, Nan::New("events").ToLocalChecked(), Nan::New((double) sDrainEventCount));
+  Nan::Set(drain, Nan::New("yields").ToLocalChecked(), Nan::New((double) sDrainYieldCount));
+  Nan::Set(drain, Nan::New("maxBlockedMs").ToLocalChecked(), Nan::New((double) sDrainMaxBlockedNs / 1000000.0));
+  Nan::Set(stats, Nan::New("drain").ToLocalChecked(), drain);
+
+  v8::Local<v8::Object> queue = Nan::New<v8::Object>();
+  Nan::Set(queue, Nan::New("capacity").ToLocalChecked(), Nan::New((double) core.queue_capacity));
+  Nan::Set(queue, Nan::New("pending").ToLocalChecked(), Nan::New((double) core.queue_pending));
+  Nan::Set(queue, Nan::New("dropped").ToLocalChecked(), Nan::New((double) core.queue_dropped));
+  Nan::Set(stats, Nan::New("queue").ToLocalChecked(), queue);
+
+  v8::Local<v8::Object> lifecycle = Nan::New<v8::Object>();
+  Nan::Set(lifecycle, Nan::New("starts").ToLocalChecked(), Nan::New((double) core.starts));
+  Nan::Set(lifecycle, Nan::New("stops").ToLocalChecked(), Nan::New((double) core.stops));
+  Nan::Set(lifecycle, Nan::New("lastStartMs").ToLocalChecked(), Nan::New((double) core.last_start_ns / 1000000.0));
+  Nan::Set(lifecycle, Nan::New("lastStopMs").ToLocalChecked(), Nan::New((double) core.last_stop_ns / 1000000.0));
+  Nan::Set(stats, Nan::New("lifecycle").ToLocalChecked(), lifecycle);
+
+  v8::Local<v8::Object> raw = Nan::New<v8::Object>();
+  Nan::Set(raw, Nan::New("active").ToLocalChecked(), Nan::New(raw_input_running()));
+  Nan::Set(raw, Nan::New("pending").ToLocalChecked(), Nan::New((double) raw_input_pending()));
+  Nan::Set(raw, Nan::New("dropped").ToLocalChecked(), Nan::New((double) raw_input_dropped()));
+  Nan::Set(stats, Nan::New("raw").ToLocalChecked(), raw);
+
+  v8::Local<v8::Object> filter = Nan::New<v8::Object>();
+  Nan::Set(filter, Nan::New("active").ToLocalChecked(), Nan::New(core.filter_active));
+  Nan::Set(filter, Nan::New("evaluated").ToLocalChecked(), Nan::New((double) core.filter_evaluated));
+  Nan::Set(filter, Nan::New("rejected").ToLocalChecked(), Nan::New((double) core.filter_rejected));
+  Nan::Set(stats, Nan::New("filter").ToLocalChecked(), filter);
+
+  plugin_host_stats host;
+  plugin_host_get_stats(&host);
+  v8::Local<v8::Object> plugins = Nan::New<v8::Object>();
+  Nan::Set(plugins, Nan::New("loaded").ToLocalChecked(), Nan::New((double) host.loaded));
+  Nan::Set(plugins, Nan::New("batches").ToLocalChecked(), Nan::New((double) host.batches));
+  Nan::Set(plugins, Nan::New("processed").ToLocalChecked(), Nan::New((double) host.processed));
+  Nan::Set(plugins, Nan::New("suppressed").ToLocalChecked(), Nan::New((double) host.suppressed));
+  Nan::Set(plugins, Nan::New("forwarded").ToLocalChecked(), Nan::New((double) host.forwarded));
+  Nan::Set(stats, Nan::New("plugins").ToLocalChecked(), plugins);
+
+  pipeline_stats pipeline;
+  pipeline_get_stats(&pipeline);
+  v8::Local<v8::Object> stages = Nan::New<v8::Object>();
+  Nan::Set(stages, Nan::New("queued").ToLocalChecked(), Nan::New((double) pipeline.queued));
+  Nan::Set(stages, Nan::New("dropped").ToLocalChecked(), Nan::New((double) pipeline.dropped));
+  Nan::Set(stages, Nan::New("pending").ToLocalChecked(), Nan::New((double) pipeline.pending));
+  Nan::Set(stages, Nan::New("batches").ToLocalChecked(), Nan::New((double) pipeline.batches));
+  Nan::Set(stages, Nan::New("queue").ToLocalChecked(), latencyObject(*pipeline.queue));
+  Nan::Set(stages, Nan::New("process").ToLocalChecked(), latencyObject(*pipeline.process));
+  Nan::Set(stages, Nan::New("deliver").ToLocalChecked(), latencyObject(sDeliverLatency));
+  Nan::Set(stats, Nan::New("pipeline").ToLocalChecked(), stages);
+
+  std::vector<sampler_stats> samplers;
+  sampler_get_stats(&samplers);
+  v8::Local<v8::Object> sampling = Nan::New<v8::Object>();
+  for (const sampler_stats &entry : samplers) {
+    v8::Local<v8::Object> counts = Nan::New<v8::Object>();
+    Nan::Set(counts, Nan::New("seen").ToLocalChecked(), Nan::New((double) entry.seen));
+    Nan::Set(counts, Nan::New("sampled").ToLocalChecked(), Nan::New((double) entry.sampled));
+    Nan::Set(sampling, entry.type, counts);
+  }
+  Nan::Set(stats, Nan::New("sampling").ToLocalChecked(), sampling);
+
+  flight_recorder_stats recorder;
+  flight_recorder_get_stats(&recorder);
+  v8::Local<v8::Object> history = Nan::New<v8::Object>();
+  Nan::Set(history, Nan::New("capacity").ToLocalChecked(), Nan::New((double) recorder.capacity));
+  Nan::Set(history, Nan::New("maxAge").ToLocalChecked(), Nan::New(recorder.max_age_ms));
+  Nan::Set(history, Nan::New("redact").ToLocalChecked(), Nan::New(recorder.redact));
+  Nan::Set(history, Nan::New("recorded").ToLocalChecked(), Nan::New((double) recorder.recorded));
+  Nan::Set(stats, Nan::New("history").ToLocalChecked(), history);
+
+  v8::Local<v8::Object> watchdog = Nan::New<v8::Object>();
+  Nan::Set(watchdog, Nan::New("state").ToLocalChecked(), Nan::New(core.watchdog_state).ToLocalChecked());
+  Nan::Set(watchdog, Nan::New("restarts").ToLocalChecked(), Nan::New((double) core.restarts));
+  Nan::Set(watchdog, Nan::New("stalls").ToLocalChecked(), Nan::New((double) core.stalls));
+  Nan::Set(watchdog, Nan::New("failures").ToLocalChecked(), Nan::New((double) core.failures));
+  Nan::Set(watchdog, Nan::New("lastRecoveryMs").ToLocalChecked(), Nan::New((double) core.last_recovery_ns / 1000000.0));
+  Nan::Set(stats, Nan::New("watchdog").ToLocalChecked(), watchdog);
+
+  info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(SetRawInput) {
+  if (info.Length() < 1 || !info[0]->IsTrue()) {
+    raw_input_stop();
+    return;
+  }
+
+  std::string error;
+  if (!raw_input_start(&iohook_core_wakeup, &error)) {
+    Nan::ThrowError(error.c_str());
+  }
+}
+
+NAN_METHOD(SetFilter) {
+  if (info.Length() < 1 || !info[0]->IsString() || info[0].As<v8::String>()->Length() == 0) {
+    iohook_core_set_filter(nullptr);
+    return;
+  }
+
+  Nan::Utf8String expression(info[0]);
+  filter_program *filter = new filter_program();
+  std::string error;
+  if (!filter_compile(*expression, filter, &error)) {
+    delete filter;
+    Nan::ThrowSyntaxError(("Invalid filter: " + error).c_str());
+    return;
+  }
+
+  iohook_core_set_filter(filter);
+}
+
+NAN_METHOD(LoadPlugin) {
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    Nan::ThrowTypeError("loadPlugin expects the path of a shared library");
+    return;
+  }
+
+  Nan::Utf8String path(info[0]);
+  std::string name, error;
+  if (!plugin_load(*path, &name, &error)) {
+    Nan::ThrowError(error.c_str());
+    return;
+  }
+
+  info.GetReturnValue().Set(Nan::New(name).ToLocalChecked());
+}
+
+NAN_METHOD(UnloadPlugin) {
+  bool unloaded = false;
+  if (info.Length() > 0 && info[0]->IsString()) {
+    Nan::Utf8String name(info[0]);
+    unloaded = plugin_unload(*name);
+  }
+
+  info.GetReturnValue().Set(Nan::New(unloaded));
+}
+
+NAN_METHOD(SetProjection) {
+  if (info.Length() < 1 || !info[0]->IsNumber()) {
+    Nan::ThrowTypeError("setProjection expects an event type");
+    return;
+  }
+
+  uint32_t type = Nan::To<uint32_t>(info[0]).FromJust();
+  if (type < EVENT_KEY_TYPED || type > EVENT_MOUSE_WHEEL) {
+    Nan::ThrowRangeError("Unknown event type");
+    return;
+  }
+
+  if (info.Length() < 2 || !info[1]->IsArray()) {
+    sProjection[type] = PROJECT_ALL;
+    return;
+  }
+
+  v8::Local<v8::Array> names = info[1].As<v8::Array>();
+  uint32_t fields = 0;
+  for (uint32_t i = 0; i < names->Length(); i++) {
+    Nan::Utf8String name(Nan::Get(names, i).ToLocalChecked());
+    uint32_t field = *name != nullptr ? projection_field((uint8_t) type, *name) : 0;
+    if (field == 0) {
+      Nan::ThrowError((std::string("Unknown event property: ") + (*name != nullptr ? *name : "")).c_str());
+      return;
+    }
+    fields |= field;
+  }
+
+  sProjection[type] = fields;
+}
+
+NAN_METHOD(SetWatchdog) {
+  watchdog_config config;
+  watchdog_get_config(&config);
+  config.enabled = info.Length() < 1 || info[0]->IsTrue();
+  if (info.Length() > 1 && info[1]->IsNumber()) {
+    config.stall_ms = Nan::To<uint32_t>(info[1]).FromJust();
+  }
+  if (info.Length() > 2 && info[2]->IsNumber()) {
+    config.probe_ms = Nan::To<uint32_t>(info[2]).FromJust();
+  }
+  if (info.Length() > 3 && info[3]->IsNumber()) {
+    config.min_backoff_ms = Nan::To<uint32_t>(info[3]).FromJust();
+  }
+  if (info.Length() > 4 && info[4]->IsNumber()) {
+    config.max_backoff_ms = Nan::To<uint32_t>(info[4]).FromJust();
+  }
+  if (config.probe_ms == 0 || config.min_backoff_ms == 0 || config.max_backoff_ms < config.min_backoff_ms) {
+    Nan::ThrowRangeError("Invalid watchdog timing");
+    return;
+  }
+
+  watchdog_configure(config);
+}
+
+NAN_METHOD(SetSampler) {
+  if (info.Length() < 2 || !info[0]->IsNumber() || !info[1]->IsNumber()) {
+    Nan::ThrowTypeError("setSampler expects an event type and a mode");
+    return;
+  }
+
+  sampler_config config;
+  config.mode = (uint8_t) Nan::To<uint32_t>(info[1]).FromJust();
+  config.n = info.Length() > 2 ? Nan::To<uint32_t>(info[2]).FromMaybe(1) : 1;
+  config.interval_ms = config.n;
+  config.size = config.n;
+  config.window_ms = info.Length() > 3 ? Nan::To<uint32_t>(info[3]).FromMaybe(1000) : 1000;
+  if (config.mode > SAMPLER_RESERVOIR) {
+    Nan::ThrowRangeError("Unknown sampler mode");
+    return;
+  }
+
+  iohook_core_set_sampler((uint8_t) Nan::To<uint32_t>(info[0]).FromJust(), config);
+}
+
+NAN_METHOD(EnableKeyStats) {
+  key_sketch_enable(info.Length() > 0 && info[0]->IsTrue());
+}
+
+NAN_METHOD(ResetKeyStats) {
+  key_sketch_reset();
+}
+
+static v8::Local<v8::Array> keySketchEntries(key_sketch_kind kind, size_t limit) {
+  std::vector<key_sketch_entry> entries;
+  key_sketch_top(kind, limit, &entries);
+
+  v8::Local<v8::Array> array = Nan::New<v8::Array>((int) entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    const key_sketch_entry &entry = entries[i];
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+
+    if (kind == KEY_SKETCH_CHORDS) {
+      Nan::Set(obj, Nan::New("modifiers").ToLocalChecked(), Nan::New((uint32_t) (entry.key >> 16)));
+      Nan::Set(obj, Nan::New("keycode").ToLocalChecked(), Nan::New((uint32_t) (entry.key & 0xFFFF)));
+    } else {
+      int length = kind == KEY_SKETCH_BIGRAMS ? 2 : 3;
+      v8::Local<v8::Array> keys = Nan::New<v8::Array>(length);
+      for (int k = 0; k < length; k++) {
+        Nan::Set(keys, k, Nan::New((uint32_t) ((entry.key >> (16 * (length - 1 - k))) & 0xFFFF)));
+      }
+      Nan::Set(obj, Nan::New("keys").ToLocalChecked(), keys);
+    }
+    Nan::Set(obj, Nan::New("count").ToLocalChecked(), Nan::New((double) entry.count));
+    Nan::Set(obj, Nan::New("error").ToLocalChecked(), Nan::New((double) entry.error));
+    Nan::Set(array, (uint32_t) i, obj);
+  }
+  return array;
+}
+
+NAN_METHOD(GetKeyStats) {
+  size_t limit = info.Length() > 0 && info[0]->IsNumber() ? Nan::To<uint32_t>(info[0]).FromJust() : KEY_SKETCH_TOP_K;
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  Nan::Set(obj, Nan::New("enabled").ToLocalChecked(), Nan::New(key_sketch_enabled()));
+  Nan::Set(obj, Nan::New("keystrokes").ToLocalChecked(), Nan::New((double) key_sketch_keystrokes()));
+  Nan::Set(obj, Nan::New("bigrams").ToLocalChecked(), keySketchEntries(KEY_SKETCH_BIGRAMS, limit));
+  Nan::Set(obj, Nan::New("trigrams").ToLocalChecked(), keySketchEntries(KEY_SKETCH_TRIGRAMS, limit));
+  Nan::Set(obj, Nan::New("chords").ToLocalChecked(), keySketchEntries(KEY_SKETCH_CHORDS, limit));
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(EstimateKeySequence) {
+  if (info.Length() < 1 || !info[0]->IsArray()) {
+    Nan::ThrowTypeError("estimateKeySequence expects an array of 2 or 3 keycodes");
+    return;
+  }
+
+  v8::Local<v8::Array> keys = info[0].As<v8::Array>();
+  if (keys->Length() < 2 || keys->Length() > 3) {
+    Nan::ThrowRangeError("estimateKeySequence expects an array of 2 or 3 keycodes");
+    return;
+  }
+
+  uint16_t keycodes[3];
+  for (uint32_t i = 0; i < keys->Length(); i++) {
+    keycodes[i] = (uint16_t) Nan::To<uint32_t>(Nan::Get(keys, i).ToLocalChecked()).FromMaybe(0);
+  }
+  info.GetReturnValue().Set(Nan::New((double) key_sketch_estimate(keycodes, keys->Length())));
+}
+
+NAN_METHOD(ExportKeyStats) {
+  std::string image;
+  key_sketch_snapshot(&image);
+  info.GetReturnValue().Set(Nan::CopyBuffer(image.data(), (uint32_t) image.size()).ToLocalChecked());
+}
+
+NAN_METHOD(ImportKeyStats) {
+  if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+    Nan::ThrowTypeError("importKeyStats expects a Buffer");
+    return;
+  }
+
+  std::string error;
+  if (!key_sketch_merge(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]), &error)) {
+    Nan::ThrowError(error.c_str());
+  }
+}
+
+NAN_METHOD(SetHistory) {
+  if (info.Length() < 3 || !info[0]->IsNumber() || !info[1]->IsNumber()) {
+    Nan::ThrowTypeError("setHistory expects a capacity, a maximum age and a redaction flag");
+    return;
+  }
+
+  double capacity = Nan::To<double>(info[0]).FromJust();
+  double max_age_ms = Nan::To<double>(info[1]).FromJust();
+  if (!(capacity >= 0 && capacity <= (1 << 24)) || !(max_age_ms >= 0 && max_age_ms <= UINT32_MAX)) {
+    Nan::ThrowRangeError("setHistory expects at most 16777216 events and a maximum age that fits 32 bits");
+    return;
+  }
+  flight_recorder_configure((size_t) capacity, (uint32_t) max_age_ms, info[2]->IsTrue());
+}
+
+NAN_METHOD(DumpHistory) {
+  std::vector<packed_event> events;
+  uint64_t time_base;
+  flight_recorder_dump(&events, &time_base);
+
+  // Binary: the packed events as recorded, with times relative to timeBase.
+  if (info.Length() > 0 && info[0]->IsTrue()) {
+    v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+    Nan::Set(obj, Nan::New("timeBase").ToLocalChecked(), Nan::New((double) time_base));
+    Nan::Set(obj, Nan::New("events").ToLocalChecked(),
+        Nan::CopyBuffer((const char *) events.data(), (uint32_t) (events.size() * sizeof(packed_event))).ToLocalChecked());
+    info.GetReturnValue().Set(obj);
+    return;
+  }
+
+  BatchBuilder builder(events.size());
+  for (size_t i = 0; i < events.size(); i++) {
+    uiohook_event ev;
+    unpack_event(events[i], time_base, &ev);
+    builder.Set(i, ev);
+  }
+  info.GetReturnValue().Set(builder.Build());
+}
+
+NAN_METHOD(IsKeyDown) {
+  info.GetReturnValue().Set(info.Length() > 0 && info[0]->IsNumber() &&
+      input_state_key_down((uint16_t) Nan::To<uint32_t>(info[0]).FromJust()));
+}
+
+NAN_METHOD(IsButtonDown) {
+  info.GetReturnValue().Set(info.Length() > 0 && info[0]->IsNumber() &&
+      input_state_button_down((uint16_t) Nan::To<uint32_t>(info[0]).FromJust()));
+}
+
+NAN_METHOD(GetInputState) {
+  input_state state;
+  input_state_get(&state);
+
+  v8::Local<v8::Object> obj = Nan::New<v8::Object>();
+  Nan::Set(obj, Nan::New("mask").ToLocalChecked(), Nan::New(state.mask));
+  Nan::Set(obj, Nan::New("buttons").ToLocalChecked(), Nan::New(state.buttons));
+  Nan::Set(obj, Nan::New("x").ToLocalChecked(), Nan::New(state.x));
+  Nan::Set(obj, Nan::New("y").ToLocalChecked(), Nan::New(state.y));
+
+  int pressed = 0;
+  for (uint32_t word : state.keys) {
+    for (; word != 0; word &= word - 1) {
+      pressed++;
+    }
+  }
+  Nan::Set(obj, Nan::New("keysDown").ToLocalChecked(), Nan::New(pressed));
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(SetWheelCoalescing) {
+  if (info.Length() > 0)
+  {
+    sIsWheelCoalescing = info[0]->IsTrue();
+  }
+}
+
 NAN_METHOD(StartHook) {
   //allow one single execution
   if (sIsRunning == false)
@@ -550,6 +1275,90 @@ NAN_MODULE_INIT(Init) {
 
   Nan::Set(target, Nan::New<String>("debugEnable").ToLocalChecked(),
   Nan::GetFunction(Nan::New<FunctionTemplate>(DebugEnable)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setBatchMode").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetBatchMode)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setNdjsonMode").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetNdjsonMode)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setDrainBudget").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetDrainBudget)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setWheelCoalescing").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetWheelCoalescing)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setDeliveryMode").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetDeliveryMode)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("useSyntheticSource").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(UseSyntheticSource)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("getStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(GetStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setRawInput").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetRawInput)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setFilter").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetFilter)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("loadPlugin").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(LoadPlugin)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("unloadPlugin").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(UnloadPlugin)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setSampler").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetSampler)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setProjection").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetProjection)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setWatchdog").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetWatchdog)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("enableKeyStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(EnableKeyStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("resetKeyStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(ResetKeyStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("getKeyStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(GetKeyStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("estimateKeySequence").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(EstimateKeySequence)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("exportKeyStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(ExportKeyStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("importKeyStats").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(ImportKeyStats)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("setHistory").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(SetHistory)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("dumpHistory").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(DumpHistory)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("isKeyDown").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(IsKeyDown)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("isButtonDown").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(IsButtonDown)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("getInputState").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(GetInputState)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("analyzeBatch").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(AnalyzeBatch)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("playMacro").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(PlayMacro)).ToLocalChecked());
+
+  Nan::Set(target, Nan::New<String>("stopMacro").ToLocalChecked(),
+  Nan::GetFunction(Nan::New<FunctionTemplate>(StopMacro)).ToLocalChecked());
 }
 
 NAN_MODULE_WORKER_ENABLED(nodeHook, Init)
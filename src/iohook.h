@@ -4,7 +4,12 @@
 
 #include <nan_object_wrap.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "uiohook.h"
+#include "macro_player.h"
 
 class HookProcessWorker : public Nan::AsyncProgressWorkerBase<uiohook_event>
 {
@@ -17,8 +22,50 @@ class HookProcessWorker : public Nan::AsyncProgressWorkerBase<uiohook_event>
     void Execute(const ExecutionProgress& progress);
   
     void HandleProgressCallback(const uiohook_event *event, size_t size);
+
+    void Drain();
+
+    size_t HandleBatchProgress(size_t max_events, uint64_t start);
+
+    size_t HandleNdjsonProgress(size_t max_events, uint64_t start);
   
     void Stop();
+
+    void Destroy();
   
     const HookExecution* fHookExecution;
-};
\ No newline at end of file
+
+  private:
+
+    uint64_t fSession;
+};
+
+// Plays a macro on a thread of its own rather than on the libuv pool, whose
+// few threads a long macro would hold for its whole duration.  Deletes
+// itself once the callback has run.
+class MacroPlayer
+{
+  public:
+
+    MacroPlayer(Nan::Callback * callback, std::vector<macro_step> steps);
+
+    ~MacroPlayer();
+
+    void Start();
+
+    void Cancel();
+
+  private:
+
+    static void DoneProc(uv_async_t *handle);
+
+    void HandleDone();
+
+    Nan::Callback *fCallback;
+    Nan::AsyncResource fResource;
+    std::vector<macro_step> fSteps;
+    std::atomic<bool> fCancel;
+    macro_stats fStats;
+    std::thread fThread;
+    uv_async_t fDone;
+};
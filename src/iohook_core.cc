@@ -0,0 +1,1103 @@
+#include "iohook_core.h"
+#include "clock.h"
+#include "epoch_guard.h"
+#include "event_json.h"
+#include "event_sampler.h"
+#include "flight_recorder.h"
+#include "hook_watchdog.h"
+#include "input_state.h"
+#include "key_sketch.h"
+#include "pipeline.h"
+#include "plugin_host.h"
+#include "synthetic_source.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#if defined(__APPLE__) && defined(__MACH__)
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+#include <pthread.h>
+#endif
+#include <stdarg.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static bool sUseSyntheticSource = false;
+
+// Hook sessions are numbered by iohook_core_new_session().  A new session
+// waits on the lifecycle mutex for the previous run() to return, and a stop
+// that arrives before the hook is enabled is picked up by run() through
+// sStopSession.
+static std::mutex sLifecycleMutex;
+static std::mutex sSessionMutex;
+static uint64_t sHookSession = 0;
+static uint64_t sStopSession = 0;
+static bool sHookEnabled = false;
+
+// Signalled by iohook_core_request_stop() so that the watchdog's restart
+// delay and probe interval end as soon as the session is stopped.
+static std::condition_variable sSessionCond;
+
+// Hook health, see hook_watchdog.h.  Statuses are posted by the session loop
+// and the monitor thread and taken by the consumer.
+static std::mutex sStatusMutex;
+static std::vector<iohook_status> sStatuses;
+static std::atomic<const char*> sWatchdogState("stopped");
+static std::atomic<uint64_t> sHookUpNs(0);
+static std::atomic<uint64_t> sHookDownNs(0);
+static std::atomic<uint64_t> sWatchdogRestarts(0);
+static std::atomic<uint64_t> sWatchdogStalls(0);
+static std::atomic<uint64_t> sWatchdogFailures(0);
+static std::atomic<uint64_t> sLastRecoveryNs(0);
+
+// Lifecycle statistics.
+static std::atomic<uint64_t> sStartCount(0);
+static std::atomic<uint64_t> sStopCount(0);
+static std::atomic<uint64_t> sStopRequestNs(0);
+static std::atomic<uint64_t> sLastStartNs(0);
+static std::atomic<uint64_t> sLastStopNs(0);
+
+// Events on their way from the pipeline worker thread to the consumer.  When
+// the consumer falls this far behind, new events are dropped and counted.
+#define IOHOOK_QUEUE_CAPACITY   65536
+
+static SpscRing<packed_event> zqueue(IOHOOK_QUEUE_CAPACITY);
+static std::atomic<uint64_t> sQueueDropCount(0);
+
+// NDJSON output, see iohook_core_set_ndjson().  Chunk buffers go back to the
+// worker through sNdjsonFree, which iohook_core_set_ndjson() fills up front;
+// the worker only allocates when none is free, and a buffer that comes back
+// while sNdjsonFree is full is deleted.  When the consumer falls
+// IOHOOK_NDJSON_QUEUE_CAPACITY chunks behind, new events are dropped and
+// counted with the queue's.
+#define IOHOOK_NDJSON_QUEUE_CAPACITY  256
+#define IOHOOK_NDJSON_SPARE_CHUNKS    8
+
+static std::atomic<bool> sNdjsonOutput(false);
+static SpscRing<iohook_ndjson_chunk> sNdjsonQueue(IOHOOK_NDJSON_QUEUE_CAPACITY);
+static SpscRing<char*> sNdjsonFree(IOHOOK_NDJSON_SPARE_CHUNKS);
+
+// Pipeline worker thread only.  A buffer the full queue turned down, kept for
+// the next chunk.
+static char *sNdjsonSpare = nullptr;
+
+// Packed event times are relative to the first event of the session, see
+// packed_event.h.  Only moved by the pipeline worker thread while the queue is
+// drained; iohook_core_new_session() asks for a new base.
+static std::atomic<uint64_t> sEventTimeBase(0);
+static std::atomic<bool> sEventTimeBaseSet(false);
+
+// Filter installed by iohook_core_set_filter(), evaluated by the pipeline worker thread
+// before an event is queued.  Replaced programs are retired through
+// sFilterEpoch, see epoch_guard.h.
+static std::atomic<filter_program*> sFilter(nullptr);
+static std::atomic<uint64_t> sFilterEpoch(0);
+static std::atomic<uint64_t> sFilterEvaluatedCount(0);
+static std::atomic<uint64_t> sFilterRejectedCount(0);
+
+// Set when the consumer is woken up and cleared when it starts draining, so
+// a burst of events costs a single wakeup.  sWakeupNs is when the pending
+// wakeup was sent.  The wakeup procedure is that of the running session.
+static std::atomic<bool> sWakeupPending(false);
+static std::atomic<uint64_t> sWakeupNs(0);
+static std::atomic<iohook_wakeup_proc> sWakeupProc(nullptr);
+static std::atomic<void*> sWakeupData(nullptr);
+static std::mutex sConsumerMutex;
+static std::condition_variable sConsumerCond;
+
+// Set with iohook_core_subscribe(), replaces the queue.
+static iohook_event_proc sSubscriber = nullptr;
+static void *sSubscriberData = nullptr;
+
+// Session started by iohook_core_start().
+static std::thread sSessionThread;
+
+// Native thread errors.
+#define UIOHOOK_ERROR_THREAD_CREATE       0x10
+
+// Thread and mutex variables.
+#ifdef _WIN32
+static HANDLE hook_thread;
+
+static CRITICAL_SECTION hook_running_mutex;
+static CRITICAL_SECTION hook_control_mutex;
+static CONDITION_VARIABLE hook_control_cond;
+
+// Written by the hook thread when hook_run() fails, which can happen long
+// after hook_enable() returned.
+static DWORD hook_thread_result;
+#else
+static pthread_t hook_thread;
+
+static pthread_mutex_t hook_running_mutex;
+static pthread_mutex_t hook_control_mutex;
+static pthread_cond_t hook_control_cond;
+
+// Written by the hook thread when hook_run() fails, which can happen long
+// after hook_enable() returned.
+static int hook_thread_result;
+#endif
+
+static void logger_proc(unsigned int level, void *user_data, const char *format, va_list args) {
+    switch (level) {
+        case LOG_LEVEL_INFO:
+            vfprintf(stdout, format, args);
+            break;
+
+        case LOG_LEVEL_WARN:
+        case LOG_LEVEL_ERROR:
+            vfprintf(stderr, format, args);
+            break;
+    }
+}
+
+static void logger(unsigned int level, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    logger_proc(level, NULL, format, args);
+    va_end(args);
+}
+
+static bool filter_accepts(const uiohook_event &event) {
+  if (sFilter.load(std::memory_order_relaxed) == nullptr) {
+    return true;
+  }
+
+  bool accepted;
+  {
+    epoch_guard guard(sFilterEpoch);
+    const filter_program *filter = sFilter.load();
+    accepted = filter == nullptr || filter_matches(*filter, event);
+  }
+
+  sFilterEvaluatedCount.fetch_add(1, std::memory_order_relaxed);
+  if (!accepted) {
+    sFilterRejectedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  return accepted;
+}
+
+void iohook_core_set_sampler(uint8_t type, const sampler_config &config) {
+  sampler_configure(type, config);
+  pipeline_tick();
+}
+
+void iohook_core_set_filter(filter_program *filter) {
+  retire_when_quiescent(sFilterEpoch, sFilter.exchange(filter));
+}
+
+static void notify_consumer() {
+  iohook_wakeup_proc wakeup = sWakeupProc.load();
+  if (wakeup != nullptr) {
+    wakeup(sWakeupData.load());
+  }
+
+  // Taking the mutex orders the notification after a concurrent predicate
+  // check in iohook_core_wait(), so the wakeup cannot be lost.
+  { std::lock_guard<std::mutex> lock(sConsumerMutex); }
+  sConsumerCond.notify_all();
+}
+
+void iohook_core_wakeup() {
+  if (!sWakeupPending.exchange(true)) {
+    sWakeupNs.store(monotonic_ns(), std::memory_order_relaxed);
+    notify_consumer();
+  }
+}
+
+// Formats events into as many chunks as they need and queues them.  Called
+// by the pipeline worker thread only.
+static void queue_ndjson(const uiohook_event *events, size_t count) {
+  size_t queued = 0;
+  for (size_t done = 0; done < count; ) {
+    iohook_ndjson_chunk chunk = { sNdjsonSpare, 0, 0 };
+    sNdjsonSpare = nullptr;
+    if (chunk.data == nullptr && !sNdjsonFree.pop(&chunk.data)) {
+      chunk.data = new char[IOHOOK_NDJSON_CHUNK_SIZE];
+    }
+
+    for (; done < count && IOHOOK_NDJSON_CHUNK_SIZE - chunk.length >= EVENT_JSON_MAX_LENGTH; done++) {
+      chunk.length += event_json_write(events[done], chunk.data + chunk.length);
+      chunk.count++;
+    }
+
+    if (sNdjsonQueue.push(chunk)) {
+      queued += chunk.count;
+    } else {
+      sNdjsonSpare = chunk.data;
+    }
+  }
+
+  if (queued < count) {
+    sQueueDropCount.fetch_add(count - queued, std::memory_order_relaxed);
+  }
+
+  if (queued > 0) {
+    iohook_core_wakeup();
+  }
+}
+
+// Hands events over to the consumer: one publish and at most one wakeup
+// however many events there are.  Called by the pipeline worker thread
+// only.
+static void queue_events(uiohook_event * const events, size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  if (sSubscriber != nullptr) {
+    sSubscriber(events, count, sSubscriberData);
+    return;
+  }
+
+  if (sNdjsonOutput.load(std::memory_order_relaxed)) {
+    queue_ndjson(events, count);
+    return;
+  }
+
+  // Events of the previous session that are still queued keep their base
+  // until the consumer has taken them.
+  uint64_t time_base = sEventTimeBase.load(std::memory_order_relaxed);
+  if ((!sEventTimeBaseSet.load() || packed_time_base_expired(time_base, events[0].time)) && zqueue.drained()) {
+    time_base = events[0].time;
+    sEventTimeBase.store(time_base, std::memory_order_relaxed);
+    sEventTimeBaseSet.store(true);
+  }
+
+  packed_event packed[64];
+  size_t queued = 0;
+  for (size_t done = 0; done < count; ) {
+    size_t chunk = std::min(count - done, sizeof(packed) / sizeof(packed[0]));
+    for (size_t i = 0; i < chunk; i++) {
+      pack_event(events[done + i], time_base, &packed[i]);
+    }
+    queued += zqueue.push(packed, chunk);
+    done += chunk;
+  }
+
+  if (queued < count) {
+    sQueueDropCount.fetch_add(count - queued, std::memory_order_relaxed);
+  }
+
+  if (queued > 0) {
+    iohook_core_wakeup();
+  }
+}
+
+static void post_status(const iohook_status &status) {
+  sWatchdogState.store(status.state);
+  {
+    std::lock_guard<std::mutex> lock(sStatusMutex);
+    sStatuses.push_back(status);
+  }
+
+  notify_consumer();
+}
+
+// Output of the batch the pipeline worker thread is processing, where the
+// samplers release reservoir samples too.
+static std::vector<uiohook_event> *sWorkerOutput = nullptr;
+
+// Set when a session ends, so that the worker releases every reservoir
+// sample held rather than waiting for the windows to close.
+static std::atomic<bool> sSamplerFlushAll(false);
+
+static uint64_t wall_time_ms() {
+  return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void emit_sampled(uiohook_event * const events, size_t count) {
+  sWorkerOutput->insert(sWorkerOutput->end(), events, events + count);
+}
+
+// Pipeline worker thread: events the plugins passed, which the filter and
+// the samplers then select from.
+static std::vector<uiohook_event> sPluginOutput;
+
+// Tracked and recorded before anything else: both reflect the devices, not
+// what plugins or JavaScript make of them.
+template<uint32_t Features>
+static inline void track_event(const uiohook_event &event) {
+  if (Features & IOHOOK_FEATURE_KEY_STATS) {
+    key_sketch_record(event, event.type == EVENT_KEY_PRESSED && input_state_key_down(event.data.keyboard.keycode));
+  }
+  input_state_update(event);
+  if (Features & IOHOOK_FEATURE_HISTORY) {
+    flight_recorder_record(event);
+  }
+}
+
+template<uint32_t Features>
+static inline void select_event(const uiohook_event &event, std::vector<uiohook_event> *out) {
+  if ((Features & IOHOOK_FEATURE_FILTER) && !filter_accepts(event)) {
+    return;
+  }
+  if ((Features & IOHOOK_FEATURE_SAMPLER) && !sampler_accept(event, &emit_sampled)) {
+    return;
+  }
+  out->push_back(event);
+}
+
+// Pipeline worker thread: everything that happens to an event between the
+// hook and the consumer queue.  Instantiated once per set of enabled
+// features, so the ones that are off cost nothing per event.  Features still
+// check for themselves, which covers one turned off during a batch.
+//
+// Plugins see every event, so they run between tracking and the filter and
+// samplers JavaScript sets up.
+template<uint32_t Features>
+static void process_batch(const uiohook_event *events, size_t count, std::vector<uiohook_event> *out) {
+  sWorkerOutput = out;
+  if (count > 0 && plugin_host_active()) {
+    for (size_t i = 0; i < count; i++) {
+      track_event<Features>(events[i]);
+    }
+
+    sPluginOutput.assign(events, events + count);
+    size_t passed = plugin_process(sPluginOutput.data(), count);
+    for (size_t i = 0; i < passed; i++) {
+      select_event<Features>(sPluginOutput[i], out);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      track_event<Features>(events[i]);
+      select_event<Features>(events[i], out);
+    }
+  }
+  sWorkerOutput = nullptr;
+}
+
+static const iohook_process_proc sProcessProcs[IOHOOK_FEATURE_ALL + 1] = {
+  &process_batch<0x0>, &process_batch<0x1>, &process_batch<0x2>, &process_batch<0x3>,
+  &process_batch<0x4>, &process_batch<0x5>, &process_batch<0x6>, &process_batch<0x7>,
+  &process_batch<0x8>, &process_batch<0x9>, &process_batch<0xA>, &process_batch<0xB>,
+  &process_batch<0xC>, &process_batch<0xD>, &process_batch<0xE>, &process_batch<0xF>
+};
+
+// Pipeline worker thread only.
+static uint32_t sProcessFeatures = 0;
+static iohook_process_proc sProcessProc = &process_batch<0x0>;
+
+uint32_t iohook_core_features() {
+  uint32_t features = 0;
+  if (key_sketch_enabled()) {
+    features |= IOHOOK_FEATURE_KEY_STATS;
+  }
+  if (flight_recorder_active()) {
+    features |= IOHOOK_FEATURE_HISTORY;
+  }
+  if (sFilter.load(std::memory_order_relaxed) != nullptr) {
+    features |= IOHOOK_FEATURE_FILTER;
+  }
+  if (sampler_active()) {
+    features |= IOHOOK_FEATURE_SAMPLER;
+  }
+  return features;
+}
+
+iohook_process_proc iohook_core_process_proc(uint32_t features) {
+  return sProcessProcs[features & IOHOOK_FEATURE_ALL];
+}
+
+// The configuration is looked at once per batch; the variant only changes
+// along with it.
+static void process_events(const uiohook_event *events, size_t count, std::vector<uiohook_event> *out) {
+  uint32_t features = iohook_core_features();
+  if (features != sProcessFeatures) {
+    sProcessFeatures = features;
+    sProcessProc = sProcessProcs[features];
+  }
+
+  // Reservoir windows close with the clock, not with the next event: release
+  // closed ones first, and come back for the next one if no event does.
+  if (sampler_pending() || sSamplerFlushAll.load(std::memory_order_relaxed)) {
+    uint64_t now = sSamplerFlushAll.exchange(false) ? UINT64_MAX : wall_time_ms();
+    sWorkerOutput = out;
+    sampler_flush(now, &emit_sampled);
+    sWorkerOutput = nullptr;
+  }
+  sProcessProc(events, count, out);
+  uint64_t next = sampler_next_flush();
+  if (next != UINT64_MAX) {
+    uint64_t now = wall_time_ms();
+    pipeline_schedule_tick(next > now ? next - now : 0);
+  }
+}
+
+// NOTE: The following callback executes on the same thread that hook_run() is called
+// from.  This is important because hook_run() attaches to the operating systems
+// event dispatcher and may delay event delivery to the target application.
+// Furthermore, some operating systems may choose to disable your hook if it
+// takes to long to process.  If you need to do any extended processing, please
+// do so by copying the event to your own queued dispatch thread.
+static void dispatch_proc(uiohook_event * const event, void *user_data) {
+  switch (event->type) {
+    case EVENT_HOOK_ENABLED:
+      // Lock the running mutex so we know if the hook is enabled.
+      #ifdef _WIN32
+      EnterCriticalSection(&hook_running_mutex);
+      #else
+      pthread_mutex_lock(&hook_running_mutex);
+      #endif
+
+      // Unlock the control mutex so hook_enable() can continue.
+      #ifdef _WIN32
+      WakeConditionVariable(&hook_control_cond);
+      LeaveCriticalSection(&hook_control_mutex);
+      #else
+      // Unlock the control mutex so hook_enable() can continue.
+      pthread_cond_signal(&hook_control_cond);
+      pthread_mutex_unlock(&hook_control_mutex);
+      #endif
+      break;
+
+    case EVENT_HOOK_DISABLED:
+      // Lock the control mutex until we exit.
+      #ifdef _WIN32
+      EnterCriticalSection(&hook_control_mutex);
+      #else
+      pthread_mutex_lock(&hook_control_mutex);
+      #endif
+
+      // Unlock the running mutex so we know if the hook is disabled.
+      #ifdef _WIN32
+      LeaveCriticalSection(&hook_running_mutex);
+      #else
+      #if defined(__APPLE__) && defined(__MACH__)
+      // Stop the main runloop so that this program ends.
+      CFRunLoopStop(CFRunLoopGetMain());
+      #endif
+
+      pthread_mutex_unlock(&hook_running_mutex);
+      #endif
+      break;
+
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+    case EVENT_KEY_TYPED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+    case EVENT_MOUSE_WHEEL:
+      // Everything else happens on the pipeline worker thread.
+      pipeline_push(*event);
+      break;
+  }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI hook_thread_proc(LPVOID arg) {
+#else
+static void *hook_thread_proc(void *arg) {
+#endif
+  // Set the hook status.
+  int status = sUseSyntheticSource ? synthetic_run(&dispatch_proc, NULL) : hook_run();
+  if (status != UIOHOOK_SUCCESS) {
+    #ifdef _WIN32
+    *(DWORD *) arg = status;
+    #else
+    *(int *) arg = status;
+    #endif
+  }
+
+  // Make sure we signal that we have passed any exception throwing code for
+  // the waiting hook_enable().
+  #ifdef _WIN32
+  WakeConditionVariable(&hook_control_cond);
+  LeaveCriticalSection(&hook_control_mutex);
+
+  return status;
+  #else
+  // Make sure we signal that we have passed any exception throwing code for
+  // the waiting hook_enable().
+  pthread_cond_signal(&hook_control_cond);
+  pthread_mutex_unlock(&hook_control_mutex);
+
+  return arg;
+  #endif
+}
+
+static int hook_enable() {
+  // Lock the thread control mutex.  This will be unlocked when the
+  // thread has finished starting, or when it has fully stopped.
+  #ifdef _WIN32
+  EnterCriticalSection(&hook_control_mutex);
+  #else
+  pthread_mutex_lock(&hook_control_mutex);
+  #endif
+
+  // Set the initial status.
+  int status = UIOHOOK_FAILURE;
+
+  #ifndef _WIN32
+  // Create the thread attribute.
+  pthread_attr_t hook_thread_attr;
+  pthread_attr_init(&hook_thread_attr);
+
+  // Get the policy and priority for the thread attr.
+  int policy;
+  pthread_attr_getschedpolicy(&hook_thread_attr, &policy);
+  int priority = sched_get_priority_max(policy);
+  #endif
+
+  // Only written by the hook thread on failure.
+  hook_thread_result = UIOHOOK_SUCCESS;
+
+  #if defined(_WIN32)
+  DWORD hook_thread_id;
+  DWORD *hook_thread_status = &hook_thread_result;
+  hook_thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) hook_thread_proc, hook_thread_status, 0, &hook_thread_id);
+  if (hook_thread != INVALID_HANDLE_VALUE) {
+  #else
+  int *hook_thread_status = &hook_thread_result;
+  if (pthread_create(&hook_thread, &hook_thread_attr, hook_thread_proc, hook_thread_status) == 0) {
+  #endif
+    #if defined(_WIN32)
+    // Attempt to set the thread priority to time critical.
+    if (SetThreadPriority(hook_thread, THREAD_PRIORITY_TIME_CRITICAL) == 0) {
+      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %li for thread %#p! (%#lX)\n",
+          __FUNCTION__, __LINE__, (long) THREAD_PRIORITY_TIME_CRITICAL,
+          hook_thread, (unsigned long) GetLastError());
+    }
+    #elif (defined(__APPLE__) && defined(__MACH__)) || _POSIX_C_SOURCE >= 200112L
+    // Some POSIX revisions do not support pthread_setschedprio so we will
+    // use pthread_setschedparam instead.
+    struct sched_param param = { .sched_priority = priority };
+    if (pthread_setschedparam(hook_thread, SCHED_OTHER, &param) != 0) {
+      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
+          __FUNCTION__, __LINE__, priority, (unsigned long) hook_thread);
+    }
+    #else
+    // Raise the thread priority using glibc pthread_setschedprio.
+    if (pthread_setschedprio(hook_thread, priority) != 0) {
+      logger(LOG_LEVEL_WARN, "%s [%u]: Could not set thread priority %i for thread 0x%lX!\n",
+          __FUNCTION__, __LINE__, priority, (unsigned long) hook_thread);
+    }
+    #endif
+
+
+    // Wait for the thread to indicate that it has passed the
+    // initialization portion by blocking until either a EVENT_HOOK_ENABLED
+    // event is received or the thread terminates.
+    // NOTE This unlocks the hook_control_mutex while we wait.
+    #ifdef _WIN32
+    SleepConditionVariableCS(&hook_control_cond, &hook_control_mutex, INFINITE);
+    #else
+    pthread_cond_wait(&hook_control_cond, &hook_control_mutex);
+    #endif
+
+    #ifdef _WIN32
+    if (TryEnterCriticalSection(&hook_running_mutex) != FALSE) {
+    #else
+    if (pthread_mutex_trylock(&hook_running_mutex) == 0) {
+    #endif
+      // Lock Successful; The hook is not running but the hook_control_cond
+      // was signaled!  This indicates that there was a startup problem!
+
+      // Get the status back from the thread.
+      #ifdef _WIN32
+      WaitForSingleObject(hook_thread,  INFINITE);
+      GetExitCodeThread(hook_thread, hook_thread_status);
+      #else
+      pthread_join(hook_thread, (void **) &hook_thread_status);
+      status = *hook_thread_status;
+      #endif
+    }
+    else {
+      // Lock Failure; The hook is currently running and wait was signaled
+      // indicating that we have passed all possible start checks.  We can
+      // always assume a successful startup at this point.
+      status = UIOHOOK_SUCCESS;
+    }
+
+    logger(LOG_LEVEL_DEBUG, "%s [%u]: Thread Result: (%#X).\n",
+        __FUNCTION__, __LINE__, status);
+  }
+  else {
+    status = UIOHOOK_ERROR_THREAD_CREATE;
+  }
+
+  // Make sure the control mutex is unlocked.
+  #ifdef _WIN32
+  LeaveCriticalSection(&hook_control_mutex);
+  #else
+  pthread_mutex_unlock(&hook_control_mutex);
+  #endif
+
+  return status;
+}
+
+static void stop_hook();
+
+static int run(uint64_t session) {
+  uint64_t start = monotonic_ns();
+
+  // Lock the thread control mutex.  This will be unlocked when the
+  // thread has finished starting, or when it has fully stopped.
+  #ifdef _WIN32
+  // Create event handles for the thread hook.
+  InitializeCriticalSection(&hook_running_mutex);
+  InitializeCriticalSection(&hook_control_mutex);
+  InitializeConditionVariable(&hook_control_cond);
+  #else
+  pthread_mutex_init(&hook_running_mutex, NULL);
+  pthread_mutex_init(&hook_control_mutex, NULL);
+  pthread_cond_init(&hook_control_cond, NULL);
+  #endif
+
+  // Set the logger callback for library output.
+  hook_set_logger_proc(&logger_proc, NULL);
+
+  // Set the event callback for uiohook events.
+  hook_set_dispatch_proc(&dispatch_proc, NULL);
+
+  // Start the hook and block.
+  // NOTE If EVENT_HOOK_ENABLED was delivered, the status will always succeed.
+  int status = hook_enable();
+  bool enabled = status == UIOHOOK_SUCCESS;
+  if (enabled) {
+    sLastStartNs.store(monotonic_ns() - start);
+    sStartCount++;
+
+    bool stop_requested;
+    {
+      std::lock_guard<std::mutex> lock(sSessionMutex);
+      sHookEnabled = true;
+      stop_requested = sStopSession >= session;
+    }
+
+    uint64_t up = monotonic_ns();
+    sHookUpNs.store(up);
+    uint64_t down = sHookDownNs.exchange(0);
+    if (down != 0) {
+      // Back after a failure or a stall.
+      sLastRecoveryNs.store(up - down);
+      sWatchdogRestarts++;
+      iohook_status status = { "up", 0, 0, 0, (up - down) / 1e6, 0 };
+      post_status(status);
+    } else {
+      sWatchdogState.store("up");
+    }
+
+    // StopHook was called before the hook came up; it could not stop it then.
+    if (stop_requested) {
+      sStopRequestNs.store(monotonic_ns());
+      stop_hook();
+    }
+  }
+
+  switch (status) {
+    case UIOHOOK_SUCCESS: {
+      // We no longer block, so we need to explicitly wait for the thread to
+      // die; it tells whether the hook stopped or failed while running.
+      #ifdef _WIN32
+      WaitForSingleObject(hook_thread,  INFINITE);
+      DWORD hook_thread_status;
+      GetExitCodeThread(hook_thread, &hook_thread_status);
+      status = (int) hook_thread_status;
+      #else
+      #if defined(__APPLE__) && defined(__MACH__)
+      // NOTE Darwin requires that you start your own runloop from main.
+      CFRunLoopRun();
+      #endif
+
+      int *hook_thread_status;
+      pthread_join(hook_thread, (void **) &hook_thread_status);
+      status = *hook_thread_status;
+      #endif
+
+      if (status != UIOHOOK_SUCCESS) {
+        logger(LOG_LEVEL_ERROR, "The hook failed while running. (%#X)\n", status);
+      }
+      break;
+    }
+
+    // System level errors.
+    case UIOHOOK_ERROR_OUT_OF_MEMORY:
+      logger(LOG_LEVEL_ERROR, "Failed to allocate memory. (%#X)\n", status);
+      break;
+
+
+    // X11 specific errors.
+    case UIOHOOK_ERROR_X_OPEN_DISPLAY:
+      logger(LOG_LEVEL_ERROR, "Failed to open X11 display. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_X_RECORD_NOT_FOUND:
+      logger(LOG_LEVEL_ERROR, "Unable to locate XRecord extension. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_X_RECORD_ALLOC_RANGE:
+      logger(LOG_LEVEL_ERROR, "Unable to allocate XRecord range. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_X_RECORD_CREATE_CONTEXT:
+      logger(LOG_LEVEL_ERROR, "Unable to allocate XRecord context. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_X_RECORD_ENABLE_CONTEXT:
+      logger(LOG_LEVEL_ERROR, "Failed to enable XRecord context. (%#X)\n", status);
+      break;
+
+
+    // Windows specific errors.
+    case UIOHOOK_ERROR_SET_WINDOWS_HOOK_EX:
+      logger(LOG_LEVEL_ERROR, "Failed to register low level windows hook. (%#X)\n", status);
+      break;
+
+
+    // Darwin specific errors.
+    case UIOHOOK_ERROR_AXAPI_DISABLED:
+      logger(LOG_LEVEL_ERROR, "Failed to enable access for assistive devices. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_CREATE_EVENT_PORT:
+      logger(LOG_LEVEL_ERROR, "Failed to create apple event port. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_CREATE_RUN_LOOP_SOURCE:
+      logger(LOG_LEVEL_ERROR, "Failed to create apple run loop source. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_GET_RUNLOOP:
+      logger(LOG_LEVEL_ERROR, "Failed to acquire apple run loop. (%#X)\n", status);
+      break;
+
+    case UIOHOOK_ERROR_CREATE_OBSERVER:
+      logger(LOG_LEVEL_ERROR, "Failed to create apple run loop observer. (%#X)\n", status);
+      break;
+
+    // Default error.
+    case UIOHOOK_FAILURE:
+    default:
+      logger(LOG_LEVEL_ERROR, "An unknown hook error occurred. (%#X)\n", status);
+      break;
+  }
+
+  if (enabled) {
+    bool stop_requested;
+    {
+      std::lock_guard<std::mutex> lock(sSessionMutex);
+      sHookEnabled = false;
+      stop_requested = sStopSession >= session;
+    }
+
+    if (stop_requested) {
+      sLastStopNs.store(monotonic_ns() - sStopRequestNs.load());
+      sStopCount++;
+    }
+  }
+
+  // The hook thread has been joined, nothing can touch these any more.
+  #ifdef _WIN32
+  CloseHandle(hook_thread);
+  DeleteCriticalSection(&hook_running_mutex);
+  DeleteCriticalSection(&hook_control_mutex);
+  #else
+  pthread_mutex_destroy(&hook_running_mutex);
+  pthread_mutex_destroy(&hook_control_mutex);
+  pthread_cond_destroy(&hook_control_cond);
+  #endif
+
+  return status;
+}
+
+static void stop_hook() {
+  int status = sUseSyntheticSource ? synthetic_stop() : hook_stop();
+  switch (status) {
+    case UIOHOOK_SUCCESS:
+      break;
+
+    // System level errors.
+    case UIOHOOK_ERROR_OUT_OF_MEMORY:
+      logger(LOG_LEVEL_ERROR, "Failed to allocate memory. (%#X)", status);
+      break;
+
+    case UIOHOOK_ERROR_X_RECORD_GET_CONTEXT:
+      // NOTE This is the only platform specific error that occurs on hook_stop().
+      logger(LOG_LEVEL_ERROR, "Failed to get XRecord context. (%#X)", status);
+      break;
+
+    // Default error.
+    case UIOHOOK_FAILURE:
+    default:
+      logger(LOG_LEVEL_ERROR, "An unknown hook error occurred. (%#X)", status);
+      break;
+  }
+}
+
+void iohook_core_request_stop() {
+  bool enabled;
+  {
+    std::lock_guard<std::mutex> lock(sSessionMutex);
+    sStopSession = sHookSession;
+    enabled = sHookEnabled;
+  }
+
+  sSessionCond.notify_all();
+
+  // Not up yet: run() will notice the request once hook_enable() returns.
+  if (enabled) {
+    sStopRequestNs.store(monotonic_ns());
+    stop_hook();
+  }
+}
+
+// Called with sSessionMutex held.
+static bool session_stopped(uint64_t session) {
+  return sStopSession >= session;
+}
+
+// Stops a hook that has not delivered anything for a while although the
+// pointer moved, so that the session loop restarts it.
+static void monitor_thread_proc(uint64_t session, const bool *done) {
+  bool have_cursor = false;
+  int16_t last_x = 0, last_y = 0;
+
+  std::unique_lock<std::mutex> lock(sSessionMutex);
+  for (;;) {
+    watchdog_config config;
+    watchdog_get_config(&config);
+    sSessionCond.wait_for(lock, std::chrono::milliseconds(config.probe_ms), [&] {
+      return *done || session_stopped(session);
+    });
+    if (*done || session_stopped(session)) {
+      break;
+    }
+
+    if (!config.enabled || config.stall_ms == 0 || !sHookEnabled || sUseSyntheticSource) {
+      have_cursor = false;
+      continue;
+    }
+
+    lock.unlock();
+    int16_t x, y;
+    bool probed = watchdog_probe_cursor(&x, &y);
+    bool moved = probed && have_cursor && (x != last_x || y != last_y);
+    have_cursor = probed;
+    last_x = x;
+    last_y = y;
+
+    uint64_t now = monotonic_ns();
+    uint64_t last = std::max(pipeline_last_push_ns(), sHookUpNs.load());
+    bool stalled = moved && now - last >= (uint64_t) config.stall_ms * 1000000;
+    lock.lock();
+
+    if (stalled && sHookEnabled && !session_stopped(session)) {
+      sWatchdogStalls++;
+      sHookDownNs.store(now);
+      iohook_status status = { "stalled", 0, 0, 0, 0, (now - last) / 1e6 };
+      post_status(status);
+
+      lock.unlock();
+      stop_hook();
+      lock.lock();
+      have_cursor = false;
+    }
+  }
+  lock.unlock();
+
+  watchdog_probe_close();
+}
+
+uint64_t iohook_core_new_session() {
+  input_state_reset();
+  sEventTimeBaseSet.store(false);
+  pipeline_start(&process_events, &queue_events);
+
+  std::lock_guard<std::mutex> lock(sSessionMutex);
+  return ++sHookSession;
+}
+
+void iohook_core_run_session(uint64_t session, iohook_wakeup_proc wakeup, void *user_data) {
+  // Wait for a previous session that is still shutting down.
+  std::lock_guard<std::mutex> lock(sLifecycleMutex);
+
+  sWakeupData.store(user_data);
+  sWakeupProc.store(wakeup);
+
+  bool done = false;
+  std::thread monitor(monitor_thread_proc, session, &done);
+
+  // The hook only returns on its own when the backend failed or the monitor
+  // stopped a stalled hook; keep restarting it until the session is stopped.
+  uint32_t attempt = 0;
+  for (;;) {
+    uint64_t started = monotonic_ns();
+    int status = run(session);
+
+    watchdog_config config;
+    watchdog_get_config(&config);
+    std::unique_lock<std::mutex> session_lock(sSessionMutex);
+    if (session_stopped(session)) {
+      break;
+    }
+
+    uint64_t now = monotonic_ns();
+    if (status == UIOHOOK_SUCCESS && now - started >= (uint64_t) WATCHDOG_BACKOFF_RESET_MS * 1000000) {
+      attempt = 0;
+    }
+    attempt++;
+    sWatchdogFailures++;
+    uint64_t down = 0;
+    sHookDownNs.compare_exchange_strong(down, now);
+
+    iohook_status failure = { "down", attempt, status, 0, 0, 0 };
+    post_status(failure);
+    if (!config.enabled) {
+      break;
+    }
+
+    uint32_t delay = watchdog_backoff_ms(attempt);
+    iohook_status restarting = { "restarting", attempt, status, delay, 0, 0 };
+    post_status(restarting);
+    if (sSessionCond.wait_for(session_lock, std::chrono::milliseconds(delay), [&] {
+      return session_stopped(session);
+    })) {
+      break;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> session_lock(sSessionMutex);
+    done = true;
+  }
+  sSessionCond.notify_all();
+  monitor.join();
+
+  sSamplerFlushAll.store(true);
+  pipeline_tick();
+
+  sHookDownNs.store(0);
+  sWatchdogState.store("stopped");
+  sWakeupProc.store(nullptr);
+}
+
+bool iohook_core_start(iohook_wakeup_proc wakeup, void *user_data) {
+  if (sSessionThread.joinable()) {
+    return false;
+  }
+
+  uint64_t session = iohook_core_new_session();
+  sSessionThread = std::thread(iohook_core_run_session, session, wakeup, user_data);
+  return true;
+}
+
+void iohook_core_stop() {
+  iohook_core_request_stop();
+  if (sSessionThread.joinable()) {
+    sSessionThread.join();
+  }
+}
+
+void iohook_core_subscribe(iohook_event_proc proc, void *user_data) {
+  sSubscriberData = user_data;
+  sSubscriber = proc;
+}
+
+size_t iohook_core_pull(uiohook_event *events, size_t max) {
+  sWakeupPending.store(false);
+
+  const packed_event *packed;
+  size_t count = 0;
+  while (count < max && (packed = zqueue.peek()) != nullptr) {
+    unpack_event(*packed, sEventTimeBase.load(std::memory_order_relaxed), &events[count++]);
+
+    packed_event consumed;
+    zqueue.pop(&consumed);
+  }
+  return count;
+}
+
+bool iohook_core_wait(uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> lock(sConsumerMutex);
+  return sConsumerCond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [] {
+    return sWakeupPending.load() || !zqueue.empty() || !sNdjsonQueue.empty();
+  });
+}
+
+SpscRing<packed_event> &iohook_core_queue() {
+  return zqueue;
+}
+
+uint64_t iohook_core_time_base() {
+  return sEventTimeBase.load(std::memory_order_relaxed);
+}
+
+bool iohook_core_begin_drain(uint64_t *wakeup_ns) {
+  if (!sWakeupPending.exchange(false)) {
+    return false;
+  }
+
+  *wakeup_ns = sWakeupNs.load(std::memory_order_relaxed);
+  return true;
+}
+
+void iohook_core_take_statuses(std::vector<iohook_status> *statuses) {
+  std::lock_guard<std::mutex> lock(sStatusMutex);
+  statuses->insert(statuses->end(), sStatuses.begin(), sStatuses.end());
+  sStatuses.clear();
+}
+
+void iohook_core_set_ndjson(bool enabled) {
+  if (enabled) {
+    for (size_t i = 0; i < IOHOOK_NDJSON_SPARE_CHUNKS; i++) {
+      char *data = new char[IOHOOK_NDJSON_CHUNK_SIZE];
+      if (!sNdjsonFree.push(data)) {
+        delete[] data;
+        break;
+      }
+    }
+  }
+  sNdjsonOutput.store(enabled);
+}
+
+bool iohook_core_take_ndjson(iohook_ndjson_chunk *chunk) {
+  return sNdjsonQueue.pop(chunk);
+}
+
+void iohook_core_release_ndjson(char *data) {
+  if (!sNdjsonFree.push(data)) {
+    delete[] data;
+  }
+}
+
+size_t iohook_core_ndjson_pending() {
+  return sNdjsonQueue.size();
+}
+
+void iohook_core_use_synthetic_source(bool enabled) {
+  sUseSyntheticSource = enabled;
+}
+
+void iohook_core_get_stats(iohook_core_stats *stats) {
+  stats->starts = sStartCount.load();
+  stats->stops = sStopCount.load();
+  stats->last_start_ns = sLastStartNs.load();
+  stats->last_stop_ns = sLastStopNs.load();
+
+  stats->queue_capacity = zqueue.capacity();
+  stats->queue_pending = zqueue.size();
+  stats->queue_dropped = sQueueDropCount.load();
+
+  stats->filter_active = sFilter.load() != nullptr;
+  stats->filter_evaluated = sFilterEvaluatedCount.load();
+  stats->filter_rejected = sFilterRejectedCount.load();
+
+  stats->watchdog_state = sWatchdogState.load();
+  stats->restarts = sWatchdogRestarts.load();
+  stats->stalls = sWatchdogStalls.load();
+  stats->failures = sWatchdogFailures.load();
+  stats->last_recovery_ns = sLastRecoveryNs.load();
+}
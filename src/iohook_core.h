@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "uiohook.h"
+#include "event_filter.h"
+#include "event_sampler.h"
+#include "event_ring.h"
+#include "packed_event.h"
+
+// The hook engine, without Node: hook lifecycle and watchdog, the event
+// pipeline (state tracking, filter, samplers, plugins) and the queue events
+// wait in for their consumer.  The Node addon in iohook.cc is a binding on
+// top of it; native programs link the iohook_core library and use it
+// directly.
+//
+//   iohook_core_start(&wakeup, nullptr);
+//   uiohook_event events[256];
+//   while (running) {
+//     iohook_core_wait(100);
+//     size_t count = iohook_core_pull(events, 256);
+//     ...
+//   }
+//   iohook_core_stop();
+//
+// There is one engine per process, and one consumer: either the thread that
+// pulls from the queue or the subscriber set with iohook_core_subscribe().
+
+// Engine threads.  Called when events or statuses become available after the
+// consumer last drained, so a burst costs a single call.  Must not block.
+typedef void (*iohook_wakeup_proc)(void *user_data);
+
+// Pipeline worker thread.  Receives the events that passed the filter,
+// samplers and plugins, in batches.
+typedef void (*iohook_event_proc)(const uiohook_event *events, size_t count, void *user_data);
+
+// Hook health reported by the watchdog, see hook_watchdog.h.  state is one of
+// "down", "restarting", "stalled" and "up".
+struct iohook_status {
+  const char *state;
+  uint32_t attempt;
+  int code;
+  uint32_t delay_ms;
+  double downtime_ms;
+  double idle_ms;
+};
+
+// NDJSON lines (event_json.h) for count events, formatted by the pipeline
+// worker thread.
+#define IOHOOK_NDJSON_CHUNK_SIZE    65536
+
+struct iohook_ndjson_chunk {
+  char *data;
+  size_t length;
+  size_t count;
+};
+
+struct iohook_core_stats {
+  // Lifecycle
+  uint64_t starts;
+  uint64_t stops;
+  uint64_t last_start_ns;
+  uint64_t last_stop_ns;
+
+  // Consumer queue
+  size_t queue_capacity;
+  size_t queue_pending;
+  uint64_t queue_dropped;
+
+  // Filter
+  bool filter_active;
+  uint64_t filter_evaluated;
+  uint64_t filter_rejected;
+
+  // Watchdog
+  const char *watchdog_state;
+  uint64_t restarts;
+  uint64_t stalls;
+  uint64_t failures;
+  uint64_t last_recovery_ns;
+};
+
+// Optional pipeline stages.  The pipeline worker runs a loop compiled for
+// exactly the enabled set, and switches loops when the set changes.
+#define IOHOOK_FEATURE_KEY_STATS    0x01
+#define IOHOOK_FEATURE_HISTORY      0x02
+#define IOHOOK_FEATURE_FILTER       0x04
+#define IOHOOK_FEATURE_SAMPLER      0x08
+#define IOHOOK_FEATURE_ALL          0x0F
+
+// Pipeline worker thread.  Processes a batch of hooked events into out.
+typedef void (*iohook_process_proc)(const uiohook_event *events, size_t count, std::vector<uiohook_event> *out);
+
+// Runs a session on a thread of its own.  Returns false if a session started
+// by iohook_core_start() is still running.
+bool iohook_core_start(iohook_wakeup_proc wakeup, void *user_data);
+
+// Stops the session and waits for its thread.
+void iohook_core_stop();
+
+// Delivers events to proc on the pipeline worker thread instead of queueing
+// them; nullptr goes back to queueing.  Set it before starting the session.
+void iohook_core_subscribe(iohook_event_proc proc, void *user_data);
+
+// Consumer thread.  Moves up to max queued events to events and returns how
+// many were moved.
+size_t iohook_core_pull(uiohook_event *events, size_t max);
+
+// Consumer thread.  Waits until a wakeup is pending; false on timeout.
+bool iohook_core_wait(uint32_t timeout_ms);
+
+// Bindings that run sessions on threads of their own.  A new session resets
+// the tracked input state and starts the pipeline worker; running it blocks
+// until the session is stopped, restarting the hook as the watchdog says.
+// A session waits for the previous one to return before it starts.
+uint64_t iohook_core_new_session();
+void iohook_core_run_session(uint64_t session, iohook_wakeup_proc wakeup, void *user_data);
+
+// Any thread.  Stops the latest session, also if it has not enabled the hook
+// yet.
+void iohook_core_request_stop();
+
+// Consumer thread.  Direct access to the queue, whose event times are
+// relative to iohook_core_time_base().  The base may move whenever the queue
+// is empty, so read it after peeking an event and before popping it.
+// iohook_core_begin_drain() clears the
+// pending wakeup before the queue is drained; it returns false if none was
+// pending, else stores when the wakeup was sent.
+SpscRing<packed_event> &iohook_core_queue();
+uint64_t iohook_core_time_base();
+bool iohook_core_begin_drain(uint64_t *wakeup_ns);
+
+// Consumer thread.  Moves the statuses posted so far to *statuses.
+void iohook_core_take_statuses(std::vector<iohook_status> *statuses);
+
+// Consumer thread.  While enabled, the pipeline worker formats the events it
+// would queue as NDJSON into chunks of at most IOHOOK_NDJSON_CHUNK_SIZE bytes,
+// which the consumer takes instead.  Chunks formatted before it is disabled
+// can still be taken.
+void iohook_core_set_ndjson(bool enabled);
+
+// Consumer thread.  Moves the oldest chunk to *chunk; false if there is none.
+// The chunk data belongs to the caller until it hands it back with
+// iohook_core_release_ndjson(), also from the consumer thread.
+bool iohook_core_take_ndjson(iohook_ndjson_chunk *chunk);
+void iohook_core_release_ndjson(char *data);
+size_t iohook_core_ndjson_pending();
+
+// Any thread.  Wakes the consumer, e.g. when an event source of its own has
+// something.
+void iohook_core_wakeup();
+
+// Replaces the filter, nullptr for none.  The engine takes ownership.
+void iohook_core_set_filter(filter_program *filter);
+
+// Replaces the sampler of an event type, see event_sampler.h.  A sample the
+// previous one held is released without waiting for the next event.
+void iohook_core_set_sampler(uint8_t type, const sampler_config &config);
+
+// Replaces the OS hook with the synthetic source from the next session on.
+void iohook_core_use_synthetic_source(bool enabled);
+
+void iohook_core_get_stats(iohook_core_stats *stats);
+
+// Any thread.  The IOHOOK_FEATURE_* flags that are enabled now.
+uint32_t iohook_core_features();
+
+// Benchmarks only.  The loop compiled for features, which must not be called
+// while a session is running.  Calling one compiled for fewer features than
+// are enabled skips the missing ones.
+iohook_process_proc iohook_core_process_proc(uint32_t features);
@@ -0,0 +1,145 @@
+#ifndef IOHOOK_PLUGIN_H
+#define IOHOOK_PLUGIN_H
+
+/*
+ * iohook native plugin ABI.
+ *
+ * A plugin is a shared library exporting iohook_plugin_register().  Once
+ * loaded with ioHook.loadPlugin(path), it sees every input event on the native
+ * pipeline worker thread, in batches, before JavaScript does, and decides per event
+ * whether it still reaches JavaScript.  Plugins run before the filter and
+ * samplers set up from JavaScript, which only select among the events the
+ * plugins passed.  Plugins never run on the main thread and never touch V8.
+ *
+ * This header is plain C and self-contained; plugins do not need libuiohook
+ * or node headers.  The ABI only changes together with
+ * IOHOOK_PLUGIN_ABI_VERSION, and plugins built for another version are
+ * refused at load time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOHOOK_PLUGIN_ABI_VERSION       1
+
+#if defined(_WIN32)
+#define IOHOOK_PLUGIN_EXPORT            __declspec(dllexport)
+#else
+#define IOHOOK_PLUGIN_EXPORT            __attribute__((visibility("default")))
+#endif
+
+/* Event types, same values as the numeric `type` seen in JavaScript. */
+#define IOHOOK_PLUGIN_EVENT_KEY_TYPED       3
+#define IOHOOK_PLUGIN_EVENT_KEY_PRESSED     4
+#define IOHOOK_PLUGIN_EVENT_KEY_RELEASED    5
+#define IOHOOK_PLUGIN_EVENT_MOUSE_CLICKED   6
+#define IOHOOK_PLUGIN_EVENT_MOUSE_PRESSED   7
+#define IOHOOK_PLUGIN_EVENT_MOUSE_RELEASED  8
+#define IOHOOK_PLUGIN_EVENT_MOUSE_MOVED     9
+#define IOHOOK_PLUGIN_EVENT_MOUSE_DRAGGED   10
+#define IOHOOK_PLUGIN_EVENT_MOUSE_WHEEL     11
+
+/*
+ * An input event.  Key codes are libuiohook virtual key codes (VC_*), mask
+ * bits are libuiohook's MASK_* modifier and button bits, time is in
+ * milliseconds.
+ */
+typedef struct iohook_plugin_event {
+  uint16_t type;
+  uint16_t mask;
+  uint32_t reserved;
+  uint64_t time;
+  union {
+    struct {
+      uint16_t keycode;
+      uint16_t rawcode;
+      uint16_t keychar;
+    } keyboard;
+    struct {
+      uint16_t button;
+      uint16_t clicks;
+      int16_t x;
+      int16_t y;
+    } mouse;
+    struct {
+      int16_t x;
+      int16_t y;
+      int16_t rotation;
+      uint16_t delta;
+      uint8_t type;
+      uint8_t direction;
+    } wheel;
+    uint8_t raw[16];
+  } data;
+} iohook_plugin_event;
+
+/*
+ * Per event verdicts, written by process().  Plugins run in load order and
+ * each one only sees the events all previous plugins passed:
+ *   PASS           no opinion, the next plugin decides; events every plugin
+ *                  passes reach JavaScript
+ *   SUPPRESS       drop the event, neither later plugins nor JavaScript see it
+ *   FORWARD_TO_JS  deliver the event to JavaScript without asking later
+ *                  plugins
+ * Suppression is local to iohook: by the time a plugin runs, the OS has
+ * already delivered the event to other applications.
+ */
+#define IOHOOK_PLUGIN_PASS              0
+#define IOHOOK_PLUGIN_SUPPRESS          1
+#define IOHOOK_PLUGIN_FORWARD_TO_JS     2
+
+/* Services the host offers to plugins, passed to init(). */
+typedef struct iohook_plugin_host {
+  uint32_t abi_version;
+
+  /*
+   * Inject an event into the OS input stream, e.g. to remap keys.  Injected
+   * events are hooked again like any other input, so a remapper has to
+   * recognise and pass its own events.  May be called from any thread.
+   */
+  void (*post_event)(const iohook_plugin_event *event);
+} iohook_plugin_host;
+
+typedef struct iohook_plugin {
+  /* Must be IOHOOK_PLUGIN_ABI_VERSION. */
+  uint32_t abi_version;
+
+  /* Unique name, used to unload the plugin. */
+  const char *name;
+
+  /*
+   * Optional.  Called once by loadPlugin() on the JavaScript thread; a non
+   * zero return value aborts loading.  Whatever is stored in *user_data is
+   * handed to process() and shutdown().
+   */
+  int (*init)(const iohook_plugin_host *host, void **user_data);
+
+  /*
+   * Required.  Called on the worker thread with up to a few hundred events
+   * at a time.  verdicts[i] is IOHOOK_PLUGIN_PASS on entry.  Events may be
+   * modified in place; JavaScript sees the modified events.  Must not block:
+   * while it runs, no event reaches JavaScript.
+   */
+  void (*process)(void *user_data, iohook_plugin_event *events, size_t count, uint8_t *verdicts);
+
+  /* Optional.  Called once by unloadPlugin() after the last process(). */
+  void (*shutdown)(void *user_data);
+} iohook_plugin;
+
+/*
+ * The single symbol a plugin exports.  The returned struct must stay valid
+ * until the library is unloaded.
+ */
+#define IOHOOK_PLUGIN_REGISTER_SYMBOL   "iohook_plugin_register"
+
+typedef const iohook_plugin *(*iohook_plugin_register_proc)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
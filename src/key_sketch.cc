@@ -0,0 +1,357 @@
+#include "key_sketch.h"
+#include "input_state.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#define KEY_SKETCH_MAGIC    0x534B4F49  // "IOKS"
+#define KEY_SKETCH_VERSION  1
+
+struct count_min {
+  uint32_t counts[KEY_SKETCH_DEPTH][KEY_SKETCH_WIDTH];
+};
+
+struct top_k {
+  key_sketch_entry entries[KEY_SKETCH_TOP_K];
+  uint32_t size;
+};
+
+struct sketch_state {
+  uint64_t keystrokes;
+  count_min grams[2];
+  top_k top[3];
+};
+
+// Updated at typing speed by the worker thread, so the lock is never held for
+// long by either side.
+static std::mutex sLock;
+static sketch_state sState;
+static std::atomic<bool> sEnabled(false);
+
+// Worker thread: the keys of the current n-gram run, under sLock.
+static uint16_t sRun[2];
+static size_t sRunLength = 0;
+static uint64_t sRunTime = 0;
+
+static const uint64_t sSeeds[KEY_SKETCH_DEPTH] = {
+  0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+};
+
+static inline uint32_t bucket(uint64_t key, int row) {
+  // splitmix64 finalizer
+  uint64_t z = key ^ sSeeds[row];
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return (uint32_t) (z & (KEY_SKETCH_WIDTH - 1));
+}
+
+static void count_min_add(count_min *sketch, uint64_t key) {
+  for (int row = 0; row < KEY_SKETCH_DEPTH; row++) {
+    uint32_t &count = sketch->counts[row][bucket(key, row)];
+    if (count < UINT32_MAX) {
+      count++;
+    }
+  }
+}
+
+static uint64_t count_min_estimate(const count_min &sketch, uint64_t key) {
+  uint32_t estimate = UINT32_MAX;
+  for (int row = 0; row < KEY_SKETCH_DEPTH; row++) {
+    estimate = std::min(estimate, sketch.counts[row][bucket(key, row)]);
+  }
+  return estimate;
+}
+
+// Space-saving: a key that is not tracked replaces the least counted one and
+// inherits its count as error.
+static void top_k_add(top_k *top, uint64_t key) {
+  key_sketch_entry *min = nullptr;
+  for (uint32_t i = 0; i < top->size; i++) {
+    key_sketch_entry &entry = top->entries[i];
+    if (entry.key == key) {
+      entry.count++;
+      return;
+    }
+    if (min == nullptr || entry.count < min->count) {
+      min = &entry;
+    }
+  }
+
+  if (top->size < KEY_SKETCH_TOP_K) {
+    top->entries[top->size++] = { key, 1, 0 };
+  } else {
+    min->key = key;
+    min->error = min->count;
+    min->count++;
+  }
+}
+
+static uint64_t top_k_min(const top_k &top) {
+  if (top.size < KEY_SKETCH_TOP_K) {
+    return 0;
+  }
+
+  uint64_t min = UINT64_MAX;
+  for (uint32_t i = 0; i < top.size; i++) {
+    min = std::min(min, top.entries[i].count);
+  }
+  return min;
+}
+
+static bool by_count(const key_sketch_entry &a, const key_sketch_entry &b) {
+  return a.count > b.count || (a.count == b.count && a.key < b.key);
+}
+
+// Mergeable summaries: a key missing from a full summary may have been
+// counted up to that summary's minimum, which goes to both count and error.
+static void top_k_merge(top_k *top, const top_k &other) {
+  uint64_t top_min = top_k_min(*top);
+  uint64_t other_min = top_k_min(other);
+
+  std::unordered_map<uint64_t, const key_sketch_entry*> incoming;
+  for (uint32_t i = 0; i < other.size; i++) {
+    incoming[other.entries[i].key] = &other.entries[i];
+  }
+
+  std::vector<key_sketch_entry> merged;
+  merged.reserve(top->size + other.size);
+  for (uint32_t i = 0; i < top->size; i++) {
+    key_sketch_entry entry = top->entries[i];
+    auto found = incoming.find(entry.key);
+    if (found != incoming.end()) {
+      entry.count += found->second->count;
+      entry.error += found->second->error;
+      incoming.erase(found);
+    } else {
+      entry.count += other_min;
+      entry.error += other_min;
+    }
+    merged.push_back(entry);
+  }
+  for (uint32_t i = 0; i < other.size; i++) {
+    if (incoming.count(other.entries[i].key) > 0) {
+      key_sketch_entry entry = other.entries[i];
+      entry.count += top_min;
+      entry.error += top_min;
+      merged.push_back(entry);
+    }
+  }
+
+  std::sort(merged.begin(), merged.end(), by_count);
+  top->size = (uint32_t) std::min(merged.size(), (size_t) KEY_SKETCH_TOP_K);
+  std::copy(merged.begin(), merged.begin() + top->size, top->entries);
+}
+
+static uint16_t chord_modifiers(uint16_t mask) {
+  uint16_t modifiers = 0;
+  if (mask & MASK_CTRL) modifiers |= KEY_SKETCH_CTRL;
+  if (mask & MASK_ALT) modifiers |= KEY_SKETCH_ALT;
+  if (mask & MASK_META) modifiers |= KEY_SKETCH_META;
+  if (mask & MASK_SHIFT) modifiers |= KEY_SKETCH_SHIFT;
+  return modifiers;
+}
+
+void key_sketch_enable(bool enabled) {
+  sEnabled.store(enabled);
+}
+
+bool key_sketch_enabled() {
+  return sEnabled.load();
+}
+
+void key_sketch_record(const uiohook_event &event, bool repeat) {
+  if (!sEnabled.load(std::memory_order_relaxed) || event.type != EVENT_KEY_PRESSED || repeat) {
+    return;
+  }
+
+  uint16_t keycode = event.data.keyboard.keycode;
+  if (keycode == VC_UNDEFINED) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(sLock);
+  sState.keystrokes++;
+
+  // Shift and friends do not interrupt a run: they are part of typing.
+  if (is_modifier_key(keycode)) {
+    return;
+  }
+
+  uint16_t modifiers = chord_modifiers(event.mask);
+  if (modifiers & (KEY_SKETCH_CTRL | KEY_SKETCH_ALT | KEY_SKETCH_META)) {
+    top_k_add(&sState.top[KEY_SKETCH_CHORDS], ((uint64_t) modifiers << 16) | keycode);
+    sRunLength = 0;
+    return;
+  }
+
+  if (sRunLength > 0 && event.time - sRunTime > KEY_SKETCH_NGRAM_GAP_MS) {
+    sRunLength = 0;
+  }
+  sRunTime = event.time;
+
+  if (sRunLength >= 1) {
+    uint64_t bigram = ((uint64_t) sRun[sRunLength - 1] << 16) | keycode;
+    count_min_add(&sState.grams[0], bigram);
+    top_k_add(&sState.top[KEY_SKETCH_BIGRAMS], bigram);
+  }
+  if (sRunLength >= 2) {
+    uint64_t trigram = ((uint64_t) sRun[0] << 32) | ((uint64_t) sRun[1] << 16) | keycode;
+    count_min_add(&sState.grams[1], trigram);
+    top_k_add(&sState.top[KEY_SKETCH_TRIGRAMS], trigram);
+  }
+
+  if (sRunLength == 2) {
+    sRun[0] = sRun[1];
+    sRun[1] = keycode;
+  } else {
+    sRun[sRunLength++] = keycode;
+  }
+}
+
+void key_sketch_top(key_sketch_kind kind, size_t limit, std::vector<key_sketch_entry> *entries) {
+  {
+    std::lock_guard<std::mutex> lock(sLock);
+    const top_k &top = sState.top[kind];
+    entries->assign(top.entries, top.entries + top.size);
+  }
+
+  std::sort(entries->begin(), entries->end(), by_count);
+  if (entries->size() > limit) {
+    entries->resize(limit);
+  }
+}
+
+uint64_t key_sketch_estimate(const uint16_t *keycodes, size_t count) {
+  if (count < 2 || count > 3) {
+    return 0;
+  }
+
+  uint64_t key = 0;
+  for (size_t i = 0; i < count; i++) {
+    key = (key << 16) | keycodes[i];
+  }
+
+  std::lock_guard<std::mutex> lock(sLock);
+  return count_min_estimate(sState.grams[count - 2], key);
+}
+
+uint64_t key_sketch_keystrokes() {
+  std::lock_guard<std::mutex> lock(sLock);
+  return sState.keystrokes;
+}
+
+void key_sketch_reset() {
+  std::lock_guard<std::mutex> lock(sLock);
+  memset(&sState, 0, sizeof(sState));
+  sRunLength = 0;
+}
+
+// Image layout, native byte order:
+//   uint32 magic, version, depth, width, top k
+//   uint64 keystrokes
+//   uint32 counts[depth][width]          bigrams, then trigrams
+//   per top-K summary (bigrams, trigrams, chords):
+//     uint32 size, then size x { uint64 key, count, error }
+static const size_t sHeaderSize = 5 * sizeof(uint32_t) + sizeof(uint64_t);
+
+static void append(std::string *image, const void *data, size_t size) {
+  image->append((const char *) data, size);
+}
+
+void key_sketch_snapshot(std::string *image) {
+  // Copied under the lock, serialized outside of it.
+  sketch_state *copy = new sketch_state;
+  {
+    std::lock_guard<std::mutex> lock(sLock);
+    memcpy(copy, &sState, sizeof(sketch_state));
+  }
+
+  const uint32_t header[5] = { KEY_SKETCH_MAGIC, KEY_SKETCH_VERSION, KEY_SKETCH_DEPTH, KEY_SKETCH_WIDTH, KEY_SKETCH_TOP_K };
+  image->clear();
+  image->reserve(sHeaderSize + sizeof(copy->grams) + sizeof(copy->top));
+  append(image, header, sizeof(header));
+  append(image, &copy->keystrokes, sizeof(copy->keystrokes));
+  append(image, copy->grams, sizeof(copy->grams));
+  for (const top_k &top : copy->top) {
+    append(image, &top.size, sizeof(top.size));
+    append(image, top.entries, top.size * sizeof(key_sketch_entry));
+  }
+
+  delete copy;
+}
+
+bool key_sketch_merge(const char *image, size_t size, std::string *error) {
+  error->clear();
+
+  uint32_t header[5];
+  if (size < sHeaderSize + sizeof(count_min) * 2) {
+    *error = "Key statistics snapshot is truncated";
+    return false;
+  }
+
+  memcpy(header, image, sizeof(header));
+  if (header[0] != KEY_SKETCH_MAGIC) {
+    *error = "Not a key statistics snapshot";
+    return false;
+  }
+  if (header[1] != KEY_SKETCH_VERSION || header[2] != KEY_SKETCH_DEPTH ||
+      header[3] != KEY_SKETCH_WIDTH || header[4] != KEY_SKETCH_TOP_K) {
+    *error = "Key statistics snapshot has an incompatible version or size";
+    return false;
+  }
+
+  sketch_state *incoming = new sketch_state;
+  size_t offset = sizeof(header);
+  memcpy(&incoming->keystrokes, image + offset, sizeof(incoming->keystrokes));
+  offset += sizeof(incoming->keystrokes);
+  memcpy(incoming->grams, image + offset, sizeof(incoming->grams));
+  offset += sizeof(incoming->grams);
+
+  for (top_k &top : incoming->top) {
+    if (size - offset < sizeof(top.size)) {
+      *error = "Key statistics snapshot is truncated";
+      break;
+    }
+    memcpy(&top.size, image + offset, sizeof(top.size));
+    offset += sizeof(top.size);
+
+    if (top.size > KEY_SKETCH_TOP_K || size - offset < top.size * sizeof(key_sketch_entry)) {
+      *error = "Key statistics snapshot is truncated";
+      break;
+    }
+    memcpy(top.entries, image + offset, top.size * sizeof(key_sketch_entry));
+    offset += top.size * sizeof(key_sketch_entry);
+  }
+
+  if (error->empty() && offset != size) {
+    *error = "Key statistics snapshot has trailing data";
+  }
+  if (!error->empty()) {
+    delete incoming;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sLock);
+    sState.keystrokes += incoming->keystrokes;
+    for (int n = 0; n < 2; n++) {
+      for (int row = 0; row < KEY_SKETCH_DEPTH; row++) {
+        for (int column = 0; column < KEY_SKETCH_WIDTH; column++) {
+          uint64_t sum = (uint64_t) sState.grams[n].counts[row][column] + incoming->grams[n].counts[row][column];
+          sState.grams[n].counts[row][column] = (uint32_t) std::min(sum, (uint64_t) UINT32_MAX);
+        }
+      }
+    }
+    for (int kind = 0; kind < 3; kind++) {
+      top_k_merge(&sState.top[kind], incoming->top[kind]);
+    }
+  }
+
+  delete incoming;
+  return true;
+}
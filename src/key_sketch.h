@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "uiohook.h"
+
+// Fixed memory key usage statistics, updated on the pipeline worker thread
+// from key presses (auto-repeat excluded):
+//
+//   n-grams  consecutive non-modifier keys pressed less than
+//            KEY_SKETCH_NGRAM_GAP_MS apart, counted in a count-min sketch
+//            per length (2 and 3), with the most frequent ones tracked by a
+//            space-saving top-K summary
+//   chords   keys pressed with Ctrl, Alt or Meta held, tracked by a
+//            space-saving top-K summary
+//
+// Count-min estimates never undercount and overcount by at most
+// e/KEY_SKETCH_WIDTH of the total with probability 1 - e^-KEY_SKETCH_DEPTH.
+// Top-K counts overcount by at most their error.  Snapshots are a flat
+// binary image that another session can merge in.
+
+#define KEY_SKETCH_DEPTH          4
+#define KEY_SKETCH_WIDTH          4096
+#define KEY_SKETCH_TOP_K          256
+#define KEY_SKETCH_NGRAM_GAP_MS   2000
+
+// Chord modifiers, left and right merged.
+#define KEY_SKETCH_CTRL           (1 << 0)
+#define KEY_SKETCH_ALT            (1 << 1)
+#define KEY_SKETCH_META           (1 << 2)
+#define KEY_SKETCH_SHIFT          (1 << 3)
+
+enum key_sketch_kind {
+  KEY_SKETCH_BIGRAMS,
+  KEY_SKETCH_TRIGRAMS,
+  KEY_SKETCH_CHORDS
+};
+
+// Keys pack 16 bit fields, first key (or the modifiers of a chord) highest.
+struct key_sketch_entry {
+  uint64_t key;
+  uint64_t count;
+  uint64_t error;
+};
+
+// Main thread.  Recording is off by default.
+void key_sketch_enable(bool enabled);
+bool key_sketch_enabled();
+
+// Worker thread.  repeat tells whether the key was already held.
+void key_sketch_record(const uiohook_event &event, bool repeat);
+
+// Main thread.
+void key_sketch_top(key_sketch_kind kind, size_t limit, std::vector<key_sketch_entry> *entries);
+uint64_t key_sketch_estimate(const uint16_t *keycodes, size_t count);
+uint64_t key_sketch_keystrokes();
+void key_sketch_reset();
+
+void key_sketch_snapshot(std::string *image);
+
+// Adds a snapshot to the current statistics.  Returns false and a
+// description of the problem if the image is not a compatible snapshot.
+bool key_sketch_merge(const char *image, size_t size, std::string *error);
@@ -0,0 +1,195 @@
+#include "macro_player.h"
+#include "clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+#include <algorithm>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Never sleep longer than this in one go so that cancellation stays responsive.
+#define MACRO_MAX_SLEEP_NS  50000000ULL
+
+// Sleeps towards absolute monotonic deadlines. The deadline passed to
+// sleep_until() is reached "roughly"; the caller is expected to spin the
+// remaining spin_ns() nanoseconds.
+class DeadlineTimer {
+  public:
+    DeadlineTimer();
+    ~DeadlineTimer();
+
+    void sleep_until(uint64_t deadline_ns);
+
+    uint64_t spin_ns() const { return fSpinNs; }
+
+  private:
+    uint64_t fSpinNs;
+
+    #ifdef _WIN32
+    HANDLE fTimer;
+    #elif defined(__linux__)
+    int fTimerFd;
+    int fPrevSlack;
+    #endif
+};
+
+DeadlineTimer::DeadlineTimer() {
+  #ifdef _WIN32
+  // Prefer the high resolution waitable timer (Windows 10 1803+), otherwise
+  // we are at the mercy of the system tick and must spin for a whole period.
+  fTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  fSpinNs = 1000000ULL;
+  if (fTimer == NULL) {
+    fTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    fSpinNs = 16000000ULL;
+  }
+  #elif defined(__linux__)
+  fTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+  // The default 50us timer slack would eat most of our spin budget.
+  fPrevSlack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+  prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+  fSpinNs = 200000ULL;
+  #else
+  fSpinNs = 1000000ULL;
+  #endif
+}
+
+DeadlineTimer::~DeadlineTimer() {
+  #ifdef _WIN32
+  if (fTimer != NULL) {
+    CloseHandle(fTimer);
+  }
+  #elif defined(__linux__)
+  if (fTimerFd >= 0) {
+    close(fTimerFd);
+  }
+
+  // Leave the calling thread the way we found it.
+  if (fPrevSlack > 0) {
+    prctl(PR_SET_TIMERSLACK, fPrevSlack, 0, 0, 0);
+  }
+  #endif
+}
+
+void DeadlineTimer::sleep_until(uint64_t deadline_ns) {
+  uint64_t now = monotonic_ns();
+  if (deadline_ns <= now) {
+    return;
+  }
+
+  #ifdef _WIN32
+  if (fTimer != NULL) {
+    // Negative due time means relative, in 100ns units.
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG) ((deadline_ns - now) / 100);
+    if (SetWaitableTimer(fTimer, &due, 0, NULL, NULL, FALSE)) {
+      WaitForSingleObject(fTimer, INFINITE);
+      return;
+    }
+  }
+  Sleep((DWORD) ((deadline_ns - now) / 1000000ULL));
+  #elif defined(__linux__)
+  struct timespec target;
+  target.tv_sec = (time_t) (deadline_ns / 1000000000ULL);
+  target.tv_nsec = (long) (deadline_ns % 1000000000ULL);
+
+  if (fTimerFd >= 0) {
+    struct itimerspec spec = { { 0, 0 }, target };
+    if (timerfd_settime(fTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+      // EINTR simply means we wake early; the caller loops on the deadline.
+      uint64_t expirations;
+      ssize_t unused = read(fTimerFd, &expirations, sizeof(expirations));
+      (void) unused;
+      return;
+    }
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL);
+  #else
+  std::this_thread::sleep_for(std::chrono::nanoseconds(deadline_ns - now));
+  #endif
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  size_t index = (size_t) (p * (double) (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void macro_play(const std::vector<macro_step> &steps, const std::atomic<bool> &cancel, macro_stats *stats) {
+  DeadlineTimer timer;
+
+  std::vector<double> errors;
+  errors.reserve(steps.size());
+
+  stats->planned = steps.size();
+  stats->played = 0;
+  stats->cancelled = false;
+
+  uint64_t start = monotonic_ns();
+  for (size_t i = 0; i < steps.size(); i++) {
+    uint64_t deadline = start + steps[i].offset_ns;
+
+    // Coarse phase: sleep in bounded chunks until we are within the spin window.
+    while (!cancel.load(std::memory_order_relaxed)) {
+      uint64_t now = monotonic_ns();
+      if (now + timer.spin_ns() >= deadline) {
+        break;
+      }
+
+      uint64_t wake = deadline - timer.spin_ns();
+      if (wake - now > MACRO_MAX_SLEEP_NS) {
+        wake = now + MACRO_MAX_SLEEP_NS;
+      }
+      timer.sleep_until(wake);
+    }
+
+    if (cancel.load(std::memory_order_relaxed)) {
+      stats->cancelled = true;
+      break;
+    }
+
+    // Fine phase: busy-wait the remainder.
+    uint64_t now = monotonic_ns();
+    while (now < deadline) {
+      now = monotonic_ns();
+    }
+
+    uiohook_event event = steps[i].event;
+    hook_post_event(&event);
+
+    errors.push_back((double) (now - deadline) / 1000.0);
+    stats->played++;
+  }
+
+  stats->duration_ms = (double) (monotonic_ns() - start) / 1000000.0;
+
+  double sum = 0;
+  double max = 0;
+  for (size_t i = 0; i < errors.size(); i++) {
+    sum += errors[i];
+    max = std::max(max, errors[i]);
+  }
+  stats->mean_error_us = errors.empty() ? 0 : sum / (double) errors.size();
+  stats->max_error_us = max;
+
+  std::sort(errors.begin(), errors.end());
+  stats->p50_error_us = percentile(errors, 0.50);
+  stats->p99_error_us = percentile(errors, 0.99);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "uiohook.h"
+
+// A single macro step: the event to inject and when to inject it, relative to
+// the start of playback.
+struct macro_step {
+  uint64_t offset_ns;
+  uiohook_event event;
+};
+
+// Actual-vs-planned timing error of a playback. Errors are measured at the
+// moment hook_post_event() is called and are always >= 0 because the player
+// never fires ahead of a deadline.
+struct macro_stats {
+  size_t planned;
+  size_t played;
+  bool cancelled;
+  double duration_ms;
+  double mean_error_us;
+  double max_error_us;
+  double p50_error_us;
+  double p99_error_us;
+};
+
+// Plays the steps on the calling thread using absolute deadlines. Each
+// deadline is slept towards with a timerfd (or the platform equivalent) and
+// the last stretch is busy-waited for sub-millisecond accuracy.
+// Playback stops early when cancel becomes true.
+void macro_play(const std::vector<macro_step> &steps, const std::atomic<bool> &cancel, macro_stats *stats);
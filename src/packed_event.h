@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "uiohook.h"
+
+// Compact 16 byte representation of a uiohook_event used by every native
+// buffer, so four events fit in a cache line.  The time is stored in
+// milliseconds relative to a time base owned by the buffer (32 bits covers
+// about 49 days); decoding only happens when an event is handed to a consumer.
+//
+// A producer only moves the time base of its buffer while the buffer is
+// drained, and consumers decode an event before popping it, so an event is
+// never decoded against a base it was not packed with.  Bases are moved once
+// offsets pass PACKED_TIME_REBASE_MS, well before they would wrap.  An event
+// older than the base of a buffer that is not drained (the clock stepped
+// back) is stored at the base rather than wrapping around into the future.
+//
+// Payload layout per event type:
+//   keyboard  data[0] = keycode | rawcode << 16     data[1] = keychar
+//   mouse     data[0] = button | clicks << 16       data[1] = x | y << 16
+//   wheel     data[0] = x | y << 16                 data[1] = rotation | delta << 16
+//             aux = type << 4 | direction
+struct packed_event {
+  uint8_t type;
+  uint8_t aux;
+  uint16_t mask;
+  uint32_t time;
+  uint32_t data[2];
+};
+
+static_assert(sizeof(packed_event) == 16, "packed_event must stay 16 bytes");
+
+#define PACKED_TIME_REBASE_MS   (1ULL << 31)
+
+static inline bool packed_time_base_expired(uint64_t time_base, uint64_t time) {
+  return time < time_base || time - time_base >= PACKED_TIME_REBASE_MS;
+}
+
+static inline uint32_t pack_pair(uint16_t lo, uint16_t hi) {
+  return (uint32_t) lo | ((uint32_t) hi << 16);
+}
+
+static inline void pack_event(const uiohook_event &event, uint64_t time_base, packed_event *packed) {
+  packed->type = (uint8_t) event.type;
+  packed->aux = 0;
+  packed->mask = event.mask;
+  packed->time = event.time > time_base ? (uint32_t) (event.time - time_base) : 0;
+
+  switch (event.type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+      packed->data[0] = pack_pair(event.data.keyboard.keycode, event.data.keyboard.rawcode);
+      packed->data[1] = event.data.keyboard.keychar;
+      break;
+
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+      packed->data[0] = pack_pair(event.data.mouse.button, event.data.mouse.clicks);
+      packed->data[1] = pack_pair((uint16_t) event.data.mouse.x, (uint16_t) event.data.mouse.y);
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      packed->aux = (uint8_t) ((event.data.wheel.type << 4) | (event.data.wheel.direction & 0x0F));
+      packed->data[0] = pack_pair((uint16_t) event.data.wheel.x, (uint16_t) event.data.wheel.y);
+      packed->data[1] = pack_pair((uint16_t) event.data.wheel.rotation, event.data.wheel.delta);
+      break;
+
+    default:
+      packed->data[0] = 0;
+      packed->data[1] = 0;
+      break;
+  }
+}
+
+static inline void unpack_event(const packed_event &packed, uint64_t time_base, uiohook_event *event) {
+  memset(event, 0, sizeof(uiohook_event));
+  event->type = (event_type) packed.type;
+  event->mask = packed.mask;
+  event->time = time_base + packed.time;
+
+  switch (packed.type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+      event->data.keyboard.keycode = (uint16_t) packed.data[0];
+      event->data.keyboard.rawcode = (uint16_t) (packed.data[0] >> 16);
+      event->data.keyboard.keychar = (uint16_t) packed.data[1];
+      break;
+
+    case EVENT_MOUSE_CLICKED:
+    case EVENT_MOUSE_PRESSED:
+    case EVENT_MOUSE_RELEASED:
+    case EVENT_MOUSE_MOVED:
+    case EVENT_MOUSE_DRAGGED:
+      event->data.mouse.button = (uint16_t) packed.data[0];
+      event->data.mouse.clicks = (uint16_t) (packed.data[0] >> 16);
+      event->data.mouse.x = (int16_t) (uint16_t) packed.data[1];
+      event->data.mouse.y = (int16_t) (uint16_t) (packed.data[1] >> 16);
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      event->data.wheel.type = (uint8_t) (packed.aux >> 4);
+      event->data.wheel.direction = (uint8_t) (packed.aux & 0x0F);
+      event->data.wheel.x = (int16_t) (uint16_t) packed.data[0];
+      event->data.wheel.y = (int16_t) (uint16_t) (packed.data[0] >> 16);
+      event->data.wheel.rotation = (int16_t) (uint16_t) packed.data[1];
+      event->data.wheel.delta = (uint16_t) (packed.data[1] >> 16);
+      break;
+  }
+}
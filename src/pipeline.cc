@@ -0,0 +1,226 @@
+#include "pipeline.h"
+#include "clock.h"
+#include "event_ring.h"
+#include "packed_event.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <thread>
+
+struct staged_event {
+  packed_event event;
+  uint64_t queued_ns;
+};
+
+static SpscRing<staged_event> sQueue(PIPELINE_QUEUE_CAPACITY);
+
+// Only moved by the hook thread while the queue is drained, see
+// packed_event.h.
+static std::atomic<uint64_t> sTimeBase(0);
+static bool sTimeBaseSet = false;
+
+static pipeline_process_proc sProcess = nullptr;
+static pipeline_forward_proc sForward = nullptr;
+
+static std::atomic<uint64_t> sQueuedCount(0);
+static std::atomic<uint64_t> sDropCount(0);
+static std::atomic<uint64_t> sBatchCount(0);
+static std::atomic<uint64_t> sLastPushNs(0);
+static latency_counter sQueueLatency;
+static latency_counter sProcessLatency;
+
+// Only the first event of a burst signals the worker thread, as for the main
+// thread wakeup.  The signal is an auto-reset event or a pipe, so that the
+// hook thread never takes a lock the worker thread may hold: setting the flag
+// before signalling and checking it before waiting is enough for the wakeup
+// not to be lost.
+static std::atomic<bool> sPending(false);
+static std::atomic<bool> sTickRequested(false);
+static std::atomic<bool> sStopRequested(false);
+#ifdef _WIN32
+static HANDLE sWakeup = NULL;
+#else
+static int sWakeupPipe[2] = { -1, -1 };
+#endif
+
+// Worker thread: monotonic_ns() of the tick set by pipeline_schedule_tick(),
+// 0 for none.
+static uint64_t sTickNs = 0;
+
+// Any thread.  Never blocks.
+static void signal_worker() {
+  #ifdef _WIN32
+  SetEvent(sWakeup);
+  #else
+  char wakeup = 0;
+  ssize_t unused = write(sWakeupPipe[1], &wakeup, 1);
+  (void) unused;
+  #endif
+}
+
+// Worker thread.  Returns false if timeout_ms (-1 for none) passed without a
+// signal.
+static bool wait_for_signal(int timeout_ms) {
+  #ifdef _WIN32
+  return WaitForSingleObject(sWakeup, timeout_ms < 0 ? INFINITE : (DWORD) timeout_ms) == WAIT_OBJECT_0;
+  #else
+  struct pollfd fd = { sWakeupPipe[0], POLLIN, 0 };
+  int ready = poll(&fd, 1, timeout_ms);
+  if (ready <= 0) {
+    return ready < 0 && errno == EINTR;
+  }
+
+  char drained[64];
+  while (read(sWakeupPipe[0], drained, sizeof(drained)) > 0) {
+  }
+  return true;
+  #endif
+}
+
+// Declared after everything the worker thread uses, so that at exit it is
+// stopped and joined before any of that is destroyed.
+static struct worker_thread {
+  std::thread thread;
+
+  ~worker_thread() {
+    if (thread.joinable()) {
+      sStopRequested.store(true);
+      signal_worker();
+      thread.join();
+    }
+  }
+} sWorker;
+
+// Returns when there are events, a tick is due or the worker is stopped.
+static void wait_for_work() {
+  while (!sPending.load() && !sTickRequested.load() && !sStopRequested.load()) {
+    int timeout_ms = -1;
+    if (sTickNs != 0) {
+      uint64_t now = monotonic_ns();
+      if (now >= sTickNs) {
+        return;
+      }
+      timeout_ms = (int) ((sTickNs - now + 999999) / 1000000);
+    }
+
+    if (!wait_for_signal(timeout_ms) && timeout_ms >= 0) {
+      return;
+    }
+  }
+}
+
+static void worker_thread_proc() {
+  uiohook_event events[PIPELINE_BATCH_SIZE];
+  std::vector<uiohook_event> out;
+  out.reserve(PIPELINE_BATCH_SIZE);
+
+  while (!sStopRequested.load()) {
+    wait_for_work();
+    sPending.store(false);
+
+    bool tick = sTickRequested.exchange(false) || (sTickNs != 0 && monotonic_ns() >= sTickNs);
+    if (tick) {
+      sTickNs = 0;
+    }
+
+    for (;;) {
+      uint64_t start = monotonic_ns();
+      size_t count = 0;
+      const staged_event *staged;
+      while (count < PIPELINE_BATCH_SIZE && (staged = sQueue.peek()) != nullptr) {
+        unpack_event(staged->event, sTimeBase.load(std::memory_order_relaxed), &events[count++]);
+        sQueueLatency.add(start > staged->queued_ns ? start - staged->queued_ns : 0);
+
+        staged_event consumed;
+        sQueue.pop(&consumed);
+      }
+
+      if (count == 0 && !tick) {
+        break;
+      }
+      tick = false;
+
+      out.clear();
+      sProcess(events, count, &out);
+      sForward(out.data(), out.size());
+      if (count == 0) {
+        break;
+      }
+
+      sBatchCount.fetch_add(1, std::memory_order_relaxed);
+      sProcessLatency.add(monotonic_ns() - start, count);
+    }
+  }
+}
+
+void pipeline_start(pipeline_process_proc process, pipeline_forward_proc forward) {
+  if (sWorker.thread.joinable()) {
+    return;
+  }
+
+  #ifdef _WIN32
+  sWakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+  #else
+  if (pipe(sWakeupPipe) == 0) {
+    fcntl(sWakeupPipe[0], F_SETFL, fcntl(sWakeupPipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(sWakeupPipe[1], F_SETFL, fcntl(sWakeupPipe[1], F_GETFL) | O_NONBLOCK);
+  }
+  #endif
+
+  sProcess = process;
+  sForward = forward;
+  sWorker.thread = std::thread(worker_thread_proc);
+}
+
+bool pipeline_push(const uiohook_event &event) {
+  uint64_t time_base = sTimeBase.load(std::memory_order_relaxed);
+  if ((!sTimeBaseSet || packed_time_base_expired(time_base, event.time)) && sQueue.drained()) {
+    time_base = event.time;
+    sTimeBase.store(time_base, std::memory_order_relaxed);
+    sTimeBaseSet = true;
+  }
+
+  staged_event staged;
+  pack_event(event, time_base, &staged.event);
+  staged.queued_ns = monotonic_ns();
+  sLastPushNs.store(staged.queued_ns, std::memory_order_relaxed);
+  if (!sQueue.push(staged)) {
+    sDropCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  sQueuedCount.store(sQueuedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  if (!sPending.exchange(true)) {
+    signal_worker();
+  }
+  return true;
+}
+
+void pipeline_tick() {
+  sTickRequested.store(true);
+  signal_worker();
+}
+
+void pipeline_schedule_tick(uint64_t delay_ms) {
+  sTickNs = monotonic_ns() + delay_ms * 1000000;
+}
+
+void pipeline_get_stats(pipeline_stats *stats) {
+  stats->queued = sQueuedCount.load();
+  stats->dropped = sDropCount.load();
+  stats->batches = sBatchCount.load();
+  stats->pending = sQueue.size();
+  stats->queue = &sQueueLatency;
+  stats->process = &sProcessLatency;
+}
+
+uint64_t pipeline_last_push_ns() {
+  return sLastPushNs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "uiohook.h"
+
+// Three stage event pipeline:
+//
+//   hook thread     timestamps each event and pushes it into a ring
+//   worker thread   runs the process procedure over batches of events
+//                   (filtering, sampling, state tracking, plugins...) and
+//                   hands what it produced to the forward procedure
+//   main thread     delivers the forwarded events to JavaScript
+//
+// so that the hook thread, which the OS may disable when it is slow, never
+// does more than a clock read and a few stores per event, plus a write that
+// cannot block for the first event of a burst; it never takes a lock.  The
+// worker thread is started once and runs until the process exits.
+
+#define PIPELINE_QUEUE_CAPACITY   32768
+#define PIPELINE_BATCH_SIZE       256
+
+// Appends the events that go on to JavaScript to *out, which the worker
+// clears between batches.  Ticks (see pipeline_tick()) run it with no
+// events, for stages that release events by time.
+typedef void (*pipeline_process_proc)(const uiohook_event *events, size_t count, std::vector<uiohook_event> *out);
+typedef void (*pipeline_forward_proc)(uiohook_event * const events, size_t count);
+
+// Latency of one stage, updated by a single thread.
+struct latency_counter {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_ns;
+  std::atomic<uint64_t> max_ns;
+
+  latency_counter() : count(0), total_ns(0), max_ns(0) {
+  }
+
+  void add(uint64_t ns, uint64_t events = 1) {
+    count.store(count.load(std::memory_order_relaxed) + events, std::memory_order_relaxed);
+    total_ns.store(total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > max_ns.load(std::memory_order_relaxed)) {
+      max_ns.store(ns, std::memory_order_relaxed);
+    }
+  }
+};
+
+struct pipeline_stats {
+  uint64_t queued;
+  uint64_t dropped;
+  uint64_t batches;
+  size_t pending;
+
+  // Time events waited in the ring (per event) and time the worker spent
+  // processing and forwarding (per batch, counted per event).
+  const latency_counter *queue;
+  const latency_counter *process;
+};
+
+// Main thread.  Starts the worker thread if it is not running yet.
+void pipeline_start(pipeline_process_proc process, pipeline_forward_proc forward);
+
+// Hook thread.  Returns false and drops the event when the worker thread is
+// too far behind.
+bool pipeline_push(const uiohook_event &event);
+
+// Any thread.  Runs the process procedure once as soon as possible, even if
+// no event arrives.
+void pipeline_tick();
+
+// Worker thread.  Runs the process procedure once delay_ms from now, even if
+// no event arrives; replaces an earlier request.
+void pipeline_schedule_tick(uint64_t delay_ms);
+
+void pipeline_get_stats(pipeline_stats *stats);
+
+// Any thread.  monotonic_ns() of the most recent push, 0 if none.
+uint64_t pipeline_last_push_ns();
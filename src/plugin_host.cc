@@ -0,0 +1,307 @@
+#include "plugin_host.h"
+#include "iohook_plugin.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// How many events the plugins see at a time.
+#define PLUGIN_BATCH_SIZE       256
+
+#ifdef _WIN32
+typedef HMODULE library_handle;
+#else
+typedef void *library_handle;
+#endif
+
+struct loaded_plugin {
+  library_handle library;
+  const iohook_plugin *plugin;
+  void *user_data;
+  std::string name;
+};
+
+// Loaded plugins in load order.  Held by the worker thread for the duration
+// of a batch, so unloading waits for the plugin to return.
+static std::mutex sPluginsMutex;
+static std::vector<loaded_plugin> sPlugins;
+
+static std::atomic<size_t> sLoadedCount(0);
+
+static std::atomic<uint64_t> sBatchCount(0);
+static std::atomic<uint64_t> sProcessedCount(0);
+static std::atomic<uint64_t> sSuppressedCount(0);
+static std::atomic<uint64_t> sForwardedCount(0);
+
+static void to_plugin_event(const uiohook_event &event, iohook_plugin_event *out) {
+  memset(out, 0, sizeof(iohook_plugin_event));
+  out->type = (uint16_t) event.type;
+  out->mask = event.mask;
+  out->time = event.time;
+
+  switch (event.type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+      out->data.keyboard.keycode = event.data.keyboard.keycode;
+      out->data.keyboard.rawcode = event.data.keyboard.rawcode;
+      out->data.keyboard.keychar = event.data.keyboard.keychar;
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      out->data.wheel.x = event.data.wheel.x;
+      out->data.wheel.y = event.data.wheel.y;
+      out->data.wheel.rotation = event.data.wheel.rotation;
+      out->data.wheel.delta = event.data.wheel.delta;
+      out->data.wheel.type = event.data.wheel.type;
+      out->data.wheel.direction = event.data.wheel.direction;
+      break;
+
+    default:
+      out->data.mouse.button = event.data.mouse.button;
+      out->data.mouse.clicks = event.data.mouse.clicks;
+      out->data.mouse.x = event.data.mouse.x;
+      out->data.mouse.y = event.data.mouse.y;
+      break;
+  }
+}
+
+static void from_plugin_event(const iohook_plugin_event &event, uiohook_event *out) {
+  memset(out, 0, sizeof(uiohook_event));
+  out->type = (event_type) event.type;
+  out->mask = event.mask;
+  out->time = event.time;
+
+  switch (event.type) {
+    case EVENT_KEY_TYPED:
+    case EVENT_KEY_PRESSED:
+    case EVENT_KEY_RELEASED:
+      out->data.keyboard.keycode = event.data.keyboard.keycode;
+      out->data.keyboard.rawcode = event.data.keyboard.rawcode;
+      out->data.keyboard.keychar = event.data.keyboard.keychar;
+      break;
+
+    case EVENT_MOUSE_WHEEL:
+      out->data.wheel.x = event.data.wheel.x;
+      out->data.wheel.y = event.data.wheel.y;
+      out->data.wheel.rotation = event.data.wheel.rotation;
+      out->data.wheel.delta = event.data.wheel.delta;
+      out->data.wheel.type = event.data.wheel.type;
+      out->data.wheel.direction = event.data.wheel.direction;
+      break;
+
+    default:
+      out->data.mouse.button = event.data.mouse.button;
+      out->data.mouse.clicks = event.data.mouse.clicks;
+      out->data.mouse.x = event.data.mouse.x;
+      out->data.mouse.y = event.data.mouse.y;
+      break;
+  }
+}
+
+static void host_post_event(const iohook_plugin_event *event) {
+  uiohook_event posted;
+  from_plugin_event(*event, &posted);
+  hook_post_event(&posted);
+}
+
+static const iohook_plugin_host sHost = {
+  IOHOOK_PLUGIN_ABI_VERSION,
+  &host_post_event
+};
+
+// Runs the plugins over one batch.  Each plugin is handed the events still
+// undecided, packed together; verdict[i] ends up holding the decision for
+// events[i].
+static void process_batch(iohook_plugin_event *events, size_t count, uint8_t *verdict) {
+  iohook_plugin_event work[PLUGIN_BATCH_SIZE];
+  uint8_t work_verdict[PLUGIN_BATCH_SIZE];
+  size_t index[PLUGIN_BATCH_SIZE];
+
+  memset(verdict, IOHOOK_PLUGIN_PASS, count);
+
+  std::lock_guard<std::mutex> lock(sPluginsMutex);
+  for (const loaded_plugin &loaded : sPlugins) {
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (verdict[i] == IOHOOK_PLUGIN_PASS) {
+        work[pending] = events[i];
+        index[pending] = i;
+        pending++;
+      }
+    }
+
+    if (pending == 0) {
+      break;
+    }
+
+    memset(work_verdict, IOHOOK_PLUGIN_PASS, pending);
+    loaded.plugin->process(loaded.user_data, work, pending, work_verdict);
+
+    for (size_t j = 0; j < pending; j++) {
+      events[index[j]] = work[j];
+      verdict[index[j]] = work_verdict[j];
+    }
+  }
+}
+
+size_t plugin_process(uiohook_event *events, size_t count) {
+  iohook_plugin_event batch[PLUGIN_BATCH_SIZE];
+  uint8_t verdict[PLUGIN_BATCH_SIZE];
+
+  size_t survivors = 0;
+  for (size_t done = 0; done < count; ) {
+    size_t chunk = count - done < PLUGIN_BATCH_SIZE ? count - done : PLUGIN_BATCH_SIZE;
+    for (size_t i = 0; i < chunk; i++) {
+      to_plugin_event(events[done + i], &batch[i]);
+    }
+
+    process_batch(batch, chunk, verdict);
+
+    uint64_t forwarded = 0;
+    for (size_t i = 0; i < chunk; i++) {
+      if (verdict[i] == IOHOOK_PLUGIN_SUPPRESS) {
+        continue;
+      }
+      if (verdict[i] == IOHOOK_PLUGIN_FORWARD_TO_JS) {
+        forwarded++;
+      }
+      // survivors never overtakes done + i, so this only overwrites events
+      // already converted.
+      from_plugin_event(batch[i], &events[survivors++]);
+    }
+
+    sBatchCount.fetch_add(1, std::memory_order_relaxed);
+    sProcessedCount.fetch_add(chunk, std::memory_order_relaxed);
+    sForwardedCount.fetch_add(forwarded, std::memory_order_relaxed);
+    done += chunk;
+  }
+
+  sSuppressedCount.fetch_add(count - survivors, std::memory_order_relaxed);
+  return survivors;
+}
+
+static library_handle open_library(const char *path, std::string *error) {
+  #ifdef _WIN32
+  HMODULE library = LoadLibraryA(path);
+  if (library == NULL) {
+    *error = "Could not load " + std::string(path) + " (error " + std::to_string(GetLastError()) + ")";
+  }
+  #else
+  void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (library == NULL) {
+    *error = dlerror();
+  }
+  #endif
+  return library;
+}
+
+static void *find_symbol(library_handle library, const char *symbol) {
+  #ifdef _WIN32
+  return (void *) GetProcAddress(library, symbol);
+  #else
+  return dlsym(library, symbol);
+  #endif
+}
+
+static void close_library(library_handle library) {
+  #ifdef _WIN32
+  FreeLibrary(library);
+  #else
+  dlclose(library);
+  #endif
+}
+
+bool plugin_load(const char *path, std::string *name, std::string *error) {
+  error->clear();
+
+  library_handle library = open_library(path, error);
+  if (library == NULL) {
+    return false;
+  }
+
+  iohook_plugin_register_proc register_proc =
+      (iohook_plugin_register_proc) find_symbol(library, IOHOOK_PLUGIN_REGISTER_SYMBOL);
+  const iohook_plugin *plugin = register_proc != NULL ? register_proc() : NULL;
+
+  if (plugin == NULL) {
+    *error = std::string(path) + " is not an iohook plugin";
+  } else if (plugin->abi_version != IOHOOK_PLUGIN_ABI_VERSION) {
+    *error = std::string(path) + " was built for plugin ABI version " + std::to_string(plugin->abi_version) +
+        ", expected " + std::to_string(IOHOOK_PLUGIN_ABI_VERSION);
+  } else if (plugin->name == NULL || plugin->process == NULL) {
+    *error = std::string(path) + " does not define a name and a process function";
+  } else {
+    std::lock_guard<std::mutex> lock(sPluginsMutex);
+    for (const loaded_plugin &loaded : sPlugins) {
+      if (loaded.name == plugin->name) {
+        *error = "A plugin named " + loaded.name + " is already loaded";
+        break;
+      }
+    }
+  }
+
+  if (!error->empty()) {
+    close_library(library);
+    return false;
+  }
+
+  void *user_data = NULL;
+  if (plugin->init != NULL && plugin->init(&sHost, &user_data) != 0) {
+    *error = std::string(plugin->name) + " failed to initialize";
+    close_library(library);
+    return false;
+  }
+
+  *name = plugin->name;
+  {
+    std::lock_guard<std::mutex> lock(sPluginsMutex);
+    sPlugins.push_back({ library, plugin, user_data, *name });
+    sLoadedCount.store(sPlugins.size());
+  }
+
+  return true;
+}
+
+bool plugin_unload(const std::string &name) {
+  loaded_plugin unloaded;
+  {
+    std::lock_guard<std::mutex> lock(sPluginsMutex);
+    auto it = sPlugins.begin();
+    while (it != sPlugins.end() && it->name != name) {
+      ++it;
+    }
+    if (it == sPlugins.end()) {
+      return false;
+    }
+
+    unloaded = *it;
+    sPlugins.erase(it);
+    sLoadedCount.store(sPlugins.size());
+  }
+
+  if (unloaded.plugin->shutdown != NULL) {
+    unloaded.plugin->shutdown(unloaded.user_data);
+  }
+  close_library(unloaded.library);
+  return true;
+}
+
+bool plugin_host_active() {
+  return sLoadedCount.load(std::memory_order_relaxed) > 0;
+}
+
+void plugin_host_get_stats(plugin_host_stats *stats) {
+  stats->loaded = sLoadedCount.load();
+  stats->batches = sBatchCount.load();
+  stats->processed = sProcessedCount.load();
+  stats->suppressed = sSuppressedCount.load();
+  stats->forwarded = sForwardedCount.load();
+}
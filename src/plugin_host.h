@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "uiohook.h"
+
+// Loads native plugins (see iohook_plugin.h) and runs them over the events
+// of the pipeline worker thread (see pipeline.h), in load order.
+
+struct plugin_host_stats {
+  uint64_t loaded;
+  uint64_t batches;
+  uint64_t processed;
+  uint64_t suppressed;
+  uint64_t forwarded;
+};
+
+// Main thread.  On success returns true and the plugin name, otherwise false
+// and a description of the problem.
+bool plugin_load(const char *path, std::string *name, std::string *error);
+
+// Main thread.  Returns false if no plugin of that name is loaded.
+bool plugin_unload(const std::string &name);
+
+// Whether any plugin is loaded.
+bool plugin_host_active();
+
+// Worker thread.  Runs the plugins over the events and removes the ones they
+// suppress, keeping the others in order; returns how many are left.
+size_t plugin_process(uiohook_event *events, size_t count);
+
+void plugin_host_get_stats(plugin_host_stats *stats);
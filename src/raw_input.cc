@@ -0,0 +1,331 @@
+#include "raw_input.h"
+#include "event_ring.h"
+#include "x11_guard.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#endif
+
+#define RAW_INPUT_QUEUE_CAPACITY    16384
+#define RAW_INPUT_BATCH_SIZE        256
+
+static SpscRing<packed_event> sQueue(RAW_INPUT_QUEUE_CAPACITY);
+static std::atomic<uint64_t> sDropCount(0);
+
+// Only written by the raw input thread before its first push.
+static uint64_t sTimeBase = 0;
+static bool sTimeBaseSet = false;
+
+// Raw input thread: X server times are 32 bit milliseconds of the server
+// clock; sServerTime extends them to the wall clock time of the first event.
+static uint64_t sServerTime = 0;
+static uint32_t sLastServerTime = 0;
+
+static std::atomic<bool> sRunning(false);
+
+// Set by the raw input thread when it lost its X connection and ended.
+static std::atomic<bool> sLost(false);
+
+bool raw_input_pop(packed_event *event) {
+  return sQueue.pop(event);
+}
+
+size_t raw_input_pending() {
+  return sQueue.size();
+}
+
+uint64_t raw_input_time_base() {
+  return sTimeBase;
+}
+
+uint64_t raw_input_dropped() {
+  return sDropCount.load();
+}
+
+bool raw_input_running() {
+  return sRunning.load() && !sLost.load();
+}
+
+#if defined(__linux__)
+
+static Display *sDisplay = nullptr;
+static int sOpcode = 0;
+static int sStopPipe[2] = { -1, -1 };
+static raw_input_notify_proc sNotify = nullptr;
+
+// Joins the thread at exit if raw input was never stopped.
+static struct raw_input_thread {
+  std::thread thread;
+
+  ~raw_input_thread() {
+    raw_input_stop();
+  }
+} sThread;
+
+static uint64_t wall_time_ms() {
+  return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t to_fixed(double value) {
+  double fixed = round(value * 65536.0);
+  fixed = fixed < INT32_MIN ? INT32_MIN : (fixed > INT32_MAX ? INT32_MAX : fixed);
+  return (uint32_t) (int32_t) fixed;
+}
+
+// Translates one XI2 raw event, returns false for events without a payload
+// we report (e.g. motion along scroll valuators only).
+static bool translate(int evtype, const XIRawEvent *raw, packed_event *packed) {
+  packed->aux = 0;
+  packed->mask = (uint16_t) raw->sourceid;
+  packed->data[0] = 0;
+  packed->data[1] = 0;
+
+  switch (evtype) {
+    case XI_RawMotion: {
+      // raw_values holds one value per set bit of the valuator mask; axes 0
+      // and 1 are x and y.
+      bool moved = false;
+      const double *value = raw->raw_values;
+      for (int axis = 0; axis < 2 && axis < raw->valuators.mask_len * 8; axis++) {
+        if (XIMaskIsSet(raw->valuators.mask, axis)) {
+          packed->data[axis] = to_fixed(*value++);
+          moved = true;
+        }
+      }
+      packed->type = EVENT_RAW_MOTION;
+      return moved;
+    }
+
+    case XI_RawKeyPress:
+      packed->type = EVENT_RAW_KEY_PRESSED;
+      break;
+
+    case XI_RawKeyRelease:
+      packed->type = EVENT_RAW_KEY_RELEASED;
+      break;
+
+    case XI_RawButtonPress:
+      packed->type = EVENT_RAW_BUTTON_PRESSED;
+      break;
+
+    case XI_RawButtonRelease:
+      packed->type = EVENT_RAW_BUTTON_RELEASED;
+      break;
+
+    default:
+      return false;
+  }
+
+  packed->data[0] = (uint32_t) raw->detail;
+  return true;
+}
+
+struct raw_batch {
+  packed_event events[RAW_INPUT_BATCH_SIZE];
+  size_t count;
+};
+
+// Translates what the server has sent so far, up to a full batch.
+static void read_batch(void *user_data) {
+  raw_batch *batch = (raw_batch *) user_data;
+  size_t &count = batch->count;
+  packed_event *events = batch->events;
+
+  count = 0;
+  while (XPending(sDisplay) > 0) {
+    XEvent event;
+    XNextEvent(sDisplay, &event);
+
+    XGenericEventCookie *cookie = &event.xcookie;
+    if (cookie->type != GenericEvent || cookie->extension != sOpcode || !XGetEventData(sDisplay, cookie)) {
+      continue;
+    }
+
+    const XIRawEvent *raw = (const XIRawEvent *) cookie->data;
+    if (!sTimeBaseSet) {
+      sTimeBase = wall_time_ms();
+      sTimeBaseSet = true;
+      sServerTime = sTimeBase;
+      sLastServerTime = (uint32_t) raw->time;
+    }
+
+    // Events of a batch were read at once; their own times tell them apart.
+    // The difference wraps with the server clock, and never goes back.
+    uint32_t elapsed = (uint32_t) raw->time - sLastServerTime;
+    if ((int32_t) elapsed > 0) {
+      sServerTime += elapsed;
+      sLastServerTime = (uint32_t) raw->time;
+    }
+
+    if (translate(cookie->evtype, raw, &events[count])) {
+      events[count].time = (uint32_t) (sServerTime - sTimeBase);
+      count++;
+    }
+    XFreeEventData(sDisplay, cookie);
+
+    if (count == RAW_INPUT_BATCH_SIZE) {
+      break;
+    }
+  }
+}
+
+static void close_display(void *user_data) {
+  XCloseDisplay((Display *) user_data);
+}
+
+// Reads everything the server has sent so far and publishes it in batches,
+// then sleeps until more arrives or raw_input_stop() is called.  Ends early
+// if the X connection fails.
+static void raw_input_thread_proc() {
+  struct pollfd fds[2] = {
+    { ConnectionNumber(sDisplay), POLLIN, 0 },
+    { sStopPipe[0], POLLIN, 0 }
+  };
+
+  raw_batch batch;
+  for (;;) {
+    if (!x11_guarded(&read_batch, &batch)) {
+      sLost.store(true);
+      sNotify();
+      break;
+    }
+
+    if (batch.count > 0) {
+      size_t queued = sQueue.push(batch.events, batch.count);
+      if (queued < batch.count) {
+        sDropCount.fetch_add(batch.count - queued, std::memory_order_relaxed);
+      }
+      sNotify();
+      continue;
+    }
+
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+  }
+}
+
+struct raw_setup {
+  Display *display;
+  const char *error;
+};
+
+static void setup_display(void *user_data) {
+  raw_setup *setup = (raw_setup *) user_data;
+  Display *display = setup->display;
+
+  // Servers only send raw events to the root window while another client
+  // grabs the device, as games and drawing tools do, to XInput 2.1 clients.
+  int event, first_error;
+  int major = 2, minor = 2;
+  if (!XQueryExtension(display, "XInputExtension", &sOpcode, &event, &first_error)) {
+    setup->error = "The X server does not support the XInput extension";
+    return;
+  } else if (XIQueryVersion(display, &major, &minor) != Success) {
+    setup->error = "The X server does not support XInput 2";
+    return;
+  } else if (major == 2 && minor < 1) {
+    setup->error = "The X server only supports XInput 2.0, raw input needs XInput 2.1";
+    return;
+  }
+
+  unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = { 0 };
+  XISetMask(mask_bits, XI_RawMotion);
+  XISetMask(mask_bits, XI_RawKeyPress);
+  XISetMask(mask_bits, XI_RawKeyRelease);
+  XISetMask(mask_bits, XI_RawButtonPress);
+  XISetMask(mask_bits, XI_RawButtonRelease);
+
+  XIEventMask mask;
+  mask.deviceid = XIAllMasterDevices;
+  mask.mask_len = sizeof(mask_bits);
+  mask.mask = mask_bits;
+  XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+  XFlush(display);
+}
+
+bool raw_input_start(raw_input_notify_proc notify, std::string *error) {
+  error->clear();
+  if (sRunning.load()) {
+    if (!sLost.load()) {
+      return true;
+    }
+    raw_input_stop();
+  }
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    *error = "Unable to open the X display";
+    return false;
+  }
+
+  raw_setup setup = { display, nullptr };
+  if (!x11_guarded(&setup_display, &setup)) {
+    *error = "Lost the connection to the X server";
+    return false;
+  }
+  if (setup.error == nullptr && pipe(sStopPipe) != 0) {
+    setup.error = "Unable to create the raw input stop pipe";
+  }
+
+  if (setup.error != nullptr) {
+    *error = setup.error;
+    x11_guarded(&close_display, display);
+    return false;
+  }
+
+  sDisplay = display;
+  sNotify = notify;
+  sRunning.store(true);
+  sThread.thread = std::thread(raw_input_thread_proc);
+  return true;
+}
+
+void raw_input_stop() {
+  if (!sRunning.load()) {
+    return;
+  }
+
+  char stop = 0;
+  ssize_t unused = write(sStopPipe[1], &stop, 1);
+  (void) unused;
+  sThread.thread.join();
+
+  // A connection that failed is dropped, closing it would fail again.
+  if (!sLost.load()) {
+    x11_guarded(&close_display, sDisplay);
+  }
+  sDisplay = nullptr;
+  close(sStopPipe[0]);
+  close(sStopPipe[1]);
+  sLost.store(false);
+  sRunning.store(false);
+}
+
+#else
+
+bool raw_input_start(raw_input_notify_proc notify, std::string *error) {
+  *error = "Raw input requires XInput 2 and is only available on Linux";
+  return false;
+}
+
+void raw_input_stop() {
+}
+
+#endif
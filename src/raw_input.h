@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "packed_event.h"
+
+// Raw input read through XInput2 on Linux, next to the regular hook:
+// unaccelerated relative motion and key and button presses, tagged with the
+// id of the physical device they come from.  A thread of its own reads them
+// from the X server and queues them for the main thread.  Not available on
+// other platforms.
+//
+// Raw events reuse packed_event with types from EVENT_RAW_MOTION up.  mask
+// holds the source device id and the payload is:
+//   motion          data[0] = dx, data[1] = dy, 16.16 fixed point
+//   key / button    data[0] = X keycode or button number
+
+#define EVENT_RAW_MOTION            32
+#define EVENT_RAW_KEY_PRESSED       33
+#define EVENT_RAW_KEY_RELEASED      34
+#define EVENT_RAW_BUTTON_PRESSED    35
+#define EVENT_RAW_BUTTON_RELEASED   36
+
+// Called on the raw input thread after new events have been queued.
+typedef void (*raw_input_notify_proc)();
+
+// Main thread.  Returns false and a description of the problem if the X
+// server cannot be reached or does not support XInput 2.1.  Reconnects if
+// the raw input thread lost its connection.
+bool raw_input_start(raw_input_notify_proc notify, std::string *error);
+
+// Main thread.  Stops and joins the raw input thread, if running.
+void raw_input_stop();
+
+// False once the X connection was lost, e.g. because the X server went away.
+bool raw_input_running();
+
+// Main thread, consumer side of the raw event queue.
+bool raw_input_pop(packed_event *event);
+size_t raw_input_pending();
+uint64_t raw_input_time_base();
+uint64_t raw_input_dropped();
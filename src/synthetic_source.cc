@@ -0,0 +1,103 @@
+#include "synthetic_source.h"
+#include "clock.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Events are generated in ticks of this length to reach high rates without
+// sleeping between every single event.
+#define SYNTHETIC_TICK_NS  1000000ULL
+
+static std::atomic<double> sRate(1000.0);
+static std::atomic<uint64_t> sLimit(0);
+static std::atomic<bool> sFailAtLimit(false);
+static std::atomic<bool> sStopRequested(false);
+
+void synthetic_set_rate(double rate) {
+  sRate.store(rate);
+}
+
+void synthetic_set_limit(uint64_t count) {
+  sLimit.store(count);
+}
+
+void synthetic_set_fail_at_limit(bool enabled) {
+  sFailAtLimit.store(enabled);
+}
+
+static uint64_t wall_time_ms() {
+  return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void dispatch_lifecycle(dispatcher_t dispatch, void *user_data, event_type type) {
+  uiohook_event event;
+  memset(&event, 0, sizeof(uiohook_event));
+  event.type = type;
+  event.time = wall_time_ms();
+  dispatch(&event, user_data);
+}
+
+int synthetic_run(dispatcher_t dispatch, void *user_data) {
+  sStopRequested.store(false);
+  dispatch_lifecycle(dispatch, user_data, EVENT_HOOK_ENABLED);
+
+  uiohook_event event;
+  memset(&event, 0, sizeof(uiohook_event));
+  event.type = EVENT_MOUSE_MOVED;
+
+  uint64_t limit = sLimit.load();
+  uint64_t sent = 0;
+  uint64_t start = monotonic_ns();
+  uint64_t tick = 0;
+  while (!sStopRequested.load(std::memory_order_relaxed) && (limit == 0 || sent < limit)) {
+    // Number of events due by the end of this tick.
+    double rate = sRate.load(std::memory_order_relaxed);
+    tick++;
+    uint64_t due = rate > 0 ? (uint64_t) (rate * (double) (tick * SYNTHETIC_TICK_NS) / 1e9) : sent + 1024;
+    if (limit > 0 && due > limit) {
+      due = limit;
+    }
+
+    uint64_t now_ms = wall_time_ms();
+    for (; sent < due; sent++) {
+      // Trace a circle so that consumers see plausible coordinates.
+      double angle = (double) sent * 0.01;
+      event.time = now_ms;
+      event.data.mouse.x = (int16_t) (500 + 300 * cos(angle));
+      event.data.mouse.y = (int16_t) (500 + 300 * sin(angle));
+      dispatch(&event, user_data);
+    }
+
+    if (rate > 0) {
+      uint64_t deadline = start + tick * SYNTHETIC_TICK_NS;
+      uint64_t now = monotonic_ns();
+      if (deadline > now) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now));
+      }
+    }
+  }
+
+  if (limit > 0 && sent >= limit && sFailAtLimit.load()) {
+    dispatch_lifecycle(dispatch, user_data, EVENT_HOOK_DISABLED);
+    return UIOHOOK_FAILURE;
+  }
+
+  // Behave like a hook that is still running until explicitly stopped.
+  while (!sStopRequested.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  dispatch_lifecycle(dispatch, user_data, EVENT_HOOK_DISABLED);
+  return UIOHOOK_SUCCESS;
+}
+
+int synthetic_stop() {
+  sStopRequested.store(true);
+  return UIOHOOK_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "uiohook.h"
+
+// A stand-in for hook_run()/hook_stop() that generates mouse movement at a
+// fixed rate instead of listening to the OS.  It follows the same lifecycle
+// as libuiohook: EVENT_HOOK_ENABLED is dispatched first, synthetic_run()
+// blocks until synthetic_stop() is called and EVENT_HOOK_DISABLED is
+// dispatched last.  Used by benchmarks and stress tests, and works without a
+// display server.
+
+// Events per second; rate <= 0 means as fast as possible.
+void synthetic_set_rate(double rate);
+
+// Stop by itself after count events, 0 means run until stopped.
+void synthetic_set_limit(uint64_t count);
+
+// When enabled, synthetic_run() returns UIOHOOK_FAILURE once the limit is
+// reached, like a backend that lost its connection, instead of waiting to be
+// stopped.  For exercising the watchdog.
+void synthetic_set_fail_at_limit(bool enabled);
+
+int synthetic_run(dispatcher_t dispatch, void *user_data);
+
+int synthetic_stop();
@@ -0,0 +1,49 @@
+#include "x11_guard.h"
+
+#if !defined(_WIN32) && !(defined(__APPLE__) && defined(__MACH__))
+
+#include <setjmp.h>
+
+#include <mutex>
+
+#include <X11/Xlib.h>
+
+// Where the IO error handler jumps to on a thread inside x11_guarded().
+static thread_local jmp_buf *tRecover = nullptr;
+
+static XIOErrorHandler sPreviousHandler = nullptr;
+static std::once_flag sInstalled;
+
+static int io_error_handler(Display *display) {
+  if (tRecover != nullptr) {
+    longjmp(*tRecover, 1);
+  }
+  return sPreviousHandler != nullptr ? sPreviousHandler(display) : 0;
+}
+
+bool x11_guarded(x11_guarded_proc proc, void *user_data) {
+  std::call_once(sInstalled, [] {
+    sPreviousHandler = XSetIOErrorHandler(&io_error_handler);
+  });
+
+  jmp_buf recover;
+  jmp_buf *outer = tRecover;
+  if (setjmp(recover) != 0) {
+    tRecover = outer;
+    return false;
+  }
+
+  tRecover = &recover;
+  proc(user_data);
+  tRecover = outer;
+  return true;
+}
+
+#else
+
+bool x11_guarded(x11_guarded_proc proc, void *user_data) {
+  proc(user_data);
+  return true;
+}
+
+#endif
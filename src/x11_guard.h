@@ -0,0 +1,16 @@
+#pragma once
+
+// Xlib ends the process when an X connection fails, e.g. because the X
+// server went away: its IO error handler is not allowed to return.  Work
+// done on our own connections (the watchdog probe, raw input) goes through
+// x11_guarded() instead, so that the thread loses its connection but the
+// process lives on.  Connections of other threads, such as the hook's,
+// keep the previous handler.  X11 platforms only.
+
+typedef void (*x11_guarded_proc)(void *user_data);
+
+// Calls proc(user_data) and returns true, or false if an X connection
+// failed while it ran; proc then did not finish.  The failed connection can
+// neither be used nor closed any more.  proc must not own objects with
+// destructors.
+bool x11_guarded(x11_guarded_proc proc, void *user_data);
@@ -0,0 +1,42 @@
+const ioHook = require('../index');
+
+// Replaces the OS hook with the synthetic source and starts it.  The
+// synthetic source emits `limit` mousemove events at `rate` per second,
+// tracing a circle of radius 300 around (500, 500).
+function startSynthetic(limit, rate = 2000) {
+  ioHook.unload();
+  ioHook.useSyntheticSource(true, rate, limit);
+  ioHook.load();
+  ioHook.start();
+}
+
+// Goes back to the OS hook; for afterEach.
+function stopSynthetic() {
+  ioHook.unload();
+  ioHook.useSyntheticSource(false);
+  ioHook.load();
+}
+
+function wait(ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms));
+}
+
+// Resolves with copies of the events (or the buffers) emitted as eventName
+// within timeoutMs.
+function collect(eventName, timeoutMs) {
+  const received = [];
+  ioHook.on(eventName, (event) => received.push(Buffer.isBuffer(event) ? event : Object.assign({}, event)));
+  return wait(timeoutMs).then(() => received);
+}
+
+// Records of the ndjson buffers received, in order.  Unlike event objects,
+// they carry the full event time.
+function parseNdjson(buffers) {
+  return Buffer.concat(buffers)
+    .toString('utf8')
+    .split('\n')
+    .filter((line) => line.length > 0)
+    .map((line) => JSON.parse(line));
+}
+
+module.exports = { ioHook, startSynthetic, stopSynthetic, wait, collect, parseNdjson };
@@ -0,0 +1,59 @@
+const { ioHook, startSynthetic, stopSynthetic, collect } = require('../helpers');
+
+describe('Native event filter', () => {
+  afterEach(() => {
+    ioHook.removeAllListeners('mousemove');
+    ioHook.setFilter(null);
+    stopSynthetic();
+  });
+
+  it('throws a SyntaxError with the position of an invalid expression', () => {
+    expect(() => ioHook.setFilter('x >')).toThrow(SyntaxError);
+    expect(() => ioHook.setFilter('x > 1 &&')).toThrow(/at position 8/);
+    expect(() => ioHook.setFilter('nosuchfield == 1')).toThrow(SyntaxError);
+    expect(() => ioHook.setFilter('x == 0x')).toThrow(/invalid number/);
+    expect(() => ioHook.setFilter('x == 12abc')).toThrow(/invalid number/);
+    expect(() => ioHook.setFilter('x @ 1')).toThrow(/unexpected character/);
+  });
+
+  it('accepts decimal numbers with leading zeros and hexadecimal numbers', () => {
+    expect(() => ioHook.setFilter('x == 08')).not.toThrow();
+    expect(() => ioHook.setFilter('x == 0x1F4 || x == 0X1f4')).not.toThrow();
+    expect(() => ioHook.setFilter('rotation == -0x1')).not.toThrow();
+  });
+
+  it('only delivers events matching the expression', async () => {
+    const rejected = ioHook.getStats().filter.rejected;
+    ioHook.setFilter('type == mousemove && x >= 0500');
+    startSynthetic(400);
+
+    const received = await collect('mousemove', 500);
+    expect(received.length).toBeGreaterThan(0);
+    expect(received.length).toBeLessThan(400);
+    for (const event of received) {
+      expect(event.x).toBeGreaterThanOrEqual(500);
+    }
+
+    // Every event the filter turned down is counted.
+    const stats = ioHook.getStats().filter;
+    expect(stats.active).toBe(true);
+    expect(stats.rejected - rejected).toBe(400 - received.length);
+  });
+
+  it('delivers nothing when no event can match', async () => {
+    ioHook.setFilter('type in (keydown, keyup)');
+    startSynthetic(200);
+
+    const received = await collect('mousemove', 300);
+    expect(received).toEqual([]);
+  });
+
+  it('delivers everything again once the filter is removed', async () => {
+    ioHook.setFilter('x < 0');
+    ioHook.setFilter(null);
+    startSynthetic(200);
+
+    const received = await collect('mousemove', 300);
+    expect(received.length).toBe(200);
+  });
+});
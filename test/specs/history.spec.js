@@ -0,0 +1,76 @@
+const robot = require('robotjs');
+const { ioHook, startSynthetic, stopSynthetic, wait } = require('../helpers');
+
+const KEYDOWN = 4;
+const MOUSEMOVE = 9;
+
+// Keycodes of the key presses in a dumped batch.
+function keydowns(batch) {
+  const keycodes = [];
+  for (let i = 0; i < batch.length; i++) {
+    if (batch.type[i] === KEYDOWN) {
+      keycodes.push(batch.keycode[i]);
+    }
+  }
+  return keycodes;
+}
+
+describe('Event history', () => {
+  afterEach(() => {
+    ioHook.setHistory();
+    stopSynthetic();
+  });
+
+  it('redacts typed keys by default', () => {
+    ioHook.setHistory();
+    expect(ioHook.getStats().history.redact).toBe(true);
+  });
+
+  it('keeps the most recent events up to its capacity', async () => {
+    ioHook.setHistory({ events: 64, seconds: 0 });
+    startSynthetic(500);
+    await wait(500);
+
+    const batch = ioHook.dumpHistory();
+    expect(batch.length).toBeGreaterThan(0);
+    expect(batch.length).toBeLessThanOrEqual(64);
+    for (let i = 0; i < batch.length; i++) {
+      expect(batch.type[i]).toBe(MOUSEMOVE);
+      if (i > 0) {
+        expect(batch.time[i]).toBeGreaterThanOrEqual(batch.time[i - 1]);
+      }
+    }
+
+    const binary = ioHook.dumpHistory({ binary: true });
+    expect(binary.events.length % 16).toBe(0);
+    expect(binary.events.length / 16).toBeLessThanOrEqual(64);
+  });
+
+  it('hides typed keys but keeps shortcuts when redacting', async () => {
+    // Changing the redaction setting clears the history.
+    ioHook.setHistory({ redact: false });
+    ioHook.setHistory({ redact: true });
+    ioHook.start();
+    await wait(50);
+
+    robot.keyTap('a');
+    robot.keyToggle('control', 'down');
+    robot.keyTap('a');
+    robot.keyToggle('control', 'up');
+    await wait(100);
+
+    // Ctrl (29), then Ctrl+A (30); the plain A is recorded without keycode.
+    expect(keydowns(ioHook.dumpHistory())).toEqual([0, 29, 30]);
+  });
+
+  it('records typed keys once redaction is turned off', async () => {
+    ioHook.setHistory({ redact: false });
+    ioHook.start();
+    await wait(50);
+
+    robot.keyTap('a');
+    await wait(100);
+
+    expect(keydowns(ioHook.dumpHistory())).toEqual([30]);
+  });
+});
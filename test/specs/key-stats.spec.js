@@ -0,0 +1,76 @@
+const ioHook = require('../../index');
+const robot = require('robotjs');
+
+const A = 30;
+const B = 48;
+
+function wait(ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms));
+}
+
+function countOf(entries, keys) {
+  const entry = entries.find((e) => e.keys.join() === keys.join());
+  return entry ? entry.count : 0;
+}
+
+describe('Key statistics', () => {
+  beforeEach(() => {
+    ioHook.enableKeyStats(true);
+    ioHook.resetKeyStats();
+  });
+
+  afterEach(() => {
+    ioHook.resetKeyStats();
+    ioHook.enableKeyStats(false);
+    ioHook.stop();
+  });
+
+  it('counts typed bigrams and never underestimates them', async () => {
+    ioHook.start();
+    await wait(50);
+    for (const key of 'abab') {
+      robot.keyTap(key);
+    }
+    await wait(100);
+
+    const stats = ioHook.getKeyStats();
+    expect(stats.enabled).toBe(true);
+    expect(stats.keystrokes).toBe(4);
+    expect(countOf(stats.bigrams, [A, B])).toBe(2);
+    expect(countOf(stats.bigrams, [B, A])).toBe(1);
+    expect(ioHook.estimateKeySequence([A, B])).toBeGreaterThanOrEqual(2);
+    expect(ioHook.estimateKeySequence([A, B, A])).toBeGreaterThanOrEqual(1);
+  });
+
+  it('restores an exported snapshot and merges it into current statistics', async () => {
+    ioHook.start();
+    await wait(50);
+    for (const key of 'abab') {
+      robot.keyTap(key);
+    }
+    await wait(100);
+
+    const stats = ioHook.getKeyStats();
+    const snapshot = ioHook.exportKeyStats();
+    expect(Buffer.isBuffer(snapshot)).toBe(true);
+
+    ioHook.resetKeyStats();
+    expect(ioHook.getKeyStats().keystrokes).toBe(0);
+
+    ioHook.importKeyStats(snapshot);
+    expect(ioHook.getKeyStats()).toEqual(stats);
+    expect(ioHook.exportKeyStats().equals(snapshot)).toBe(true);
+
+    ioHook.importKeyStats(snapshot);
+    const merged = ioHook.getKeyStats();
+    expect(merged.keystrokes).toBe(2 * stats.keystrokes);
+    expect(countOf(merged.bigrams, [A, B])).toBe(2 * countOf(stats.bigrams, [A, B]));
+    expect(ioHook.estimateKeySequence([A, B])).toBeGreaterThanOrEqual(4);
+  });
+
+  it('rejects snapshots that are not its own', () => {
+    expect(() => ioHook.importKeyStats(Buffer.from('not a snapshot'))).toThrow();
+    expect(() => ioHook.importKeyStats(Buffer.alloc(0))).toThrow();
+    expect(() => ioHook.importKeyStats('snapshot')).toThrow(TypeError);
+  });
+});
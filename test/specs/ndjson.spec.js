@@ -0,0 +1,64 @@
+const { ioHook, startSynthetic, stopSynthetic, collect, parseNdjson } = require('../helpers');
+
+function parse(buffers) {
+  buffers.forEach((buffer) => expect(buffer.toString('utf8').endsWith('\n')).toBe(true));
+  return parseNdjson(buffers);
+}
+
+describe('NDJSON delivery', () => {
+  afterEach(() => {
+    ioHook.removeAllListeners('ndjson');
+    ioHook.removeAllListeners('mousemove');
+    ioHook.setNdjsonMode(false);
+    ioHook.setDrainBudget(0, 0);
+    stopSynthetic();
+  });
+
+  it('delivers every event as one JSON line in a Buffer', async () => {
+    const moves = [];
+    ioHook.on('mousemove', (event) => moves.push(event));
+    ioHook.setNdjsonMode(true);
+    startSynthetic(200);
+
+    const buffers = await collect('ndjson', 400);
+    expect(buffers.length).toBeGreaterThan(0);
+    buffers.forEach((buffer) => expect(Buffer.isBuffer(buffer)).toBe(true));
+    expect(moves).toEqual([]);
+
+    const events = parse(buffers);
+    expect(events.length).toBe(200);
+    for (let i = 0; i < events.length; i++) {
+      const event = events[i];
+      expect(Object.keys(event)).toEqual(['type', 'time', 'mask', 'button', 'clicks', 'x', 'y']);
+      expect(event.type).toBe('mousemove');
+      // The synthetic source traces a circle of radius 300 around (500, 500).
+      expect(Math.hypot(event.x - 500, event.y - 500)).toBeCloseTo(300, -1);
+      if (i > 0) {
+        expect(event.time).toBeGreaterThanOrEqual(events[i - 1].time);
+      }
+    }
+  });
+
+  it('delivers whole buffers under a drain budget', async () => {
+    ioHook.setNdjsonMode(true);
+    ioHook.setDrainBudget(16, 0);
+    startSynthetic(200);
+
+    // The budget is checked between buffers, never inside one.
+    const buffers = await collect('ndjson', 400);
+    expect(buffers.length).toBeGreaterThan(0);
+    expect(parse(buffers).length).toBe(200);
+  });
+
+  it('goes back to event objects when turned off', async () => {
+    ioHook.setNdjsonMode(true);
+    ioHook.setNdjsonMode(false);
+    const moves = [];
+    ioHook.on('mousemove', (event) => moves.push(event));
+    startSynthetic(50);
+
+    const buffers = await collect('ndjson', 300);
+    expect(buffers).toEqual([]);
+    expect(moves.length).toBe(50);
+  });
+});
@@ -0,0 +1,78 @@
+const { ioHook, startSynthetic, stopSynthetic, wait } = require('../helpers');
+
+// Sorted property names of every event a listener received.
+function recordKeys(received) {
+  return (event) => received.push(Object.keys(event).sort());
+}
+
+describe('Event projection', () => {
+  const listeners = [];
+
+  function onFast(fields) {
+    const received = [];
+    const listener = recordKeys(received);
+    listeners.push(listener);
+    ioHook.onFast('mousemove', listener, fields);
+    return received;
+  }
+
+  afterEach(() => {
+    listeners.splice(0).forEach((listener) => ioHook.offFast('mousemove', listener));
+    ioHook.removeAllListeners('mousemove');
+    stopSynthetic();
+  });
+
+  it('only builds the declared fields', async () => {
+    const received = onFast(['x']);
+    startSynthetic(50);
+    await wait(200);
+
+    expect(received.length).toBe(50);
+    received.forEach((keys) => expect(keys).toEqual(['type', 'x']));
+  });
+
+  it('builds the union of the fields of all fast listeners', async () => {
+    const first = onFast({ fields: ['x'] });
+    const second = onFast(['y']);
+    startSynthetic(50);
+    await wait(200);
+
+    expect(first.length).toBe(50);
+    expect(second.length).toBe(50);
+    first.concat(second).forEach((keys) => expect(keys).toEqual(['type', 'x', 'y']));
+  });
+
+  it('builds full events as soon as a listener did not declare its fields', async () => {
+    const declared = onFast(['x']);
+    const everything = [];
+    ioHook.on('mousemove', recordKeys(everything));
+    startSynthetic(50);
+    await wait(200);
+
+    const full = ['button', 'clicks', 'type', 'x', 'y'];
+    expect(everything.length).toBe(50);
+    declared.concat(everything).forEach((keys) => expect(keys).toEqual(full));
+  });
+
+  it('goes back to the declared fields once the other listener is removed', async () => {
+    const received = onFast(['y']);
+    const listener = () => {};
+    ioHook.on('mousemove', listener);
+    ioHook.removeListener('mousemove', listener);
+    startSynthetic(50);
+    await wait(200);
+
+    expect(received.length).toBe(50);
+    received.forEach((keys) => expect(keys).toEqual(['type', 'y']));
+  });
+
+  it('rejects unknown fields and does not keep the listener', () => {
+    const listener = () => {};
+    expect(() => ioHook.onFast('mousemove', listener, ['keycode'])).toThrow(/Unknown event property/);
+    // Listeners never see the outer time or the wheel type.
+    expect(() => ioHook.onFast('mousemove', listener, ['time'])).toThrow(/Unknown event property/);
+    expect(() => ioHook.onFast('mousewheel', listener, ['scrollType'])).toThrow(/Unknown event property/);
+    expect(ioHook.fastListeners[9]).toBeUndefined();
+    expect(ioHook.fastListeners[11]).toBeUndefined();
+  });
+});
@@ -0,0 +1,72 @@
+const { ioHook, startSynthetic, stopSynthetic, collect, parseNdjson } = require('../helpers');
+
+// Event objects carry no time; NDJSON records do.
+async function collectTimed(timeoutMs) {
+  ioHook.setNdjsonMode(true);
+  return parseNdjson(await collect('ndjson', timeoutMs));
+}
+
+describe('Native samplers', () => {
+  afterEach(() => {
+    ioHook.removeAllListeners('mousemove');
+    ioHook.removeAllListeners('ndjson');
+    ioHook.setNdjsonMode(false);
+    ioHook.setSampler('mousemove', null);
+    stopSynthetic();
+  });
+
+  it('rejects unknown event types and options', () => {
+    expect(() => ioHook.setSampler('nosuchevent', { every: 2 })).toThrow(TypeError);
+    expect(() => ioHook.setSampler('rawmousemove', { every: 2 })).toThrow(TypeError);
+    expect(() => ioHook.setSampler('mousemove', { often: true })).toThrow(Error);
+  });
+
+  it('lets the first of every n events through and counts them', async () => {
+    ioHook.setSampler('mousemove', { every: 10 });
+    startSynthetic(200);
+
+    const received = await collect('mousemove', 400);
+    expect(received.length).toBe(20);
+    expect(ioHook.getStats().sampling.mousemove).toEqual({ seen: 200, sampled: 20 });
+  });
+
+  it('spaces events by at least the interval', async () => {
+    ioHook.setSampler('mousemove', { interval: 50 });
+    startSynthetic(300, 1000);
+
+    const received = await collectTimed(600);
+    expect(received.length).toBeGreaterThan(0);
+    for (let i = 1; i < received.length; i++) {
+      expect(received[i].time - received[i - 1].time).toBeGreaterThanOrEqual(50);
+    }
+
+    const stats = ioHook.getStats().sampling.mousemove;
+    expect(stats.seen).toBe(300);
+    expect(stats.sampled).toBe(received.length);
+  });
+
+  it('releases a reservoir sample when its window closes, without a later event', async () => {
+    ioHook.setSampler('mousemove', { reservoir: 5, window: 200 });
+    startSynthetic(100);
+
+    const received = await collectTimed(600);
+    expect(received.length).toBe(5);
+    for (let i = 1; i < received.length; i++) {
+      expect(received[i].time).toBeGreaterThanOrEqual(received[i - 1].time);
+    }
+    expect(ioHook.getStats().sampling.mousemove).toEqual({ seen: 100, sampled: 5 });
+  });
+
+  it('releases a pending reservoir sample when the sampler is removed', async () => {
+    ioHook.setSampler('mousemove', { reservoir: 7, window: 60000 });
+    startSynthetic(100);
+
+    const before = await collect('mousemove', 300);
+    expect(before.length).toBe(0);
+
+    ioHook.removeAllListeners('mousemove');
+    const received = collect('mousemove', 200);
+    ioHook.setSampler('mousemove', null);
+    expect((await received).length).toBe(7);
+  });
+});